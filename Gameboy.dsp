@@ -48,8 +48,8 @@ BSC32=bscmake.exe
 # ADD BASE BSC32 /nologo
 # ADD BSC32 /nologo
 LINK32=link.exe
-# ADD BASE LINK32 kernel32.lib user32.lib gdi32.lib winspool.lib comdlg32.lib advapi32.lib shell32.lib ole32.lib oleaut32.lib uuid.lib odbc32.lib odbccp32.lib kernel32.lib user32.lib gdi32.lib winspool.lib comdlg32.lib advapi32.lib shell32.lib ole32.lib oleaut32.lib uuid.lib odbc32.lib odbccp32.lib /nologo /subsystem:console /machine:I386
-# ADD LINK32 kernel32.lib user32.lib gdi32.lib winspool.lib comdlg32.lib advapi32.lib shell32.lib ole32.lib oleaut32.lib uuid.lib odbc32.lib odbccp32.lib kernel32.lib user32.lib gdi32.lib winspool.lib comdlg32.lib advapi32.lib shell32.lib ole32.lib oleaut32.lib uuid.lib odbc32.lib odbccp32.lib /nologo /subsystem:console /machine:I386
+# ADD BASE LINK32 kernel32.lib user32.lib gdi32.lib winspool.lib comdlg32.lib advapi32.lib shell32.lib ole32.lib oleaut32.lib uuid.lib odbc32.lib odbccp32.lib kernel32.lib user32.lib gdi32.lib winspool.lib comdlg32.lib advapi32.lib shell32.lib ole32.lib oleaut32.lib uuid.lib odbc32.lib odbccp32.lib winmm.lib /nologo /subsystem:console /machine:I386
+# ADD LINK32 kernel32.lib user32.lib gdi32.lib winspool.lib comdlg32.lib advapi32.lib shell32.lib ole32.lib oleaut32.lib uuid.lib odbc32.lib odbccp32.lib kernel32.lib user32.lib gdi32.lib winspool.lib comdlg32.lib advapi32.lib shell32.lib ole32.lib oleaut32.lib uuid.lib odbc32.lib odbccp32.lib winmm.lib /nologo /subsystem:console /machine:I386
 
 !ELSEIF  "$(CFG)" == "Gameboy - Win32 Debug"
 
@@ -72,8 +72,8 @@ BSC32=bscmake.exe
 # ADD BASE BSC32 /nologo
 # ADD BSC32 /nologo
 LINK32=link.exe
-# ADD BASE LINK32 kernel32.lib user32.lib gdi32.lib winspool.lib comdlg32.lib advapi32.lib shell32.lib ole32.lib oleaut32.lib uuid.lib odbc32.lib odbccp32.lib kernel32.lib user32.lib gdi32.lib winspool.lib comdlg32.lib advapi32.lib shell32.lib ole32.lib oleaut32.lib uuid.lib odbc32.lib odbccp32.lib /nologo /subsystem:console /debug /machine:I386 /pdbtype:sept
-# ADD LINK32 kernel32.lib user32.lib gdi32.lib winspool.lib comdlg32.lib advapi32.lib shell32.lib ole32.lib oleaut32.lib uuid.lib odbc32.lib odbccp32.lib kernel32.lib user32.lib gdi32.lib winspool.lib comdlg32.lib advapi32.lib shell32.lib ole32.lib oleaut32.lib uuid.lib odbc32.lib odbccp32.lib /nologo /subsystem:windows /debug /machine:I386 /pdbtype:sept
+# ADD BASE LINK32 kernel32.lib user32.lib gdi32.lib winspool.lib comdlg32.lib advapi32.lib shell32.lib ole32.lib oleaut32.lib uuid.lib odbc32.lib odbccp32.lib kernel32.lib user32.lib gdi32.lib winspool.lib comdlg32.lib advapi32.lib shell32.lib ole32.lib oleaut32.lib uuid.lib odbc32.lib odbccp32.lib winmm.lib /nologo /subsystem:console /debug /machine:I386 /pdbtype:sept
+# ADD LINK32 kernel32.lib user32.lib gdi32.lib winspool.lib comdlg32.lib advapi32.lib shell32.lib ole32.lib oleaut32.lib uuid.lib odbc32.lib odbccp32.lib kernel32.lib user32.lib gdi32.lib winspool.lib comdlg32.lib advapi32.lib shell32.lib ole32.lib oleaut32.lib uuid.lib odbc32.lib odbccp32.lib winmm.lib /nologo /subsystem:windows /debug /machine:I386 /pdbtype:sept
 # SUBTRACT LINK32 /pdb:none
 
 !ENDIF 
@@ -87,6 +87,18 @@ LINK32=link.exe
 # PROP Default_Filter "cpp;c;cxx;rc;def;r;odl;idl;hpj;bat"
 # Begin Source File
 
+SOURCE=.\hash.c
+# End Source File
+# Begin Source File
+
+SOURCE=.\joypad.c
+# End Source File
+# Begin Source File
+
+SOURCE=.\lockstep.c
+# End Source File
+# Begin Source File
+
 SOURCE=.\main.c
 # End Source File
 # Begin Source File
@@ -95,6 +107,46 @@ SOURCE=.\memory.c
 # End Source File
 # Begin Source File
 
+SOURCE=.\movie.c
+# End Source File
+# Begin Source File
+
+SOURCE=.\pace.c
+# End Source File
+# Begin Source File
+
+SOURCE=.\pool.c
+# End Source File
+# Begin Source File
+
+SOURCE=.\rewind.c
+# End Source File
+# Begin Source File
+
+SOURCE=.\rtc.c
+# End Source File
+# Begin Source File
+
+SOURCE=.\runner.c
+# End Source File
+# Begin Source File
+
+SOURCE=.\serial.c
+# End Source File
+# Begin Source File
+
+SOURCE=.\sound.c
+# End Source File
+# Begin Source File
+
+SOURCE=.\state.c
+# End Source File
+# Begin Source File
+
+SOURCE=.\timer.c
+# End Source File
+# Begin Source File
+
 SOURCE=.\video.c
 # End Source File
 # Begin Source File
@@ -123,10 +175,62 @@ SOURCE=.\gameboy.h
 # End Source File
 # Begin Source File
 
+SOURCE=.\hash.h
+# End Source File
+# Begin Source File
+
+SOURCE=.\joypad.h
+# End Source File
+# Begin Source File
+
+SOURCE=.\lockstep.h
+# End Source File
+# Begin Source File
+
 SOURCE=.\memory.h
 # End Source File
 # Begin Source File
 
+SOURCE=.\movie.h
+# End Source File
+# Begin Source File
+
+SOURCE=.\pace.h
+# End Source File
+# Begin Source File
+
+SOURCE=.\pool.h
+# End Source File
+# Begin Source File
+
+SOURCE=.\rewind.h
+# End Source File
+# Begin Source File
+
+SOURCE=.\rtc.h
+# End Source File
+# Begin Source File
+
+SOURCE=.\runner.h
+# End Source File
+# Begin Source File
+
+SOURCE=.\serial.h
+# End Source File
+# Begin Source File
+
+SOURCE=.\sound.h
+# End Source File
+# Begin Source File
+
+SOURCE=.\state.h
+# End Source File
+# Begin Source File
+
+SOURCE=.\timer.h
+# End Source File
+# Begin Source File
+
 SOURCE=.\video.h
 # End Source File
 # Begin Source File
@@ -39,9 +39,28 @@ MA  02110-1301, USA.
  #include "ps2.h"
 #endif
 
+/* an emulated machine. The emulator keeps no global state of its own so
+	any number of machines can run side by side; module functions take a
+	pointer to the instance they operate on */
+typedef struct Gameboy_s Gameboy_t;
+
+/* an incrementally updated save state, see state.h */
+typedef struct Checkpoint_s Checkpoint_t;
+
+#include "z80.h"
 #include "memory.h"
 #include "video.h"
-#include "z80.h"
+#include "joypad.h"
+#include "pace.h"
+#include "timer.h"
+#include "serial.h"
+#include "sound.h"
+#include "rtc.h"
+#include "hash.h"
+#include "runner.h"
+#include "lockstep.h"
+#include "movie.h"
+#include "pool.h"
 
 /* function return values */
 #define GB_EMU_OK					1
@@ -97,10 +116,11 @@ MA  02110-1301, USA.
 /*
  * host_blt - Perform block transfer of bitmap data.
  *
- * This is called by the emulator when a VBLANK interrupt occurs to
- * redraw the screen. For Win32 this means invalidating the window
- * and calling StretchBlt to blt the image data into the window's
- * device context.
+ * This is called by the presentation thread whenever the emulator has
+ *	completed a new frame. The frame holds SCREEN_WIDTH * SCREEN_HEIGHT
+ *	shade indices which map to the colors in GBColors. For Win32 this
+ *	means converting the frame into the DIB and invalidating the window
+ *	so StretchBlt blts it into the window's device context.
  *
  */
 #ifdef WIN32
@@ -112,25 +132,206 @@ MA  02110-1301, USA.
 #endif
 
 /*
- * host_plot - Plot a pixel to the display.
+ * host_thread - Start a new thread.
+ *
+ * The emulator runs on its own thread so that presenting frames and
+ *	processing user input never stall emulation. The host starts a
+ *	thread that calls func(arg) and terminates when func returns.
+ *
+ * @return
+ *	GB_EMU_OK if the thread was started, otherwise GB_EMU_ERROR.
+ */
+#ifdef WIN32
+ #define host_thread win32_thread
+#elif PS2
+ #define host_thread ps2_thread
+#else
+ #error Please supply system-specific host_thread function.
+#endif
+
+/*
+ * host_xchg - Atomically exchange an integer.
+ *
+ * Stores a new value and returns the old one as a single atomic operation
+ *	that also acts as a full memory barrier. This is all the emulator
+ *	needs to pass data between threads without locks. For Win32 this is
+ *	InterlockedExchange.
+ *
+ */
+#ifdef WIN32
+ #define host_xchg win32_xchg
+#elif PS2
+ #define host_xchg ps2_xchg
+#else
+ #error Please supply system-specific host_xchg function.
+#endif
+
+/*
+ * host_add - Atomically add to an integer.
+ *
+ * Adds a value to an integer and returns the old value as a single atomic
+ *	operation that also acts as a full memory barrier. This is used for
+ *	the reference counts of memory shared between machines that run on
+ *	different threads. For Win32 this is InterlockedExchangeAdd.
+ *
+ */
+#ifdef WIN32
+ #define host_add win32_add
+#elif PS2
+ #define host_add ps2_add
+#else
+ #error Please supply system-specific host_add function.
+#endif
+
+/*
+ * host_time - Retrieve a timestamp in microseconds.
+ *
+ * This is used by the emulator to decide when host_sys needs to be
+ *	called and to measure how much time is spent in the host environment.
+ *	The timestamp may wrap around, only differences between two
+ *	timestamps are ever used. For Win32 this uses the performance
+ *	counter.
+ *
+ */
+#ifdef WIN32
+ #define host_time win32_time
+#elif PS2
+ #define host_time ps2_time
+#else
+ #error Please supply system-specific host_time function.
+#endif
+
+/*
+ * host_clock - Retrieve the wall clock time in seconds.
+ *
+ * This is used by the clock of MBC3 cartridges, which keeps running
+ *	while the emulator isn't. Unlike host_time, it must count the seconds
+ *	since a fixed point in time, e.g. the Unix epoch. For Win32 this
+ *	uses GetSystemTimeAsFileTime.
+ *
+ */
+#ifdef WIN32
+ #define host_clock win32_clock
+#elif PS2
+ #define host_clock ps2_clock
+#else
+ #error Please supply system-specific host_clock function.
+#endif
+
+/*
+ * host_sleep - Suspend the calling thread.
+ *
+ * This is called by the frame pacing code to give up the CPU until
+ *	shortly before the next frame is due. The host should sleep for
+ *	about the given number of milliseconds; sleeping a bit shorter is
+ *	preferable to sleeping longer.
+ *
+ */
+#ifdef WIN32
+ #define host_sleep win32_sleep
+#elif PS2
+ #define host_sleep ps2_sleep
+#else
+ #error Please supply system-specific host_sleep function.
+#endif
+
+/*
+ * host_map_file - Map a file into memory, read-only.
+ *
+ * This is used to load ROM files without copying them. The file is
+ *	mapped as a whole and pages are read in by the host when they are
+ *	first touched. Hosts without memory-mapped files can read the file
+ *	into memory instead. For Win32 this is MapViewOfFile.
+ *
+ * @return
+ *	A pointer to the contents of the file, with its size stored in the
+ *	variable 'size' points to, or NULL if the file could not be mapped.
+ */
+#ifdef WIN32
+ #define host_map_file win32_map_file
+#elif PS2
+ #define host_map_file ps2_map_file
+#else
+ #error Please supply system-specific host_map_file function.
+#endif
+
+/*
+ * host_unmap_file - Unmap a file mapped by host_map_file.
+ *
+ */
+#ifdef WIN32
+ #define host_unmap_file win32_unmap_file
+#elif PS2
+ #define host_unmap_file ps2_unmap_file
+#else
+ #error Please supply system-specific host_unmap_file function.
+#endif
+
+/*
+ * host_map_save - Map a save file into memory, for reading and writing.
+ *
+ * The file is created if it doesn't exist and grown to the given size
+ *	if it is smaller, the new part reading as zeros. The mapping must be
+ *	shared with the file, so that changes end up in the file even if the
+ *	emulator crashes. It is unmapped with host_unmap_file. For Win32 this
+ *	is MapViewOfFile with FILE_MAP_WRITE.
+ *
+ * @return
+ *	A pointer to the first 'size' bytes of the file, or NULL if the file
+ *	could not be mapped.
+ */
+#ifdef WIN32
+ #define host_map_save win32_map_save
+#elif PS2
+ #define host_map_save ps2_map_save
+#else
+ #error Please supply system-specific host_map_save function.
+#endif
+
+/*
+ * host_flush_file - Start writing back a mapped save file.
+ *
+ * Asks the host to write changed pages of a file mapped by host_map_save
+ *	to disk. This is called from the emulation thread and should not
+ *	wait for the writes to complete. For Win32 this is FlushViewOfFile.
+ *
+ */
+#ifdef WIN32
+ #define host_flush_file win32_flush_file
+#elif PS2
+ #define host_flush_file ps2_flush_file
+#else
+ #error Please supply system-specific host_flush_file function.
+#endif
+
+/*
+ * HOST_SYS_INTERVAL - Default interval between calls to host_sys.
  *
- * This is called by the emulator when it needs to plot a pixel to
- *	the screen. For Win32 this manipulates the DIB bit values
- *	returned CreateDIBSection.
+ * The emulator calls host_sys at most once per interval (in microseconds)
+ *	while executing a ROM. Hosts that need to be serviced more often, or
+ *	less often, can pick a different value.
  *
  */
 #ifdef WIN32
- #define host_plot win32_plot
+ #define HOST_SYS_INTERVAL WIN32_SYS_INTERVAL
 #elif PS2
- #define host_plot win32_plot
+ #define HOST_SYS_INTERVAL PS2_SYS_INTERVAL
 #else
- #error Please supply system-specific host_plot function.
+ #error Please supply system-specific HOST_SYS_INTERVAL value.
 #endif
 
 
 /* The following functions are exported by the emulator and can be called
 	from the host environment to control the emulator. */
 
+/* host servicing statistics returned by gb_emu_host_stats */
+typedef struct {
+	unsigned int Interval;		/* interval between host_sys calls, in usec */
+	unsigned int Calls;			/* number of times host_sys was called */
+	unsigned int Time;			/* total time spent in host_sys, in usec */
+	unsigned int Last;			/* timestamp of the last host_sys call */
+} HostStats_t;
+
 /*
  * gb_emu_start - Start execution of a GameBoy ROM file.
  *
@@ -146,6 +347,26 @@ MA  02110-1301, USA.
  */
 EMU_EXPORT int gb_emu_start( unsigned char *rom, unsigned int rom_size );
 
+/*
+ * gb_emu_start_file - Start execution of a GameBoy ROM file on disk.
+ *
+ * Like gb_emu_start, but the file is mapped into memory with
+ *	host_map_file instead of being read and copied. Starting takes the
+ *	same time for any size of cartridge, the banks are read in as the
+ *	game touches them. Cartridges with battery-backed RAM keep it in a
+ *	file named after the ROM file with the extension .sav, which is
+ *	written back at most once a second and when the emulator stops.
+ *
+ * @param path
+ *	Path of the ROM file.
+ *
+ * @return
+ *	If the ROM was successfully loaded, GB_EMU_OK is returned. If the file
+ *	could not be mapped or is not a valid GameBoy ROM, GB_EMU_ERROR is
+ *	returned.
+ */
+EMU_EXPORT int gb_emu_start_file( const char *path );
+
 /*
  * gb_emu_stop - Stop execution of current ROM file.
  *
@@ -184,15 +405,468 @@ EMU_EXPORT int gb_emu_status( void );
  */
 EMU_EXPORT void gb_emu_shutdown( void );
 
+/*
+ * gb_emu_input - Passes the state of the joypad to the emulator.
+ *
+ * Call this from the presentation thread whenever the user presses or
+ *	releases a button. States are queued and applied by the emulation
+ *	thread at the next frame boundary.
+ *
+ * @param buttons
+ *	Pressed buttons, a combination of the JOYPAD_* bits.
+ *
+ * @return
+ *	GB_EMU_OK if the state was queued, GB_EMU_ERROR if the emulator has
+ *	fallen too far behind to take more input.
+ */
+EMU_EXPORT int gb_emu_input( unsigned char buttons );
+
+/*
+ * gb_emu_frame - Retrieves the most recently completed frame.
+ *
+ * @return
+ *	A pointer to SCREEN_WIDTH * SCREEN_HEIGHT shade indices if a new frame
+ *	has been completed since the last call, otherwise NULL. The frame
+ *	stays valid until the next call.
+ */
+EMU_EXPORT unsigned char *gb_emu_frame( void );
+
+/*
+ * gb_emu_set_host_interval - Sets the interval between host_sys calls.
+ *
+ * @param usec
+ *	Minimum time between two calls of host_sys while executing a ROM, in
+ *		microseconds. Pass 0 to service the host at every poll point.
+ */
+EMU_EXPORT void gb_emu_set_host_interval( unsigned int usec );
+
+/*
+ * gb_emu_host_stats - Retrieves host servicing statistics.
+ *
+ * @param Stats
+ *	A pointer to a HostStats_t structure that receives the number of
+ *		host_sys calls and the time spent in them.
+ */
+EMU_EXPORT void gb_emu_host_stats( HostStats_t *Stats );
+
+/*
+ * gb_emu_set_speed - Sets the emulation speed.
+ *
+ * @param percent
+ *	Emulation speed in percent of a real Gameboy. 100 runs at the original
+ *		59.73 Hz, 200 at twice that speed and so on.
+ */
+EMU_EXPORT void gb_emu_set_speed( unsigned int percent );
+
+/*
+ * gb_emu_set_turbo - Enables or disables turbo mode.
+ *
+ * In turbo mode the emulator runs as fast as it possibly can. Frame
+ *	pacing is disabled and no frames are blitted to the screen which
+ *	is useful for fast-forwarding and batch work.
+ *
+ * @param turbo
+ *	Set to 1 to enable turbo mode, 0 to go back to paced execution.
+ *
+ * @return
+ *	The function returns the old turbo mode setting.
+ */
+EMU_EXPORT int gb_emu_set_turbo( int turbo );
+
+/*
+ * gb_emu_set_run_ahead - Sets the number of frames to run ahead.
+ *
+ * Most games react to input a frame or two late. With run-ahead the
+ *	emulator saves its state after every frame, emulates a number of
+ *	extra frames with the current input and presents the last one
+ *	before rolling back. This hides the game's internal input lag at
+ *	the cost of emulating that many more frames.
+ *
+ * @param frames
+ *	Number of frames to run ahead, 0 to disable run-ahead. Values larger
+ *		than RUN_AHEAD_MAX are clamped.
+ */
+EMU_EXPORT void gb_emu_set_run_ahead( int frames );
+
+/*
+ * gb_emu_pace_stats - Retrieves frame pacing statistics.
+ *
+ * @param Stats
+ *	A pointer to a Pace_t structure that receives the current speed, the
+ *		number of paced and late frames and the measured frame-time
+ *		jitter.
+ */
+EMU_EXPORT void gb_emu_pace_stats( Pace_t *Stats );
+
+/*
+ * gb_emu_run_jobs - Runs a batch of ROMs on a pool of worker threads.
+ *
+ * Every job gets a machine of its own which is unaffected by and doesn't
+ *	affect the machine controlled by the other exported functions. The
+ *	jobs run unthrottled and their frames are never presented.
+ *
+ * @param Jobs
+ *	Array of jobs, see RunJob_t. The runner stores the result, latency
+ *		and run time of each job in the array.
+ * @param NumJobs
+ *	Number of jobs in the array.
+ * @param Workers
+ *	Number of worker threads to run the jobs on, at most
+ *		RUNNER_MAX_WORKERS.
+ * @param Stats
+ *	A pointer to a RunStats_t structure that receives the aggregate
+ *		frames per second and job latencies.
+ *
+ * @return
+ *	GB_EMU_OK if the batch was run, otherwise GB_EMU_ERROR.
+ */
+EMU_EXPORT int gb_emu_run_jobs( RunJob_t *Jobs, unsigned int NumJobs,
+	unsigned int Workers, RunStats_t *Stats );
+
+/*
+ * gb_emu_movie - Attaches a movie to the emulator.
+ *
+ * Movies start at power-on, so the movie is recorded or played back from
+ *	the next time a ROM is started with gb_emu_start. While a movie is
+ *	played back, the user's input is ignored. Once it is over, the user
+ *	takes over.
+ *
+ * @param Movie
+ *	A pointer to a Movie_t structure set up for recording or playback,
+ *		see movie_record and movie_load, or NULL to detach the movie.
+ *		The movie must stay around until it is detached.
+ *
+ * @return
+ *	GB_EMU_OK if the movie was attached, GB_EMU_ERROR if a ROM is being
+ *	executed.
+ */
+EMU_EXPORT int gb_emu_movie( Movie_t *Movie );
+
+/*
+ * gb_emu_replay - Plays back a movie as fast as possible.
+ *
+ * The movie is played back on a machine of its own, unthrottled and
+ *	without presenting frames. This is meant for reproducing bugs and
+ *	for benchmarking.
+ *
+ * @param rom
+ *	A pointer to the GameBoy ROM image the movie was recorded with.
+ * @param rom_size
+ *	Size of the ROM image pointed to by 'rom', in bytes.
+ * @param Movie
+ *	A pointer to the movie.
+ *
+ * @return
+ *	GB_EMU_OK if the movie was played back to the end, otherwise
+ *	GB_EMU_ERROR.
+ */
+EMU_EXPORT int gb_emu_replay( unsigned char *rom, unsigned int rom_size,
+	Movie_t *Movie );
+
+/*
+ * gb_emu_save_state - Saves the state of the running game.
+ *
+ * The state can be kept in memory or written to disk. It is independent
+ *	of the host's byte order and can be restored with gb_emu_load_state
+ *	as long as the same cartridge is loaded.
+ *
+ * @param data
+ *	A pointer to a variable that receives a pointer to the state image.
+ *		The caller releases it with free.
+ * @param size
+ *	A pointer to a variable that receives the size of the image, in bytes.
+ *
+ * @return
+ *	GB_EMU_OK on success, GB_EMU_ERROR if no ROM is being executed or
+ *	memory could not be allocated.
+ */
+EMU_EXPORT int gb_emu_save_state( unsigned char **data, unsigned int *size );
+
+/*
+ * gb_emu_load_state - Restores a state saved with gb_emu_save_state.
+ *
+ * @param data
+ *	A pointer to a state image.
+ * @param size
+ *	Size of the image, in bytes.
+ *
+ * @return
+ *	GB_EMU_OK on success. If no ROM is being executed, the image is not a
+ *	valid state or was saved with another cartridge, GB_EMU_ERROR is
+ *	returned and the game continues unaffected.
+ */
+EMU_EXPORT int gb_emu_load_state( unsigned char *data, unsigned int size );
+
+/*
+ * gb_emu_set_rewind - Sets up the rewind buffer.
+ *
+ * While a ROM is executed, the state of the machine is recorded at the
+ *	end of every frame so the game can be rewound with gb_emu_rewind.
+ *	The states are stored as compressed deltas in a buffer of fixed size,
+ *	the oldest states are dropped when it runs full. A 64 MB buffer
+ *	holds about 10 minutes of most games.
+ *
+ * @param size
+ *	Size of the rewind buffer, in bytes. Pass 0 to disable rewinding.
+ *
+ * @return
+ *	GB_EMU_OK on success, GB_EMU_ERROR if memory could not be allocated.
+ *	Recorded states are discarded in either case.
+ */
+EMU_EXPORT int gb_emu_set_rewind( unsigned int size );
+
+/*
+ * gb_emu_rewind - Runs the game backwards.
+ *
+ * While rewinding, the emulator goes back one recorded frame for every
+ *	frame it would otherwise have emulated. The game continues from
+ *	wherever rewinding is stopped.
+ *
+ * @param rewind
+ *	Set to 1 to start rewinding, 0 to stop.
+ *
+ * @return
+ *	The function returns the old setting.
+ */
+EMU_EXPORT int gb_emu_rewind( int rewind );
+
+/*
+ * gb_emu_create - Creates a machine of its own for a ROM.
+ *
+ * The machine is unaffected by and doesn't affect the machine controlled
+ *	by the other exported functions. It runs unthrottled, never presents
+ *	frames and is stepped with gb_emu_step. Different machines can be
+ *	stepped on different threads. Machines running the same ROM share a
+ *	single copy of it.
+ *
+ * @param rom
+ *	A pointer to a GameBoy ROM image in memory.
+ * @param rom_size
+ *	Size of the ROM image pointed to by 'rom', in bytes.
+ *
+ * @return
+ *	A pointer to the machine, or NULL if the ROM is not a valid GameBoy
+ *	ROM or memory could not be allocated.
+ */
+EMU_EXPORT Gameboy_t *gb_emu_create( unsigned char *rom,
+	unsigned int rom_size );
+
+/*
+ * gb_emu_create_file - Creates a machine running a ROM file on disk.
+ *
+ * Like gb_emu_create, but the file is mapped into memory with
+ *	host_map_file instead of being copied.
+ *
+ * @param path
+ *	Path of the ROM file.
+ *
+ * @return
+ *	A pointer to the machine, or NULL if the file could not be mapped,
+ *		is not a valid ROM or memory could not be allocated.
+ */
+EMU_EXPORT Gameboy_t *gb_emu_create_file( const char *path );
+
+/*
+ * gb_emu_fork - Creates a copy of a machine.
+ *
+ * The copy continues from the exact state the machine is in, which makes
+ *	it cheap to explore different inputs from one state. The ROM and the
+ *	cartridge RAM are shared between the two machines, each page of
+ *	cartridge RAM is only copied once either machine writes to it.
+ *
+ * @param gb
+ *	The machine to copy, created with gb_emu_create or gb_emu_fork. It
+ *		must not be stepped by another thread while it is copied.
+ *
+ * @return
+ *	A pointer to the copy, or NULL if memory could not be allocated.
+ */
+EMU_EXPORT Gameboy_t *gb_emu_fork( Gameboy_t *gb );
+
+/*
+ * gb_emu_step - Runs a machine for a number of frames.
+ *
+ * @param gb
+ *	A machine created with gb_emu_create or gb_emu_fork.
+ * @param buttons
+ *	Pressed buttons, a combination of the JOYPAD_* bits. The state is
+ *		applied at the end of the first frame.
+ * @param frames
+ *	Number of frames to run.
+ *
+ * @return
+ *	GB_EMU_OK if all frames were run, otherwise GB_EMU_ERROR.
+ */
+EMU_EXPORT int gb_emu_step( Gameboy_t *gb, unsigned char buttons,
+	unsigned int frames );
+
+/*
+ * gb_emu_destroy - Releases a machine.
+ *
+ * @param gb
+ *	A machine created with gb_emu_create or gb_emu_fork. Machines forked
+ *		from it are not affected.
+ */
+EMU_EXPORT void gb_emu_destroy( Gameboy_t *gb );
+
+/*
+ * gb_emu_pool_add - Adds the state of a machine to a reset pool.
+ *
+ * A reset pool holds prepared states, e.g. the state right after a
+ *	game's intro, which machines can be reset to in microseconds with
+ *	gb_emu_pool_reset instead of starting the ROM all over.
+ *
+ * @param Pool
+ *	A pointer to a ResetPool_t structure. The structure must be zeroed
+ *		out before it is used for the first time.
+ * @param gb
+ *	A machine created with gb_emu_create or gb_emu_fork. It must not be
+ *		stepped by another thread while its state is added.
+ *
+ * @return
+ *	GB_EMU_OK on success, GB_EMU_ERROR if memory could not be allocated.
+ */
+EMU_EXPORT int gb_emu_pool_add( ResetPool_t *Pool, Gameboy_t *gb );
+
+/*
+ * gb_emu_pool_reset - Resets a machine to a state of a reset pool.
+ *
+ * The machine continues from the state as if it had been forked from it.
+ *	If it was last reset to the same state, only the memory it has
+ *	written to since is restored.
+ *
+ * @param gb
+ *	A machine created with gb_emu_create or gb_emu_fork.
+ * @param Pool
+ *	A pointer to the pool.
+ * @param index
+ *	Index of the state, in the order the states were added to the pool.
+ *
+ * @return
+ *	GB_EMU_OK on success, otherwise GB_EMU_ERROR.
+ */
+EMU_EXPORT int gb_emu_pool_reset( Gameboy_t *gb, ResetPool_t *Pool,
+	unsigned int index );
+
+/*
+ * gb_emu_pool_free - Releases all states of a reset pool.
+ *
+ * @param Pool
+ *	A pointer to the pool. Machines that were reset to its states are not
+ *		affected.
+ */
+EMU_EXPORT void gb_emu_pool_free( ResetPool_t *Pool );
+
+/*
+ * gb_emu_checkpoint - Brings a checkpoint up to date with a machine.
+ *
+ * The first checkpoint of a machine saves its whole state. After that,
+ *	only memory the machine has written since the last checkpoint is
+ *	copied, which makes it cheap enough to take one every frame.
+ *
+ * @param gb
+ *	A machine created with gb_emu_create or gb_emu_fork.
+ * @param Checkpoint
+ *	A pointer to a Checkpoint_t structure, zeroed out before first use.
+ *		Checkpoint->State holds a state image that can also be passed to
+ *		gb_emu_load_state.
+ *
+ * @return
+ *	GB_EMU_OK on success, GB_EMU_ERROR if memory could not be allocated.
+ */
+EMU_EXPORT int gb_emu_checkpoint( Gameboy_t *gb, Checkpoint_t *Checkpoint );
+
+/*
+ * gb_emu_rollback - Restores a machine to a checkpoint.
+ *
+ * @param gb
+ *	A machine created with gb_emu_create or gb_emu_fork.
+ * @param Checkpoint
+ *	A checkpoint brought up to date with gb_emu_checkpoint.
+ *
+ * @return
+ *	GB_EMU_OK on success, GB_EMU_ERROR if the checkpoint was taken with
+ *		a different cartridge or memory could not be allocated.
+ */
+EMU_EXPORT int gb_emu_rollback( Gameboy_t *gb, Checkpoint_t *Checkpoint );
+
+/*
+ * gb_emu_checkpoint_free - Releases a checkpoint.
+ *
+ * @param Checkpoint
+ *	A pointer to the checkpoint. It can be used again afterwards.
+ */
+EMU_EXPORT void gb_emu_checkpoint_free( Checkpoint_t *Checkpoint );
+
+/*
+ * gb_emu_hash_state - Computes a 64-bit hash of a machine's state.
+ *
+ * Machines in the same state get the same hash, no matter how long they
+ *	have been running, so this can be used to find states that have been
+ *	visited before. Only memory written since the last call is hashed
+ *	again.
+ *
+ * @param gb
+ *	A machine created with gb_emu_create or gb_emu_fork.
+ *
+ * @return
+ *	The hash of the machine state.
+ */
+EMU_EXPORT u64 gb_emu_hash_state( Gameboy_t *gb );
+
+/*
+ * gb_emu_hash_frame - Computes a 64-bit hash of a machine's screen.
+ *
+ * @param gb
+ *	A machine created with gb_emu_create or gb_emu_fork.
+ *
+ * @return
+ *	The hash of the last frame the machine has completed.
+ */
+EMU_EXPORT u64 gb_emu_hash_frame( Gameboy_t *gb );
+
+/*
+ * gb_emu_trap_writes - Reports writes to a range of memory.
+ *
+ * Writes to the 256 byte pages covering the range are passed to a hook
+ *	before they are carried out. All other writes go straight to memory,
+ *	so traps cost nothing outside of the pages they cover. The machine
+ *	must not be running.
+ *
+ * @param gb
+ *	A machine created with gb_emu_create or gb_emu_fork.
+ * @param from
+ *	The first address of the range.
+ * @param to
+ *	The last address of the range.
+ * @param Hook
+ *	The function to call for each write. A machine has one hook for all
+ *		of its traps. Pass NULL to remove the traps from the range.
+ */
+EMU_EXPORT void gb_emu_trap_writes( Gameboy_t *gb, unsigned short from,
+	unsigned short to, MemTrap_t Hook );
+
 /*
  * End of EMU_EXPORTS
  *
  */
 
 /* function declarations */
-void gb_emu_reset( void );
-void gb_emu_run( void );
-int gb_emu_single_step( void );
+void gb_emu_reset( Gameboy_t *gb );
+int gb_emu_start_rom( MemROM_t *ROM, const char *path );
+Gameboy_t *gb_emu_create_rom( MemROM_t *ROM );
+void gb_emu_init_headless( Gameboy_t *gb );
+Gameboy_t *gb_emu_alloc( void );
+void gb_emu_free( Gameboy_t *gb );
+void gb_emu_run( Gameboy_t *gb );
+int gb_emu_run_frame( Gameboy_t *gb );
+int gb_emu_end_slice( Gameboy_t *gb, s32 Ran );
+int gb_emu_run_ahead( Gameboy_t *gb );
+void gb_emu_poll_host( void );
+void gb_emu_thread( void *arg );
+void gb_emu_wait_idle( Gameboy_t *gb );
+int gb_emu_suspend( void );
+int gb_emu_single_step( Gameboy_t *gb );
 
 /* clock cycle counters for HBLANK, timers, etc. */
 enum {
@@ -201,14 +875,93 @@ enum {
 	CNT_NUM_CNT
 };
 
-typedef struct {
-	z80_machine_t CPU;
-	int Status;
+/* snapshots need to know about the counters */
+#include "state.h"
+#include "rewind.h"
+
+/* maximum number of frames to run ahead */
+#define RUN_AHEAD_MAX	8
+
+/* size of the block of hot fields at the start of Gameboy_t, a multiple
+	of CACHE_LINE */
+#define GB_HOT_SIZE		256
+
+/* machines are allocated on this boundary, see gb_emu_alloc */
+#define CACHE_LINE		64
+
+/* The fields used by every CPU slice and memory access come first and are
+	padded to GB_HOT_SIZE, so that they take up the first few cache lines of
+	the machine. The page tables follow, their size is a multiple of
+	CACHE_LINE so the memory banks after it start on a cache line as
+	well. Machines are allocated with gb_emu_alloc, so no two machines
+	share a cache line. The frame buffers go last because a forked machine
+	does not need to copy them */
+struct Gameboy_s {
+	union {
+		struct {
+			z80_machine_t CPU;
+			s32 Cycles;			/* clock cycles to run in next CPU slice */
+			int Counters[CNT_NUM_CNT];
+			volatile int Status;
+			Timer_t Timer;
+			MemMap_t Map;
+		};
+		unsigned char Hot[GB_HOT_SIZE];
+	};
+
+	/* host pointers to the 256 byte pages of the address space, or NULL
+		if a page has to be read by mem_read_slow */
+	unsigned char *ReadPage[MEM_NUM_PAGES];
+
+	/* handlers of the writes to each page, see mem_map_write */
+	MemWrite_t WriteHandler[MEM_NUM_PAGES];
+
 	Memory_t Memory;
-	int Counters[CNT_NUM_CNT];
 
-} Gameboy_t;
+	/* handlers of the I/O registers and IE, see mem_init_io */
+	MemIORead_t IORead[MEM_IO_SIZE];
+	MemIOWrite_t IOWrite[MEM_IO_SIZE];
+
+	Joypad_t Joypad;
+
+	volatile int Busy;			/* emulation thread is executing the ROM */
+	HostStats_t Host;
+	Pace_t Pace;
+	int Turbo;					/* run unthrottled and don't blit */
+
+	int RunAhead;				/* number of frames to run ahead */
+	int Speculating;			/* frame will be rolled back */
+	int RenderSkip;				/* don't draw or present this frame */
+	Snapshot_t AheadState;		/* state to roll back to after running ahead */
+
+	Movie_t *Movie;				/* movie being recorded or played back */
+
+	Rewind_t Rewind;			/* states of the past frames */
+	volatile int Rewinding;		/* run backwards through Rewind */
+
+	unsigned int PoolId;		/* set if the machine is a pool state */
+	unsigned int ResetFrom;		/* PoolId of the state last reset to */
+
+	/* blocks of internal RAM changed since the last pool reset, the last
+		checkpoint and the last state hash, see mem_collect_dirty */
+	unsigned int PoolDirty[MEM_DIRTY_WORDS];
+	unsigned int CheckDirty[MEM_DIRTY_WORDS];
+	unsigned int HashDirty[MEM_DIRTY_WORDS];
+
+	u64 BlockHash[MEM_DIRTY_WORDS * 32];	/* hashes of the blocks */
+	u64 MemHash;				/* sum of BlockHash, see hash_state */
+
+	/* pages whose writes are reported to TrapHook, one bit per page */
+	unsigned int Traps[MEM_NUM_PAGES / 32];
+	MemTrap_t TrapHook;
+
+	MemSave_t Save;				/* save file of a battery-backed cartridge */
+	Rtc_t RTC;					/* clock of MBC3 cartridges */
+
+	Screen_t Screen;
+};
 
+/* the machine driven by the exported functions */
 extern Gameboy_t Gameboy;
 
 /* number of clock cycles to run before doing cyclic tasks */
@@ -0,0 +1,192 @@
+/*
+=================================================================
+Copyright (C) 2008 Torben Koenke
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+MA  02110-1301, USA.
+=================================================================
+*/
+
+
+
+
+#include "gameboy.h"
+
+/*
+ * hash_mix - Scrambles the bits of a 64-bit value.
+ *
+ */
+u64 hash_mix( u64 h ) {
+	h ^= h >> 33;
+	h *= HASH_K2;
+	h ^= h >> 33;
+	h *= HASH_K3;
+	h ^= h >> 33;
+
+	return h;
+}
+
+/*
+ * hash_bytes - Computes a 64-bit hash of a block of memory.
+ *
+ * @param data
+ *	A pointer to the memory to hash.
+ * @param size
+ *	Size of the memory pointed to by 'data', in bytes.
+ * @param seed
+ *	A value mixed into the hash, e.g. the position of the block.
+ *
+ */
+u64 hash_bytes( unsigned char *data, unsigned int size, u64 seed ) {
+	u64 h = seed ^ ((u64) size * HASH_K1);
+	unsigned int i;
+
+	for(i = 0; i + 4 <= size; i += 4) {
+		h ^= (u32) data[ i ] | ((u32) data[ i + 1 ] << 8) |
+			((u32) data[ i + 2 ] << 16) | ((u32) data[ i + 3 ] << 24);
+		h *= HASH_K1;
+		h ^= h >> 29;
+	}
+
+	for(; i < size; i++) {
+		h ^= data[ i ];
+		h *= HASH_K1;
+	}
+
+	return hash_mix(h);
+}
+
+/*
+ * hash_state - Computes a 64-bit hash of the machine state.
+ *
+ * The hashes of the 256 byte blocks of internal RAM are kept and only
+ *	blocks written since the last call are hashed again, see MEM_DIRTY.
+ *	Pages of cartridge RAM keep their hash until they are written to.
+ *	The state hashed is what determines how the machine goes on, and the
+ *	timer is hashed relative to the clock cycle counter, so machines in
+ *	the same state hash the same no matter how long they have been running.
+ *
+ */
+u64 hash_state( Gameboy_t *gb ) {
+	unsigned char regs[HASH_REGS_SIZE], *p = regs, *data;
+	unsigned int i, b, bits, addr, size;
+	u32 div = gb->CPU.cycles - gb->Timer.DivBase;
+	MemPage_t *Page;
+	u64 h;
+
+	mem_collect_dirty(gb);
+
+	for(i = 0; i < MEM_DIRTY_WORDS; i++) {
+		for(bits = gb->HashDirty[ i ]; bits; bits &= bits - 1) {
+			for(b = 0; !(bits & (1U << b)); b++);
+			b	+= i * 32;
+			addr = 0x8000 + (b << 8);
+
+			if(addr < 0xA000) {
+				data = &gb->Memory.VRAM[ addr - 0x8000 ];
+				size = 0x100;
+			}
+			else if(addr >= 0xC000 && addr < 0xE000) {
+				data = &gb->Memory.RAM0[ addr - 0xC000 ];
+				size = 0x100;
+			}
+			else if(addr == 0xFE00) {
+				data = gb->Memory.OAM;
+				size = 0xA0;
+			}
+			else
+				continue;
+
+			/* the blocks are summed up so they can be replaced one by one */
+			gb->MemHash			-= gb->BlockHash[ b ];
+			gb->BlockHash[ b ]	= hash_bytes(data, size, b);
+			gb->MemHash			+= gb->BlockHash[ b ];
+		}
+
+		gb->HashDirty[ i ] = 0;
+	}
+
+	h = gb->MemHash;
+
+	for(i = 0; i < gb->Map.NumRAMBanks * MEM_BANK_PAGES; i++) {
+		Page = gb->Map.RAMPages[ i ];
+
+		/* pages shared with forks only ever get the same hash */
+		if(!Page->Hashed) {
+			Page->Hash		= hash_bytes(Page->Data, MEM_PAGE_SIZE, 0);
+			Page->Hashed	= 1;
+		}
+
+		h += hash_mix(Page->Hash + (u64) (i + 1) * HASH_K1);
+	}
+
+	p = state_put16(p, gb->CPU.pc);
+	p = state_put16(p, gb->CPU.sp);
+	p = state_put16(p, gb->CPU.u_af.AF);
+	p = state_put16(p, gb->CPU.u_bc.BC);
+	p = state_put16(p, gb->CPU.u_de.DE);
+	p = state_put16(p, gb->CPU.u_hl.HL);
+	*p++ = gb->CPU.IFF;
+	*p++ = gb->Memory.IE;
+	memcpy(p, gb->Memory.RAM1, 0x7F);		p += 0x7F;
+	memcpy(p, gb->Memory.IORegs, 0x4C);		p += 0x4C;
+	p = state_put32(p, gb->Map.ROMBankSelect);
+	p = state_put32(p, gb->Map.RAMBankSelect);
+	p = state_put32(p, gb->Map.MBCMode);
+	*p++ = gb->Map.RAMEnable;
+
+	/* the clock's base is relative to the cycle counter as well, the wall
+		clock time it was last updated at is not part of the state.
+		Without a clock the base is meaningless */
+	memcpy(p, gb->RTC.Regs, RTC_NUM_REGS);		p += RTC_NUM_REGS;
+	memcpy(p, gb->RTC.Latched, RTC_NUM_REGS);	p += RTC_NUM_REGS;
+	*p++ = gb->RTC.Latch;
+	p = state_put32(p, gb->RTC.Present ?
+		gb->CPU.cycles - gb->RTC.Cycle + gb->RTC.Rem : 0);
+
+	/* DIV and the TIMA input clock only depend on the low 16 bits of the
+		cycles since DIV was reset */
+	p = state_put32(p, div & 0xFFFF);
+	*p++ = (unsigned char) (gb->Timer.TimaValue + (gb->Timer.Armed ?
+		(div >> TimerShift[ gb->Memory.IORegs[IO_REG_TAC] & TAC_CLOCK ]) -
+		gb->Timer.TimaTicks : 0));
+	*p++ = gb->Timer.Armed;
+	*p++ = gb->Timer.Pending;
+	p = state_put32(p, gb->Timer.Armed ?
+		gb->Timer.Event - gb->CPU.cycles : 0);
+
+	for(i = 0; i < CNT_NUM_CNT; i++)
+		p = state_put32(p, gb->Counters[ i ]);
+
+	p = state_put32(p, gb->Cycles);
+	*p++ = gb->Joypad.Buttons;
+	p = state_put32(p, gb->Screen.WndLine);
+
+	return hash_mix(h + hash_bytes(regs, p - regs, HASH_K2));
+}
+
+/*
+ * hash_frame - Computes a 64-bit hash of the last completed frame.
+ *
+ */
+u64 hash_frame( Gameboy_t *gb ) {
+	int Middle = gb->Screen.Middle;
+
+	/* the presentation thread has taken the last frame if it isn't
+		fresh anymore */
+	return hash_bytes(gb->Screen.Frames[ (Middle & FRAME_FRESH) ?
+		(Middle & FRAME_INDEX) : gb->Screen.Front ],
+		SCREEN_WIDTH * SCREEN_HEIGHT, 0);
+}
@@ -0,0 +1,47 @@
+/*
+=================================================================
+Copyright (C) 2008 Torben Koenke
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+MA  02110-1301, USA.
+=================================================================
+*/
+
+
+#ifndef _HASH_H_
+#define _HASH_H_
+
+/* builds a 64-bit constant from two 32-bit halves */
+#define HASH_CONST(hi, lo)	(((u64) (hi) << 32) | (u64) (lo))
+
+/* odd multipliers for hash_bytes and hash_mix */
+#define HASH_K1				HASH_CONST(0x9E3779B9, 0x7F4A7C15)
+#define HASH_K2				HASH_CONST(0xFF51AFD7, 0xED558CCD)
+#define HASH_K3				HASH_CONST(0xC4CEB9FE, 0x1A85EC53)
+
+/* size of the registers, I/O area and other small state hashed by
+	hash_state every time */
+#define HASH_REGS_SIZE		(6 * 2 + 2 + 0x7F + 0x4C + 3 * 4 + 1 + \
+								2 * RTC_NUM_REGS + 1 + 4 + 4 + 1 + 2 + 4 + \
+								CNT_NUM_CNT * 4 + 4 + 1 + 4)
+
+/* function declarations */
+
+u64 hash_bytes( unsigned char *data, unsigned int size, u64 seed );
+u64 hash_mix( u64 h );
+u64 hash_state( Gameboy_t *gb );
+u64 hash_frame( Gameboy_t *gb );
+
+#endif /* _HASH_H_ */
@@ -0,0 +1,137 @@
+/*
+=================================================================
+Copyright (C) 2008 Torben Koenke
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+MA  02110-1301, USA.
+=================================================================
+*/
+
+
+#include "gameboy.h"
+
+/*
+ * joypad_push - Queues a new joypad state.
+ *
+ * This is called by the presentation thread (which receives the user's
+ *	input) and is the only function that writes the queue's Head.
+ *
+ * @param buttons
+ *	Pressed buttons, a combination of the JOYPAD_* bits.
+ *
+ * @return
+ *	GB_EMU_OK if the state was queued, GB_EMU_ERROR if the queue is full.
+ */
+int joypad_push( Gameboy_t *gb, unsigned char buttons ) {
+	InputQueue_t *Queue = &gb->Joypad.Queue;
+	int head = Queue->Head;
+
+	/* queue is full, the emulation thread isn't keeping up */
+	if(((head + 1) & (INPUT_QUEUE_SIZE - 1)) == Queue->Tail)
+		return GB_EMU_ERROR;
+
+	Queue->States[ head ] = buttons;
+
+	/* the exchange makes sure the state is visible before the new head */
+	host_xchg(&Queue->Head, (head + 1) & (INPUT_QUEUE_SIZE - 1));
+
+	return GB_EMU_OK;
+}
+
+/*
+ * joypad_update - Applies queued joypad states.
+ *
+ * This is called by the emulation thread at every frame boundary and is
+ *	the only function that writes the queue's Tail. The queued states are
+ *	merged into one, so the input of a frame is fully described by a
+ *	single state and can be recorded and played back by a movie. A button
+ *	that is pressed and released again within a frame is held down for
+ *	the frame and the release is left in the queue for the next one, so
+ *	the game still sees the press and gets its INT_TRANSPIN. While a
+ *	movie is played back, the user's input is discarded.
+ *
+ */
+void joypad_update( Gameboy_t *gb ) {
+	InputQueue_t *Queue = &gb->Joypad.Queue;
+	int tail = Queue->Tail;
+	unsigned char buttons = gb->Joypad.Buttons, next;
+
+	while(tail != Queue->Head) {
+		next = Queue->States[ tail ];
+
+		/* stop at the release of a button pressed in this frame */
+		if(buttons & ~gb->Joypad.Buttons & ~next)
+			break;
+
+		buttons = next;
+		tail = (tail + 1) & (INPUT_QUEUE_SIZE - 1);
+	}
+
+	host_xchg(&Queue->Tail, tail);
+
+	if(gb->Movie) {
+		if(gb->Movie->Mode == MOVIE_PLAY)
+			movie_next(gb->Movie, &buttons);
+		else
+			movie_append(gb->Movie, buttons);
+	}
+
+	joypad_set(gb, buttons);
+}
+
+/*
+ * joypad_set - Sets the pressed buttons.
+ *
+ * Pressing a button causes a high to low transition on one of the
+ *	P10 - P13 lines, which requests an INT_TRANSPIN interrupt.
+ *
+ */
+void joypad_set( Gameboy_t *gb, unsigned char buttons ) {
+	if(buttons & ~gb->Joypad.Buttons)
+		gb->Memory.IORegs[IO_REG_IF] |= INT_TRANSPIN;
+
+	gb->Joypad.Buttons = buttons;
+}
+
+/*
+ * joypad_register_io - Installs the handler of the P1 register.
+ *
+ * Writes to P1 select the keys to read and are stored as usual.
+ *
+ */
+void joypad_register_io( Gameboy_t *gb ) {
+	mem_io_register(gb, IO_REG_P1, joypad_read_p1, NULL);
+}
+
+/*
+ * joypad_read_p1 - Computes the value of the P1 register.
+ *
+ * Games select the direction keys or the buttons by pulling P14 or P15
+ *	low and then read the lower 4 bits, where a pressed key reads as 0.
+ *
+ * @return
+ *	The current value of the P1 register.
+ */
+unsigned char joypad_read_p1( Gameboy_t *gb, unsigned int reg ) {
+	unsigned char p1 = gb->Memory.IORegs[IO_REG_P1] & 0x30, keys = 0;
+
+	if(!(p1 & P1_SELECT_DIR))
+		keys |= gb->Joypad.Buttons & 0x0F;
+
+	if(!(p1 & P1_SELECT_BTN))
+		keys |= gb->Joypad.Buttons >> 4;
+
+	return 0xC0 | p1 | (~keys & 0x0F);
+}
@@ -0,0 +1,68 @@
+/*
+=================================================================
+Copyright (C) 2008 Torben Koenke
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+MA  02110-1301, USA.
+=================================================================
+*/
+
+
+#ifndef _JOYPAD_H_
+#define _JOYPAD_H_
+
+/* Joypad buttons. A set bit means the button is pressed */
+#define JOYPAD_RIGHT		(1 << 0)
+#define JOYPAD_LEFT			(1 << 1)
+#define JOYPAD_UP			(1 << 2)
+#define JOYPAD_DOWN			(1 << 3)
+#define JOYPAD_A			(1 << 4)
+#define JOYPAD_B			(1 << 5)
+#define JOYPAD_SELECT		(1 << 6)
+#define JOYPAD_START		(1 << 7)
+
+/* P1 register bits that select the direction keys and the buttons,
+	respectively. Both are active low */
+#define P1_SELECT_DIR		(1 << 4)
+#define P1_SELECT_BTN		(1 << 5)
+
+/* size of the input queue, must be a power of 2 */
+#define INPUT_QUEUE_SIZE	64
+
+/* Single producer, single consumer queue for passing joypad states from
+	the presentation thread to the emulation thread. Only the producer
+	writes Head and only the consumer writes Tail */
+typedef struct {
+	unsigned char States[INPUT_QUEUE_SIZE];
+	volatile int Head;
+	volatile int Tail;
+
+} InputQueue_t;
+
+typedef struct {
+	unsigned char Buttons;		/* currently pressed buttons */
+	InputQueue_t Queue;
+
+} Joypad_t;
+
+/* function declarations */
+
+int joypad_push( Gameboy_t *gb, unsigned char buttons );
+void joypad_update( Gameboy_t *gb );
+void joypad_set( Gameboy_t *gb, unsigned char buttons );
+void joypad_register_io( Gameboy_t *gb );
+unsigned char joypad_read_p1( Gameboy_t *gb, unsigned int reg );
+
+#endif /* _JOYPAD_H_ */
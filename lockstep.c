@@ -0,0 +1,443 @@
+/*
+=================================================================
+Copyright (C) 2008 Torben Koenke
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+MA  02110-1301, USA.
+=================================================================
+*/
+
+
+#include "gameboy.h"
+
+/* blends the lanes of the current group into a register */
+#define LANE_BLEND(r, v, m)	((u8)(((r) & ~(m)) | ((v) & (m))))
+
+/*
+ * lockstep_init - Powers up a number of machines running the same ROM.
+ *
+ * @param ls
+ *	A pointer to a LockStep_t structure.
+ * @param lanes
+ *	Number of machines, at most LOCKSTEP_MAX_LANES.
+ * @param rom
+ *	A pointer to a GameBoy ROM image in memory.
+ * @param rom_size
+ *	Size of the ROM image pointed to by 'rom', in bytes.
+ *
+ * @return
+ *	GB_EMU_OK if all machines were powered up, otherwise GB_EMU_ERROR.
+ */
+int lockstep_init( LockStep_t *ls, unsigned int lanes, unsigned char *rom,
+	unsigned int rom_size ) {
+	unsigned char *Next;
+	Gameboy_t *gb;
+	unsigned int i;
+
+	memset(ls, 0, sizeof(LockStep_t));
+
+	if(!lanes || lanes > LOCKSTEP_MAX_LANES)
+		return GB_EMU_ERROR;
+
+	/* the lanes are carved out of one allocation like the pages of an
+		arena, so each of them starts on a cache line of its own */
+	if(!(ls->Raw = calloc(1, CACHE_LINE + lanes *
+		MEM_ARENA_ROUND(sizeof(Gameboy_t)))))
+		return GB_EMU_ERROR;
+
+	Next = (unsigned char*) MEM_ARENA_ROUND((size_t) ls->Raw);
+
+	for(i = 0; i < lanes; i++)
+		ls->Lanes[ i ] = (Gameboy_t*) mem_arena_carve(&Next, sizeof(Gameboy_t));
+
+	for(i = 0; i < lanes; i++) {
+		gb = ls->Lanes[ i ];
+
+		gb_emu_init_headless(gb);
+
+		/* a lane holds on to the ROM even if the cartridge can't be
+			inserted, so it is counted before lockstep_free unloads it */
+		ls->NumLanes++;
+
+		/* the first lane loads the cartridge, the others share its ROM */
+		if(GB_EMU_ERROR == (i ? mem_share_cartridge(gb, ls->Lanes[ 0 ]) :
+			mem_load_cartridge(gb, rom, rom_size))) {
+			lockstep_free(ls);
+			return GB_EMU_ERROR;
+		}
+	}
+
+	return GB_EMU_OK;
+}
+
+/*
+ * lockstep_free - Releases all machines.
+ *
+ */
+void lockstep_free( LockStep_t *ls ) {
+	unsigned int i;
+
+	/* the ROM banks go with the last lane */
+	for(i = ls->NumLanes; i > 0; i--)
+		mem_unload_cartridge(ls->Lanes[ i - 1 ]);
+
+	free(ls->Raw);
+
+	ls->Raw			= NULL;
+	ls->NumLanes	= 0;
+}
+
+/*
+ * lockstep_input - Queues a joypad state for one of the machines.
+ *
+ * The state is applied at the end of the next frame, just like input
+ *	passed to gb_emu_input.
+ *
+ */
+int lockstep_input( LockStep_t *ls, unsigned int lane, unsigned char buttons ) {
+	if(lane >= ls->NumLanes)
+		return GB_EMU_ERROR;
+
+	return joypad_push(ls->Lanes[ lane ], buttons);
+}
+
+/*
+ * lockstep_run_frame - Emulates a single frame on all machines.
+ *
+ * The machines run in slices of RUN_CYCLES clock cycles just like
+ *	gb_emu_run_frame does. A machine that completes its frame sits
+ *	out the remaining slices of the others.
+ *
+ */
+void lockstep_run_frame( LockStep_t *ls ) {
+	Gameboy_t *gb;
+	unsigned int i, left = ls->NumLanes;
+
+	for(i = 0; i < ls->NumLanes; i++)
+		ls->Done[ i ] = 0;
+
+	while(left) {
+		for(i = 0; i < ls->NumLanes; i++) {
+			gb = ls->Lanes[ i ];
+
+			ls->End[ i ] = gb->CPU.cycles + (ls->Done[ i ] ? 0 : gb->Cycles);
+			lockstep_gather(ls, i);
+		}
+
+		lockstep_run(ls);
+
+		for(i = 0; i < ls->NumLanes; i++) {
+			gb = ls->Lanes[ i ];
+
+			lockstep_scatter(ls, i);
+
+			if(ls->Done[ i ])
+				continue;
+
+			if(gb_emu_end_slice(gb, (s32)(ls->End[ i ] - gb->CPU.cycles))) {
+				ls->Done[ i ] = 1;
+				left--;
+			}
+		}
+	}
+}
+
+/*
+ * lockstep_run - Runs all lanes until their slices are used up.
+ *
+ * The lane with the most clock cycles left leads. All lanes that are at
+ *	the same address and about to execute the same opcode join it and
+ *	execute the instruction as a group. Lanes that took a different
+ *	branch drop out of the group and are picked up again once they have
+ *	fallen behind, which usually has them join up with the others
+ *	where the code paths meet.
+ *
+ */
+void lockstep_run( LockStep_t *ls ) {
+	Gameboy_t *gb;
+	unsigned int i;
+	int leader;
+	s32 left, most;
+	u16 pc;
+	u8 opc;
+
+	for(;;) {
+		for(i = 0, leader = -1, most = 0; i < ls->NumLanes; i++) {
+			left = (s32)(ls->End[ i ] - ls->Lanes[ i ]->CPU.cycles);
+
+			if(left > most) {
+				most	= left;
+				leader	= i;
+			}
+		}
+
+		if(leader < 0)
+			break;
+
+		pc	= ls->PC[ leader ];
+		opc	= mem_read(ls->Lanes[ leader ], pc);
+
+		/* the fixed ROM bank is the same for all lanes, but the banks
+			switched in and the RAM are not, so anywhere else the opcode
+			needs to be checked for every lane */
+		for(i = 0; i < ls->NumLanes; i++) {
+			gb = ls->Lanes[ i ];
+
+			ls->Mask[ i ] = ((s32)(ls->End[ i ] - gb->CPU.cycles) > 0 &&
+				ls->PC[ i ] == pc && (pc < 0x4000 || (int) i == leader ||
+				mem_read(gb, pc) == opc)) ? 0xFF : 0x00;
+		}
+
+		ls->Groups++;
+
+		if(!lockstep_exec(ls, opc))
+			lockstep_exec_scalar(ls);
+	}
+}
+
+/*
+ * lockstep_exec - Executes an instruction for the current group.
+ *
+ * The result is computed for all lanes and blended into the registers of
+ *	the lanes in the group, so the loops contain no branches and can be
+ *	turned into vector instructions by the compiler.
+ *
+ * @return
+ *	1 if the instruction was executed, 0 if it is not one of the
+ *		instructions that can be executed in lockstep.
+ */
+int lockstep_exec( LockStep_t *ls, u8 opc ) {
+	u8 *Reg[8], *hi, *lo, m, v, r;
+	u16 w, t;
+	unsigned int i, n = ls->NumLanes, len = 1;
+	int x = opc >> 6, y = (opc >> 3) & 7, z = opc & 7, taken;
+
+	/* register operands in the order they are encoded in the opcodes.
+		Index 6 is [HL] which isn't handled here */
+	Reg[0] = ls->B;		Reg[1] = ls->C;
+	Reg[2] = ls->D;		Reg[3] = ls->E;
+	Reg[4] = ls->H;		Reg[5] = ls->L;
+	Reg[6] = NULL;		Reg[7] = ls->A;
+
+	if(opc == OP_NOP) {
+	}
+	/* LD r, r' */
+	else if(x == 1 && y != 6 && z != 6) {
+		for(i = 0; i < n; i++)
+			Reg[y][i] = LANE_BLEND(Reg[y][i], Reg[z][i], ls->Mask[i]);
+	}
+	/* ADD, SUB, AND, XOR, OR and CP with a register */
+	else if(x == 2 && y != 1 && y != 3 && z != 6) {
+		lockstep_exec_alu(ls, y, Reg[z]);
+	}
+	/* INC r */
+	else if(x == 0 && z == 4 && y != 6) {
+		for(i = 0; i < n; i++) {
+			m = ls->Mask[i];
+			v = Reg[y][i];
+			r = v + 1;
+
+			Reg[y][i]	= LANE_BLEND(v, r, m);
+			ls->F[i]	= LANE_BLEND(ls->F[i], (ls->F[i] & (FL_CARRY|0x0F)) |
+				(((v & 0x0F) + 1) > 0x0F ? FL_HCARRY : 0) |
+				(r ? 0 : FL_ZERO), m);
+		}
+	}
+	/* DEC r */
+	else if(x == 0 && z == 5 && y != 6) {
+		for(i = 0; i < n; i++) {
+			m = ls->Mask[i];
+			v = Reg[y][i];
+			r = v - 1;
+
+			Reg[y][i]	= LANE_BLEND(v, r, m);
+			ls->F[i]	= LANE_BLEND(ls->F[i], (ls->F[i] & (FL_CARRY|0x0F)) |
+				FL_SUB | ((v & 0x0F) ? 0 : FL_HCARRY) | (r ? 0 : FL_ZERO), m);
+		}
+	}
+	/* LD r, n */
+	else if(x == 0 && z == 6 && y != 6) {
+		for(i = 0; i < n; i++) {
+			if(ls->Mask[i])
+				ls->Imm[i] = mem_read(ls->Lanes[i], (u16)(ls->PC[i] + 1));
+		}
+
+		for(i = 0; i < n; i++)
+			Reg[y][i] = LANE_BLEND(Reg[y][i], ls->Imm[i], ls->Mask[i]);
+
+		len = 2;
+	}
+	/* INC rr and DEC rr for BC, DE and HL */
+	else if(x == 0 && z == 3 && y < 6) {
+		hi = Reg[(y >> 1) * 2];
+		lo = Reg[(y >> 1) * 2 + 1];
+
+		for(i = 0; i < n; i++) {
+			m = ls->Mask[i];
+			w = (u16)((hi[i] << 8) | lo[i]);
+			w = (y & 1) ? w - 1 : w + 1;
+
+			hi[i] = LANE_BLEND(hi[i], (u8)(w >> 8), m);
+			lo[i] = LANE_BLEND(lo[i], (u8)w, m);
+		}
+	}
+	/* JR n and JR cc, n */
+	else if(x == 0 && z == 0 && y >= 3) {
+		for(i = 0; i < n; i++) {
+			if(ls->Mask[i])
+				ls->Imm[i] = mem_read(ls->Lanes[i], (u16)(ls->PC[i] + 1));
+		}
+
+		for(i = 0; i < n; i++) {
+			/* NZ, Z, NC, C */
+			taken = (y == 3) || (((ls->F[i] & ((y & 2) ? FL_CARRY :
+				FL_ZERO)) ? 1 : 0) == (y & 1));
+
+			w = (u16)(0 - (ls->Mask[i] & 1));
+			t = (u16)(ls->PC[i] + 2 + (taken ? (s8)ls->Imm[i] : 0));
+
+			ls->PC[i] = (u16)((ls->PC[i] & ~w) | (t & w));
+		}
+
+		len = 0;
+	}
+	else
+		return 0;
+
+	/* advance the program counters and clocks of the group */
+	for(i = 0; i < n; i++) {
+		w = (u16)(0 - (ls->Mask[i] & 1));
+		ls->PC[i] = (u16)(ls->PC[i] + (len & w));
+	}
+
+	for(i = 0; i < n; i++) {
+		if(ls->Mask[i]) {
+			ls->Lanes[i]->CPU.cycles += z80_ictbl[opc];
+			ls->VectorOps++;
+		}
+	}
+
+	return 1;
+}
+
+/*
+ * lockstep_exec_alu - Executes an 8-bit arithmetic or logical instruction
+ *	for the current group.
+ *
+ * @param op
+ *	Bits 3 - 5 of the opcode: 0 = ADD, 2 = SUB, 4 = AND, 5 = XOR, 6 = OR,
+ *		7 = CP. The flags are computed exactly like z80_run does.
+ * @param src
+ *	Register array holding the second operand.
+ */
+void lockstep_exec_alu( LockStep_t *ls, int op, u8 *src ) {
+	unsigned int i, n = ls->NumLanes;
+	u8 a, b, r, f, m;
+
+	for(i = 0; i < n; i++) {
+		m = ls->Mask[i];
+		a = ls->A[i];
+		b = src[i];
+
+		switch(op) {
+			case 0:
+				r = a + b;
+				f = (((a & 0x0F) + (b & 0x0F)) > 0x0F ? FL_HCARRY : 0) |
+					((a + b) > 0xFF ? FL_CARRY : 0);
+				break;
+
+			case 2:
+			case 7:
+				r = a - b;
+				f = FL_SUB | ((b & 0x0F) > (a & 0x0F) ? FL_HCARRY : 0) |
+					(b > a ? FL_CARRY : 0);
+				break;
+
+			case 4:
+				r = a & b;
+				f = FL_HCARRY;
+				break;
+
+			case 5:
+				r = a ^ b;
+				f = 0;
+				break;
+
+			default:
+				r = a | b;
+				f = 0;
+				break;
+		}
+
+		f |= r ? 0 : FL_ZERO;
+
+		/* CP only sets the flags */
+		if(op != 7)
+			ls->A[i] = LANE_BLEND(a, r, m);
+
+		ls->F[i] = LANE_BLEND(ls->F[i], (ls->F[i] & 0x0F) | f, m);
+	}
+}
+
+/*
+ * lockstep_exec_scalar - Executes an instruction for the current group
+ *	one lane at a time.
+ *
+ * This is the fallback for all instructions lockstep_exec doesn't know
+ *	how to execute in lockstep.
+ *
+ */
+void lockstep_exec_scalar( LockStep_t *ls ) {
+	unsigned int i;
+
+	for(i = 0; i < ls->NumLanes; i++) {
+		if(!ls->Mask[i])
+			continue;
+
+		lockstep_scatter(ls, i);
+		z80_run(&ls->Lanes[i]->CPU, 1);
+		lockstep_gather(ls, i);
+
+		ls->ScalarOps++;
+	}
+}
+
+/*
+ * lockstep_gather - Copies a lane's registers into the register arrays.
+ *
+ */
+void lockstep_gather( LockStep_t *ls, unsigned int lane ) {
+	z80_machine_t *z80 = &ls->Lanes[ lane ]->CPU;
+
+	ls->PC[ lane ] = z80->pc;	ls->SP[ lane ] = z80->sp;
+	ls->A[ lane ] = z80->u_af.A;	ls->F[ lane ] = z80->u_af.F;
+	ls->B[ lane ] = z80->u_bc.B;	ls->C[ lane ] = z80->u_bc.C;
+	ls->D[ lane ] = z80->u_de.D;	ls->E[ lane ] = z80->u_de.E;
+	ls->H[ lane ] = z80->u_hl.H;	ls->L[ lane ] = z80->u_hl.L;
+}
+
+/*
+ * lockstep_scatter - Copies a lane's registers back into its CPU.
+ *
+ */
+void lockstep_scatter( LockStep_t *ls, unsigned int lane ) {
+	z80_machine_t *z80 = &ls->Lanes[ lane ]->CPU;
+
+	z80->pc = ls->PC[ lane ];	z80->sp = ls->SP[ lane ];
+	z80->u_af.A = ls->A[ lane ];	z80->u_af.F = ls->F[ lane ];
+	z80->u_bc.B = ls->B[ lane ];	z80->u_bc.C = ls->C[ lane ];
+	z80->u_de.D = ls->D[ lane ];	z80->u_de.E = ls->E[ lane ];
+	z80->u_hl.H = ls->H[ lane ];	z80->u_hl.L = ls->L[ lane ];
+}
@@ -0,0 +1,76 @@
+/*
+=================================================================
+Copyright (C) 2008 Torben Koenke
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+MA  02110-1301, USA.
+=================================================================
+*/
+
+
+#ifndef _LOCKSTEP_H_
+#define _LOCKSTEP_H_
+
+/* maximum number of machines run in lockstep */
+#define LOCKSTEP_MAX_LANES	256
+
+/* Many machines running the same ROM in lockstep. The CPU registers of
+	all machines (lanes) are kept in one array per register so that an
+	instruction can be executed for all lanes that are about to execute it
+	in a single loop. Only a subset of frequently used instructions is
+	executed that way, everything else goes through z80_run one lane at a
+	time. Every lane has its own RAM, the ROM banks are shared */
+typedef struct {
+	unsigned int NumLanes;
+	unsigned char *Raw;			/* the allocation the lanes are carved from */
+	Gameboy_t *Lanes[LOCKSTEP_MAX_LANES];	/* lane 0 owns the ROM banks */
+
+	u16 PC[LOCKSTEP_MAX_LANES];
+	u16 SP[LOCKSTEP_MAX_LANES];
+	u8 A[LOCKSTEP_MAX_LANES];
+	u8 F[LOCKSTEP_MAX_LANES];
+	u8 B[LOCKSTEP_MAX_LANES];
+	u8 C[LOCKSTEP_MAX_LANES];
+	u8 D[LOCKSTEP_MAX_LANES];
+	u8 E[LOCKSTEP_MAX_LANES];
+	u8 H[LOCKSTEP_MAX_LANES];
+	u8 L[LOCKSTEP_MAX_LANES];
+
+	u8 Mask[LOCKSTEP_MAX_LANES];	/* 0xFF for lanes executing the group */
+	u8 Imm[LOCKSTEP_MAX_LANES];		/* immediate operand of the group */
+	u32 End[LOCKSTEP_MAX_LANES];	/* clock cycle the lane's slice ends at */
+	u8 Done[LOCKSTEP_MAX_LANES];	/* lane has completed the frame */
+
+	unsigned int Groups;		/* number of instruction groups executed */
+	unsigned int VectorOps;		/* instructions executed in lockstep */
+	unsigned int ScalarOps;		/* instructions executed by z80_run */
+
+} LockStep_t;
+
+/* function declarations */
+
+int lockstep_init( LockStep_t *ls, unsigned int lanes, unsigned char *rom,
+	unsigned int rom_size );
+void lockstep_free( LockStep_t *ls );
+int lockstep_input( LockStep_t *ls, unsigned int lane, unsigned char buttons );
+void lockstep_run_frame( LockStep_t *ls );
+void lockstep_run( LockStep_t *ls );
+int lockstep_exec( LockStep_t *ls, u8 opc );
+void lockstep_exec_alu( LockStep_t *ls, int op, u8 *src );
+void lockstep_exec_scalar( LockStep_t *ls );
+void lockstep_gather( LockStep_t *ls, unsigned int lane );
+void lockstep_scatter( LockStep_t *ls, unsigned int lane );
+
+#endif /* _LOCKSTEP_H_ */
@@ -20,38 +20,107 @@ MA  02110-1301, USA.
 */
 
 #include "gameboy.h"
+#include <stddef.h>
 
 /* global Gameboy variable included in all files */
 Gameboy_t Gameboy;
 
+/* fails to compile if the hot fields of Gameboy_t outgrow GB_HOT_SIZE or
+	the memory banks don't start on a cache line */
+typedef char gb_hot_size_check[offsetof(Gameboy_t, ReadPage) ==
+	GB_HOT_SIZE ? 1 : -1];
+typedef char gb_memory_align_check[offsetof(Gameboy_t, Memory) %
+	CACHE_LINE ? -1 : 1];
+
 /*
  * main - entry point
  *
  */
 int main(int argc, char *argv[]) {
+	unsigned char *frame;
+
 	/* initialize the host environment */
 	if(host_init() != GB_EMU_OK) {
 		printf("Could not initialize host environment.\n");
 		return 0;
 	}
 
-	while(1) {
-		/* wait for user to load a rom file and start the emulator */
-		host_sys();
+	/* service the host as often as the host environment asks for */
+	Gameboy.Host.Interval = HOST_SYS_INTERVAL;
 
-		/* start the emulator if a ROM has been loaded */
-		if(Gameboy.Status == GB_EMU_STATUS_EXECUTING)
-			gb_emu_run();
+	/* run at the speed of a real Gameboy */
+	Gameboy.Pace.Speed = 100;
 
-		/* user requested to shut program down */
-		if(Gameboy.Status == GB_EMU_STATUS_SHUTDOWN)
-			break;
+	/* set up the triple buffer */
+	Gameboy.Screen.Back		= 0;
+	Gameboy.Screen.Front	= 1;
+	Gameboy.Screen.Middle	= 2;
+
+	/* the emulator runs on a thread of its own. This thread takes care of
+		the host environment and presents the frames */
+	if(host_thread(gb_emu_thread, &Gameboy) != GB_EMU_OK) {
+		printf("Could not start emulation thread.\n");
+		return 0;
 	}
 
+	while(Gameboy.Status != GB_EMU_STATUS_SHUTDOWN) {
+		/* process user input, load a rom file, etc. */
+		gb_emu_poll_host();
+
+		/* present the most recent frame if there is a new one */
+		if((frame = gb_emu_frame()))
+			host_blt(frame);
+		else
+			host_sleep(1);
+	}
+
+	/* let the emulation thread finish */
+	gb_emu_wait_idle(&Gameboy);
+
 	printf("Exiting emulator\n");
 	return 0;
 }
 
+/*
+ * gb_emu_thread - Entry point of the emulation thread.
+ *
+ * Executes the ROM whenever the emulator's status says so, until the
+ *	program is shut down.
+ *
+ */
+void gb_emu_thread( void *arg ) {
+	Gameboy_t *gb = (Gameboy_t*) arg;
+
+	while(gb->Status != GB_EMU_STATUS_SHUTDOWN) {
+		/* say that we are about to touch the machine before looking at the
+			status, see gb_emu_wait_idle */
+		host_xchg(&gb->Busy, 1);
+
+		if(gb->Status == GB_EMU_STATUS_EXECUTING)
+			gb_emu_run(gb);
+
+		host_xchg(&gb->Busy, 0);
+
+		/* stopped or paused, don't burn CPU time */
+		if(gb->Status != GB_EMU_STATUS_EXECUTING)
+			host_sleep(10);
+	}
+}
+
+/*
+ * gb_emu_wait_idle - Waits for the emulation thread to stop executing.
+ *
+ * The caller must have set the status to something other than
+ *	GB_EMU_STATUS_EXECUTING beforehand. When the function returns, the
+ *	emulation thread no longer accesses the machine and the caller can
+ *	safely swap cartridges etc.
+ *
+ */
+void gb_emu_wait_idle( Gameboy_t *gb ) {
+	while(gb->Busy)
+		host_sleep(1);
+}
+
 /*
  * gb_emu_start - Start execution of a GameBoy ROM file.
  *
@@ -66,18 +135,87 @@ int main(int argc, char *argv[]) {
  *	returned.
  */
 EMU_EXPORT int gb_emu_start( unsigned char *rom, unsigned int rom_size ) {
+	MemROM_t *ROM;
+
+	if(!(ROM = mem_rom_copy(rom, rom_size)))
+		return GB_EMU_ERROR;
+
+	return gb_emu_start_rom(ROM, NULL);
+}
+
+/*
+ * gb_emu_start_file - Start execution of a GameBoy ROM file on disk.
+ *
+ * @param path
+ *	Path of the ROM file. The file is mapped, not read. Battery-backed
+ *		RAM is kept in a .sav file next to it.
+ *
+ * @return
+ *	GB_EMU_OK if the ROM was successfully loaded, otherwise GB_EMU_ERROR.
+ */
+EMU_EXPORT int gb_emu_start_file( const char *path ) {
+	MemROM_t *ROM;
+
+	if(!(ROM = mem_rom_open(path)))
+		return GB_EMU_ERROR;
+
+	return gb_emu_start_rom(ROM, path);
+}
+
+/*
+ * gb_emu_start_rom - Starts execution of a cartridge ROM.
+ *
+ * @param ROM
+ *	The ROM to run. The emulator takes over the caller's reference.
+ * @param path
+ *	Path of the ROM file, used to find the save file of battery-backed
+ *		cartridges, or NULL if the ROM didn't come from a file.
+ *
+ * @return
+ *	GB_EMU_OK if the ROM was successfully loaded, otherwise GB_EMU_ERROR.
+ */
+int gb_emu_start_rom( MemROM_t *ROM, const char *path ) {
+	unsigned int Checksum;
+
+	/* stop the emulation thread before we pull the cartridge */
+	host_xchg(&Gameboy.Status, GB_EMU_STATUS_STOPPED);
+	gb_emu_wait_idle(&Gameboy);
+
 	/* unload old cartridge, if any */
-	mem_unload_cartridge();
+	mem_unload_cartridge(&Gameboy);
 
 	/* reset the emulator */
-	gb_emu_reset();
+	gb_emu_reset(&Gameboy);
+	rewind_clear(&Gameboy.Rewind);
+
+	/* a movie being played back must have been made with this ROM */
+	if(Gameboy.Movie) {
+		/* this reads all of the ROM, so it is only done when needed */
+		Checksum = mem_checksum(ROM->Data, ROM->Size);
+
+		if(Gameboy.Movie->Mode == MOVIE_RECORD)
+			movie_record(Gameboy.Movie, Checksum);
+		else if(Gameboy.Movie->Checksum != Checksum) {
+			mem_rom_release(ROM);
+			return GB_EMU_ERROR;
+		}
+		else
+			movie_play(Gameboy.Movie);
+	}
 
 	/* try to load the cartridge */
-	if(GB_EMU_ERROR == mem_load_cartridge(rom, rom_size))
+	if(GB_EMU_ERROR == mem_insert_cartridge(&Gameboy, ROM)) {
+		mem_unload_cartridge(&Gameboy);
 		return GB_EMU_ERROR;
+	}
+
+	/* battery-backed RAM is kept in a file next to the ROM file. The game
+		still runs if it can't be opened, it just won't be saved */
+	if(path && GB_EMU_ERROR == mem_open_save(&Gameboy, path))
+		printf("gb_emu_start: save file could not be opened\n");
 
 	/* we are executing a game */
-	Gameboy.Status = GB_EMU_STATUS_EXECUTING;
+	host_xchg(&Gameboy.Status, GB_EMU_STATUS_EXECUTING);
 
 	/* everything OK */
 	return GB_EMU_OK;
@@ -94,10 +232,12 @@ EMU_EXPORT void gb_emu_stop( void ) {
 	if( Gameboy.Status == GB_EMU_STATUS_STOPPED )
 		return;
 
-	Gameboy.Status = GB_EMU_STATUS_STOPPED;
+	host_xchg(&Gameboy.Status, GB_EMU_STATUS_STOPPED);
+	gb_emu_wait_idle(&Gameboy);
 
 	/* free resources */
-	mem_unload_cartridge();
+	mem_unload_cartridge(&Gameboy);
+	state_free(&Gameboy.AheadState);
 }
 
 /*
@@ -146,6 +286,141 @@ EMU_EXPORT void gb_emu_shutdown( void ) {
 	Gameboy.Status = GB_EMU_STATUS_SHUTDOWN;
 }
 
+/*
+ * gb_emu_input - Passes the state of the joypad to the emulator.
+ *
+ * @param buttons
+ *	Pressed buttons, a combination of the JOYPAD_* bits.
+ *
+ * @return
+ *	GB_EMU_OK if the state was queued, GB_EMU_ERROR if the emulator has
+ *	fallen too far behind to take more input.
+ */
+EMU_EXPORT int gb_emu_input( unsigned char buttons ) {
+	return joypad_push(&Gameboy, buttons);
+}
+
+/*
+ * gb_emu_frame - Retrieves the most recently completed frame.
+ *
+ * @return
+ *	A pointer to SCREEN_WIDTH * SCREEN_HEIGHT shade indices if a new frame
+ *	has been completed since the last call, otherwise NULL. The frame
+ *	stays valid until the next call.
+ */
+EMU_EXPORT unsigned char *gb_emu_frame( void ) {
+	return video_latest_frame(&Gameboy);
+}
+
+/*
+ * gb_emu_set_host_interval - Sets the interval between host_sys calls.
+ *
+ * @param usec
+ *	Minimum time between two calls of host_sys while executing a ROM, in
+ *		microseconds. Pass 0 to service the host at every poll point.
+ */
+EMU_EXPORT void gb_emu_set_host_interval( unsigned int usec ) {
+	Gameboy.Host.Interval = usec;
+}
+
+/*
+ * gb_emu_host_stats - Retrieves host servicing statistics.
+ *
+ * @param Stats
+ *	A pointer to a HostStats_t structure that receives the number of
+ *		host_sys calls and the time spent in them.
+ */
+EMU_EXPORT void gb_emu_host_stats( HostStats_t *Stats ) {
+	*Stats = Gameboy.Host;
+}
+
+/*
+ * gb_emu_set_speed - Sets the emulation speed.
+ *
+ * @param percent
+ *	Emulation speed in percent of a real Gameboy. 100 runs at the original
+ *		59.73 Hz, 200 at twice that speed and so on.
+ */
+EMU_EXPORT void gb_emu_set_speed( unsigned int percent ) {
+	if(!percent)
+		percent = 100;
+
+	Gameboy.Pace.Speed = percent;
+
+	/* start over so the new speed takes effect with the next frame */
+	Gameboy.Pace.Resync = 1;
+}
+
+/*
+ * gb_emu_set_turbo - Enables or disables turbo mode.
+ *
+ * @param turbo
+ *	Set to 1 to enable turbo mode, 0 to go back to paced execution.
+ *
+ * @return
+ *	The function returns the old turbo mode setting.
+ */
+EMU_EXPORT int gb_emu_set_turbo( int turbo ) {
+	int ret = Gameboy.Turbo;
+
+	/* don't try to make up for the frames we rushed through */
+	if(ret && !turbo)
+		Gameboy.Pace.Resync = 1;
+
+	Gameboy.Turbo = turbo;
+	return ret;
+}
+
+/*
+ * gb_emu_set_run_ahead - Sets the number of frames to run ahead.
+ *
+ * @param frames
+ *	Number of frames to run ahead, 0 to disable run-ahead. Values larger
+ *		than RUN_AHEAD_MAX are clamped.
+ */
+EMU_EXPORT void gb_emu_set_run_ahead( int frames ) {
+	if(frames < 0)
+		frames = 0;
+
+	if(frames > RUN_AHEAD_MAX)
+		frames = RUN_AHEAD_MAX;
+
+	Gameboy.RunAhead = frames;
+}
+
+/*
+ * gb_emu_pace_stats - Retrieves frame pacing statistics.
+ *
+ * @param Stats
+ *	A pointer to a Pace_t structure that receives the current speed, the
+ *		number of paced and late frames and the measured frame-time
+ *		jitter.
+ */
+EMU_EXPORT void gb_emu_pace_stats( Pace_t *Stats ) {
+	*Stats = Gameboy.Pace;
+}
+
+/*
+ * gb_emu_run_jobs - Runs a batch of ROMs on a pool of worker threads.
+ *
+ * @param Jobs
+ *	Array of jobs, see RunJob_t.
+ * @param NumJobs
+ *	Number of jobs in the array.
+ * @param Workers
+ *	Number of worker threads to run the jobs on.
+ * @param Stats
+ *	A pointer to a RunStats_t structure that receives the aggregate
+ *		frames per second and job latencies.
+ *
+ * @return
+ *	GB_EMU_OK if the batch was run, otherwise GB_EMU_ERROR.
+ */
+EMU_EXPORT int gb_emu_run_jobs( RunJob_t *Jobs, unsigned int NumJobs,
+	unsigned int Workers, RunStats_t *Stats ) {
+	return runner_run(Jobs, NumJobs, Workers, Stats);
+}
+
 /*
  * gb_emu_reset - Resets the emulator to a safe state.
  *
@@ -154,102 +429,719 @@ EMU_EXPORT void gb_emu_shutdown( void ) {
  *	up.
  *
  */
-void gb_emu_reset( void ) {
+void gb_emu_reset( Gameboy_t *gb ) {
 	int i;
 
-	Gameboy.CPU.mem_read	= mem_read;
-	Gameboy.CPU.mem_write	= mem_write;
+	gb->CPU.mem_read	= mem_read;
+	gb->CPU.mem_write	= mem_write;
+	gb->CPU.ctx			= gb;
 
 	/* setup Z80 CPU registers */
-	Gameboy.CPU.pc		= 0x0100;	Gameboy.CPU.sp		= 0xFFFE;
-	Gameboy.CPU.u_af.AF	= 0x01B0;	Gameboy.CPU.u_bc.BC	= 0x0013;
-	Gameboy.CPU.u_de.DE	= 0x00D8;	Gameboy.CPU.u_hl.HL	= 0x014D;
+	gb->CPU.pc		= 0x0100;	gb->CPU.sp		= 0xFFFE;
+	gb->CPU.u_af.AF	= 0x01B0;	gb->CPU.u_bc.BC	= 0x0013;
+	gb->CPU.u_de.DE	= 0x00D8;	gb->CPU.u_hl.HL	= 0x014D;
 	
 	/* setup I/O registers */
-	Gameboy.Memory.IORegs[IO_REG_TIMA]	= 0x00;
-	Gameboy.Memory.IORegs[IO_REG_TMA]	= 0x00;
-	Gameboy.Memory.IORegs[IO_REG_TAC]	= 0x00;
-
-	Gameboy.Memory.IORegs[IO_REG_NR10]	= 0x80;
-	Gameboy.Memory.IORegs[IO_REG_NR11]	= 0xBF;
-	Gameboy.Memory.IORegs[IO_REG_NR12]	= 0xF3;
-	Gameboy.Memory.IORegs[IO_REG_NR14]	= 0xBF;
-	Gameboy.Memory.IORegs[IO_REG_NR21]	= 0x3F;
-	Gameboy.Memory.IORegs[IO_REG_NR22]	= 0x00;
-	Gameboy.Memory.IORegs[IO_REG_NR24]	= 0xBF;
-	Gameboy.Memory.IORegs[IO_REG_NR30]	= 0x7F;
-	Gameboy.Memory.IORegs[IO_REG_NR31]	= 0xFF;
-	Gameboy.Memory.IORegs[IO_REG_NR32]	= 0x9F;
-	Gameboy.Memory.IORegs[IO_REG_NR33]	= 0xBF;
-	Gameboy.Memory.IORegs[IO_REG_NR41]	= 0xFF;
-	Gameboy.Memory.IORegs[IO_REG_NR42]	= 0x00;
-	Gameboy.Memory.IORegs[IO_REG_NR43]	= 0x00;
-	Gameboy.Memory.IORegs[IO_REG_NR30]	= 0xBF;
-	Gameboy.Memory.IORegs[IO_REG_NR50]	= 0x77;
-	Gameboy.Memory.IORegs[IO_REG_NR51]	= 0xF3;
-	Gameboy.Memory.IORegs[IO_REG_NR52]	= 0xF1;
-
-	Gameboy.Memory.IORegs[IO_REG_LCDC]	= 0x91;
-	Gameboy.Memory.IORegs[IO_REG_SCX]	= 0x00;
-	Gameboy.Memory.IORegs[IO_REG_SCY]	= 0x00;
-	Gameboy.Memory.IORegs[IO_REG_LYC]	= 0x00;
-	Gameboy.Memory.IORegs[IO_REG_BGP]	= 0xFC;
-	Gameboy.Memory.IORegs[IO_REG_OBP0]	= 0xFF;
-	Gameboy.Memory.IORegs[IO_REG_OBP1]	= 0xFF;
-	Gameboy.Memory.IORegs[IO_REG_WY]	= 0x00;
-	Gameboy.Memory.IORegs[IO_REG_WX]	= 0x00;
-
-	Gameboy.Memory.IE = 0x00;
+	gb->Memory.IORegs[IO_REG_TIMA]	= 0x00;
+	gb->Memory.IORegs[IO_REG_TMA]	= 0x00;
+	gb->Memory.IORegs[IO_REG_TAC]	= 0x00;
+
+	gb->Memory.IORegs[IO_REG_NR10]	= 0x80;
+	gb->Memory.IORegs[IO_REG_NR11]	= 0xBF;
+	gb->Memory.IORegs[IO_REG_NR12]	= 0xF3;
+	gb->Memory.IORegs[IO_REG_NR14]	= 0xBF;
+	gb->Memory.IORegs[IO_REG_NR21]	= 0x3F;
+	gb->Memory.IORegs[IO_REG_NR22]	= 0x00;
+	gb->Memory.IORegs[IO_REG_NR24]	= 0xBF;
+	gb->Memory.IORegs[IO_REG_NR30]	= 0x7F;
+	gb->Memory.IORegs[IO_REG_NR31]	= 0xFF;
+	gb->Memory.IORegs[IO_REG_NR32]	= 0x9F;
+	gb->Memory.IORegs[IO_REG_NR33]	= 0xBF;
+	gb->Memory.IORegs[IO_REG_NR41]	= 0xFF;
+	gb->Memory.IORegs[IO_REG_NR42]	= 0x00;
+	gb->Memory.IORegs[IO_REG_NR43]	= 0x00;
+	gb->Memory.IORegs[IO_REG_NR30]	= 0xBF;
+	gb->Memory.IORegs[IO_REG_NR50]	= 0x77;
+	gb->Memory.IORegs[IO_REG_NR51]	= 0xF3;
+	gb->Memory.IORegs[IO_REG_NR52]	= 0xF1;
+
+	gb->Memory.IORegs[IO_REG_LCDC]	= 0x91;
+	gb->Memory.IORegs[IO_REG_SCX]	= 0x00;
+	gb->Memory.IORegs[IO_REG_SCY]	= 0x00;
+	gb->Memory.IORegs[IO_REG_LYC]	= 0x00;
+	gb->Memory.IORegs[IO_REG_BGP]	= 0xFC;
+	gb->Memory.IORegs[IO_REG_OBP0]	= 0xFF;
+	gb->Memory.IORegs[IO_REG_OBP1]	= 0xFF;
+	gb->Memory.IORegs[IO_REG_WY]	= 0x00;
+	gb->Memory.IORegs[IO_REG_WX]	= 0x00;
+
+	gb->Memory.IE = 0x00;
+
+	mem_init_io(gb);
+
+	/* start the divider from scratch */
+	timer_reset(gb);
 
 	/* reset clock cycle counters */
 	for(i = 0; i < CNT_NUM_CNT; i++)
-		Gameboy.Counters[ i ] = 0;
+		gb->Counters[ i ] = 0;
+
+	gb->Cycles = RUN_CYCLES;
+}
+
+/*
+ * gb_emu_movie - Attaches a movie to the emulator.
+ *
+ * @param Movie
+ *	A pointer to a Movie_t structure set up for recording or playback,
+ *		or NULL to detach the movie.
+ *
+ * @return
+ *	GB_EMU_OK if the movie was attached, GB_EMU_ERROR if a ROM is being
+ *	executed.
+ */
+EMU_EXPORT int gb_emu_movie( Movie_t *Movie ) {
+	/* the emulation thread reads the movie at every frame */
+	if( Gameboy.Status != GB_EMU_STATUS_STOPPED )
+		return GB_EMU_ERROR;
+
+	Gameboy.Movie = Movie;
+	return GB_EMU_OK;
+}
+
+/*
+ * gb_emu_replay - Plays back a movie as fast as possible.
+ *
+ * @param rom
+ *	A pointer to the GameBoy ROM image the movie was recorded with.
+ * @param rom_size
+ *	Size of the ROM image pointed to by 'rom', in bytes.
+ * @param Movie
+ *	A pointer to the movie.
+ *
+ * @return
+ *	GB_EMU_OK if the movie was played back to the end, otherwise
+ *	GB_EMU_ERROR.
+ */
+EMU_EXPORT int gb_emu_replay( unsigned char *rom, unsigned int rom_size,
+	Movie_t *Movie ) {
+	Gameboy_t *gb;
+	int ret;
+
+	if(!(gb = gb_emu_alloc()))
+		return GB_EMU_ERROR;
+
+	ret = movie_replay(gb, Movie, rom, rom_size);
+	mem_unload_cartridge(gb);
+
+	gb_emu_free(gb);
+	return ret;
+}
+
+/*
+ * gb_emu_save_state - Saves the state of the running game.
+ *
+ * @param data
+ *	A pointer to a variable that receives a pointer to the state image.
+ *		The caller releases it with free.
+ * @param size
+ *	A pointer to a variable that receives the size of the image, in bytes.
+ *
+ * @return
+ *	GB_EMU_OK on success, GB_EMU_ERROR if no ROM is being executed or
+ *	memory could not be allocated.
+ */
+EMU_EXPORT int gb_emu_save_state( unsigned char **data, unsigned int *size ) {
+	int status, ret = GB_EMU_ERROR;
+
+	if(GB_EMU_STATUS_STOPPED == (status = gb_emu_suspend()))
+		return GB_EMU_ERROR;
+
+	*size = state_size(&Gameboy);
+
+	if((*data = malloc(*size))) {
+		if(GB_EMU_ERROR == (ret = state_save(&Gameboy, *data))) {
+			free(*data);
+			*data = NULL;
+		}
+	}
+
+	host_xchg(&Gameboy.Status, status);
+	return ret;
+}
+
+/*
+ * gb_emu_load_state - Restores a state saved with gb_emu_save_state.
+ *
+ * @param data
+ *	A pointer to a state image.
+ * @param size
+ *	Size of the image, in bytes.
+ *
+ * @return
+ *	GB_EMU_OK on success, otherwise GB_EMU_ERROR.
+ */
+EMU_EXPORT int gb_emu_load_state( unsigned char *data, unsigned int size ) {
+	int status, ret;
+
+	if(GB_EMU_STATUS_STOPPED == (status = gb_emu_suspend()))
+		return GB_EMU_ERROR;
+
+	ret = state_load(&Gameboy, data, size);
+
+	host_xchg(&Gameboy.Status, status);
+	return ret;
+}
+
+/*
+ * gb_emu_set_rewind - Sets up the rewind buffer.
+ *
+ * @param size
+ *	Size of the rewind buffer, in bytes. Pass 0 to disable rewinding.
+ *
+ * @return
+ *	GB_EMU_OK on success, GB_EMU_ERROR if memory could not be allocated.
+ */
+EMU_EXPORT int gb_emu_set_rewind( unsigned int size ) {
+	int status, ret;
+
+	/* the emulation thread captures into the buffer */
+	status = gb_emu_suspend();
+
+	ret = rewind_init(&Gameboy.Rewind, size);
+
+	if(status != GB_EMU_STATUS_STOPPED)
+		host_xchg(&Gameboy.Status, status);
+
+	return ret;
+}
+
+/*
+ * gb_emu_rewind - Runs the game backwards.
+ *
+ * @param rewind
+ *	Set to 1 to start rewinding, 0 to stop.
+ *
+ * @return
+ *	The function returns the old setting.
+ */
+EMU_EXPORT int gb_emu_rewind( int rewind ) {
+	return host_xchg(&Gameboy.Rewinding, rewind);
+}
+
+/*
+ * gb_emu_suspend - Suspends the emulation thread.
+ *
+ * Pauses a running game and waits for the emulation thread to let go of
+ *	the machine. The caller puts the returned status back when it is done
+ *	with the machine.
+ *
+ * @return
+ *	The old status. If no ROM is being executed, nothing is done and
+ *	GB_EMU_STATUS_STOPPED is returned.
+ */
+int gb_emu_suspend( void ) {
+	int status = Gameboy.Status;
+
+	if(status != GB_EMU_STATUS_EXECUTING && status != GB_EMU_STATUS_PAUSED)
+		return GB_EMU_STATUS_STOPPED;
+
+	host_xchg(&Gameboy.Status, GB_EMU_STATUS_PAUSED);
+	gb_emu_wait_idle(&Gameboy);
+
+	return status;
+}
+
+/*
+ * gb_emu_create - Creates a machine of its own for a ROM.
+ *
+ * @param rom
+ *	A pointer to a GameBoy ROM image in memory.
+ * @param rom_size
+ *	Size of the ROM image pointed to by 'rom', in bytes.
+ *
+ * @return
+ *	A pointer to the machine, or NULL if the ROM is not a valid GameBoy
+ *	ROM or memory could not be allocated.
+ */
+EMU_EXPORT Gameboy_t *gb_emu_create( unsigned char *rom,
+	unsigned int rom_size ) {
+	MemROM_t *ROM;
+
+	if(!(ROM = mem_rom_copy(rom, rom_size)))
+		return NULL;
+
+	return gb_emu_create_rom(ROM);
+}
+
+/*
+ * gb_emu_create_file - Creates a machine running a ROM file on disk.
+ *
+ * @param path
+ *	Path of the ROM file. The file is mapped, not read.
+ *
+ * @return
+ *	A pointer to the machine, or NULL if it could not be created.
+ */
+EMU_EXPORT Gameboy_t *gb_emu_create_file( const char *path ) {
+	MemROM_t *ROM;
+
+	if(!(ROM = mem_rom_open(path)))
+		return NULL;
+
+	return gb_emu_create_rom(ROM);
+}
+
+/*
+ * gb_emu_create_rom - Creates a machine running a cartridge ROM.
+ *
+ * @param ROM
+ *	The ROM to run. The machine takes over the caller's reference.
+ *
+ * @return
+ *	A pointer to the machine, or NULL if it could not be created.
+ */
+Gameboy_t *gb_emu_create_rom( MemROM_t *ROM ) {
+	Gameboy_t *gb;
+
+	if(!(gb = gb_emu_alloc())) {
+		mem_rom_release(ROM);
+		return NULL;
+	}
+
+	gb_emu_init_headless(gb);
+
+	if(GB_EMU_ERROR == mem_insert_cartridge(gb, ROM)) {
+		mem_unload_cartridge(gb);
+		gb_emu_free(gb);
+		return NULL;
+	}
+
+	return gb;
+}
+
+/*
+ * gb_emu_fork - Creates a copy of a machine.
+ *
+ * @param gb
+ *	The machine to copy. It must not be stepped by another thread while
+ *		it is copied.
+ *
+ * @return
+ *	A pointer to the copy, or NULL if memory could not be allocated.
+ */
+EMU_EXPORT Gameboy_t *gb_emu_fork( Gameboy_t *gb ) {
+	Gameboy_t *fork;
+
+	/* most of Gameboy_t is the frame buffers at the end, which are drawn
+		before they are looked at and aren't touched here */
+	if(!(fork = gb_emu_alloc()))
+		return NULL;
+
+	memset(fork, 0, offsetof(Gameboy_t, Screen.Frames));
+
+	if(GB_EMU_ERROR == mem_fork_cartridge(fork, gb)) {
+		gb_emu_free(fork);
+		return NULL;
+	}
+
+	fork->CPU			= gb->CPU;
+	fork->CPU.ctx		= fork;
+	fork->Timer			= gb->Timer;
+	fork->RTC			= gb->RTC;
+
+	memcpy(fork->IORead, gb->IORead, sizeof(gb->IORead));
+	memcpy(fork->IOWrite, gb->IOWrite, sizeof(gb->IOWrite));
+	fork->Cycles		= gb->Cycles;
+	fork->Joypad		= gb->Joypad;
+
+	fork->Status		= GB_EMU_STATUS_EXECUTING;
+	fork->Turbo			= 1;
+	fork->Screen.Back	= 0;
+	fork->Screen.Front	= 1;
+	fork->Screen.Middle	= 2;
+	fork->Screen.WndLine	= gb->Screen.WndLine;
+
+	memcpy(fork->Counters, gb->Counters, sizeof(gb->Counters));
+
+	return fork;
+}
+
+/*
+ * gb_emu_step - Runs a machine for a number of frames.
+ *
+ * @param gb
+ *	A machine created with gb_emu_create or gb_emu_fork.
+ * @param buttons
+ *	Pressed buttons, a combination of the JOYPAD_* bits.
+ * @param frames
+ *	Number of frames to run.
+ *
+ * @return
+ *	GB_EMU_OK if all frames were run, otherwise GB_EMU_ERROR.
+ */
+EMU_EXPORT int gb_emu_step( Gameboy_t *gb, unsigned char buttons,
+	unsigned int frames ) {
+	if(frames)
+		joypad_push(gb, buttons);
+
+	while(frames--) {
+		if(GB_EMU_ERROR == gb_emu_run_frame(gb))
+			return GB_EMU_ERROR;
+	}
+
+	return GB_EMU_OK;
+}
+
+/*
+ * gb_emu_destroy - Releases a machine.
+ *
+ * @param gb
+ *	A machine created with gb_emu_create or gb_emu_fork.
+ */
+EMU_EXPORT void gb_emu_destroy( Gameboy_t *gb ) {
+	mem_unload_cartridge(gb);
+	gb_emu_free(gb);
+}
+
+/*
+ * gb_emu_pool_add - Adds the state of a machine to a reset pool.
+ *
+ * @param Pool
+ *	A pointer to a ResetPool_t structure, zeroed out before first use.
+ * @param gb
+ *	A machine created with gb_emu_create or gb_emu_fork.
+ *
+ * @return
+ *	GB_EMU_OK on success, GB_EMU_ERROR if memory could not be allocated.
+ */
+EMU_EXPORT int gb_emu_pool_add( ResetPool_t *Pool, Gameboy_t *gb ) {
+	return pool_add(Pool, gb);
+}
+
+/*
+ * gb_emu_pool_reset - Resets a machine to a state of a reset pool.
+ *
+ * @param gb
+ *	A machine created with gb_emu_create or gb_emu_fork.
+ * @param Pool
+ *	A pointer to the pool.
+ * @param index
+ *	Index of the state in the pool.
+ *
+ * @return
+ *	GB_EMU_OK on success, otherwise GB_EMU_ERROR.
+ */
+EMU_EXPORT int gb_emu_pool_reset( Gameboy_t *gb, ResetPool_t *Pool,
+	unsigned int index ) {
+	return pool_reset(gb, Pool, index);
+}
+
+/*
+ * gb_emu_pool_free - Releases all states of a reset pool.
+ *
+ */
+EMU_EXPORT void gb_emu_pool_free( ResetPool_t *Pool ) {
+	pool_free(Pool);
+}
+
+/*
+ * gb_emu_checkpoint - Brings a checkpoint up to date with a machine.
+ *
+ * @param gb
+ *	A machine created with gb_emu_create or gb_emu_fork.
+ * @param Checkpoint
+ *	A pointer to a Checkpoint_t structure, zeroed out before first use.
+ *
+ * @return
+ *	GB_EMU_OK on success, GB_EMU_ERROR if memory could not be allocated.
+ */
+EMU_EXPORT int gb_emu_checkpoint( Gameboy_t *gb, Checkpoint_t *Checkpoint ) {
+	return state_checkpoint(gb, Checkpoint);
+}
+
+/*
+ * gb_emu_rollback - Restores a machine to a checkpoint.
+ *
+ * @return
+ *	GB_EMU_OK on success, otherwise GB_EMU_ERROR.
+ */
+EMU_EXPORT int gb_emu_rollback( Gameboy_t *gb, Checkpoint_t *Checkpoint ) {
+	return state_rollback(gb, Checkpoint);
+}
+
+/*
+ * gb_emu_checkpoint_free - Releases a checkpoint.
+ *
+ */
+EMU_EXPORT void gb_emu_checkpoint_free( Checkpoint_t *Checkpoint ) {
+	state_checkpoint_free(Checkpoint);
+}
+
+/*
+ * gb_emu_hash_state - Computes a 64-bit hash of a machine's state.
+ *
+ * @return
+ *	The hash of the machine state.
+ */
+EMU_EXPORT u64 gb_emu_hash_state( Gameboy_t *gb ) {
+	return hash_state(gb);
+}
+
+/*
+ * gb_emu_hash_frame - Computes a 64-bit hash of a machine's screen.
+ *
+ * @return
+ *	The hash of the last completed frame.
+ */
+EMU_EXPORT u64 gb_emu_hash_frame( Gameboy_t *gb ) {
+	return hash_frame(gb);
+}
+
+/*
+ * gb_emu_trap_writes - Reports writes to a range of memory.
+ *
+ */
+EMU_EXPORT void gb_emu_trap_writes( Gameboy_t *gb, unsigned short from,
+	unsigned short to, MemTrap_t Hook ) {
+	if(Hook)
+		gb->TrapHook = Hook;
+
+	mem_trap_writes(gb, from >> 8, to >> 8, Hook != NULL);
+}
+
+/*
+ * gb_emu_alloc - Allocates a machine.
+ *
+ * The machine starts on a cache line boundary, so its hot fields take up
+ *	cache lines of their own. The memory is not initialized.
+ *
+ * @return
+ *	A pointer to the machine, or NULL if memory could not be allocated.
+ */
+Gameboy_t *gb_emu_alloc( void ) {
+	unsigned char *p;
+	void **gb;
+
+	if(!(p = malloc(sizeof(Gameboy_t) + sizeof(void*) + CACHE_LINE - 1)))
+		return NULL;
+
+	/* the pointer malloc returned is kept right before the machine */
+	gb = (void**) (((size_t) (p + sizeof(void*)) + CACHE_LINE - 1) &
+		~(size_t) (CACHE_LINE - 1));
+	gb[ -1 ] = p;
+
+	return (Gameboy_t*) gb;
+}
+
+/*
+ * gb_emu_free - Frees a machine allocated with gb_emu_alloc.
+ *
+ */
+void gb_emu_free( Gameboy_t *gb ) {
+	if(gb)
+		free(((void**) gb)[ -1 ]);
+}
+
+/*
+ * gb_emu_init_headless - Prepares a machine for headless use.
+ *
+ * The machine is reset and set up to run unthrottled without presenting
+ *	any frames. It is stepped by calling gb_emu_run_frame instead of by
+ *	the emulation thread. The caller loads a cartridge afterwards.
+ *
+ */
+void gb_emu_init_headless( Gameboy_t *gb ) {
+	memset(gb, 0, sizeof(Gameboy_t));
+
+	gb->Status			= GB_EMU_STATUS_EXECUTING;
+	gb->Turbo			= 1;
+	gb->Screen.Back		= 0;
+	gb->Screen.Front	= 1;
+	gb->Screen.Middle	= 2;
+
+	gb_emu_reset(gb);
 }
 
 /*
  * gb_emu_run - The actual main emulation loop.
  *
  * Runs the CPU in a loop until the user requests to stop or
- *	pause the emulator.
+ *	pause the emulator. Unless turbo mode is enabled, every frame
+ *	is paced to the configured emulation speed.
+ *
+ */
+void gb_emu_run( Gameboy_t *gb ) {
+	int ret;
+
+	pace_reset(gb);
+
+	while(gb->Status == GB_EMU_STATUS_EXECUTING) {
+		if(gb->Rewinding)
+			ret = rewind_frame(gb);
+		/* remember the state so we can come back to it */
+		else if(GB_EMU_OK == (ret = gb->RunAhead ? gb_emu_run_ahead(gb) :
+			gb_emu_run_frame(gb)))
+			rewind_capture(gb, &gb->Rewind);
+
+		if(GB_EMU_ERROR == ret)
+			break;
+
+		/* copy battery-backed RAM to the save file now and then */
+		mem_flush_save(gb, 0);
+
+		if(!gb->Turbo)
+			pace_frame(gb);
+	}
+}
+
+/*
+ * gb_emu_run_frame - Emulates a single frame.
  *
+ * Runs the CPU until the video hardware enters the VBLANK period, or
+ *	until the user requests to stop or pause the emulator.
+ *
+ * @return
+ *	GB_EMU_OK if a frame was completed, GB_EMU_ERROR if the emulator
+ *		stopped executing before the frame was done.
  */
-void gb_emu_run( void ) {
-	s32 i, Ran, Cycles = RUN_CYCLES;
+int gb_emu_run_frame( Gameboy_t *gb ) {
+	s32 Ran;
 
-	while(Gameboy.Status == GB_EMU_STATUS_EXECUTING) {
+	while(gb->Status == GB_EMU_STATUS_EXECUTING) {
 		/* run the CPU */
-		Ran = z80_run(&Gameboy.CPU, Cycles);
-
-		/* Gameboy doc contradicts itself on this but IF seems to be reset
-			by hardware */
-		Gameboy.Memory.IORegs[IO_REG_IF] = 0;
-
-		/* update clock cycle counters */
-		for(i = 0; i < CNT_NUM_CNT; i++)
-			Gameboy.Counters[ i ] = Gameboy.Counters[ i ] + Cycles - Ran;
-
-		Cycles = Ran + RUN_CYCLES;
-
-		/* is it time to do a HBLANK interrupt yet? */
-		if(Gameboy.Counters[CNT_HBLANK] > HBLANK_CYCLES )
-			video_do_hblank();
-
-		/* give host system a chance to do maintenance work */
-		host_sys();
-
-		/* do we need to cause an interrupt? */
-		if(Gameboy.Memory.IORegs[IO_REG_IF] > 0) {
-			/* priority ordered */
-			for(i = 0; i < 4; i++) {
-				if( (Gameboy.Memory.IORegs[IO_REG_IF] & (1 << i)) &&
-					(Gameboy.Memory.IE & (1 << i)) ) {
-					/* z80_interrupt checks the global interrupt enable
-						flip-flop */
-					z80_interrupt(&Gameboy.CPU, INT_VEC_TABLE + i * 0x08);
-				}
+		Ran = z80_run(&gb->CPU, gb->Cycles);
+
+		if(gb_emu_end_slice(gb, Ran))
+			return GB_EMU_OK;
+	}
+
+	return GB_EMU_ERROR;
+}
+
+/*
+ * gb_emu_end_slice - Does the cyclic tasks after a CPU slice.
+ *
+ * Updates the clock cycle counters, does HBLANKs and timer overflows and
+ *	dispatches pending interrupts.
+ *
+ * @param Ran
+ *	The value returned by z80_run for the slice, i.e. the number of clock
+ *		cycles that were left over from gb->Cycles.
+ *
+ * @return
+ *	1 if the slice completed a frame, otherwise 0.
+ */
+int gb_emu_end_slice( Gameboy_t *gb, s32 Ran ) {
+	s32 i;
+	int frame = 0;
+
+	/* Gameboy doc contradicts itself on this but IF seems to be reset
+		by hardware */
+	gb->Memory.IORegs[IO_REG_IF] = 0;
+
+	/* update clock cycle counters */
+	for(i = 0; i < CNT_NUM_CNT; i++)
+		gb->Counters[ i ] = gb->Counters[ i ] + gb->Cycles - Ran;
+
+	gb->Cycles = Ran + RUN_CYCLES;
+
+	/* is it time to do a HBLANK interrupt yet? */
+	if(gb->Counters[CNT_HBLANK] > HBLANK_CYCLES ) {
+		/* pick up the user's input at frame boundaries, unless the
+			frame is going to be rolled back */
+		if((frame = video_do_hblank(gb)) && !gb->Speculating)
+			joypad_update(gb);
+	}
+
+	/* the clock is only looked at when the game latches it, but the
+		cycle counter it goes by wraps around every 17 minutes */
+	if(frame && gb->RTC.Present)
+		rtc_update(gb);
+
+	/* did TIMA overflow? */
+	if(gb->Timer.Pending || (gb->Timer.Armed &&
+		(s32)(gb->CPU.cycles - gb->Timer.Event) >= 0))
+		timer_interrupt(gb);
+
+	/* do we need to cause an interrupt? */
+	if(gb->Memory.IORegs[IO_REG_IF] > 0) {
+		/* priority ordered */
+		for(i = 0; i < 4; i++) {
+			if( (gb->Memory.IORegs[IO_REG_IF] & (1 << i)) &&
+				(gb->Memory.IE & (1 << i)) ) {
+				/* z80_interrupt checks the global interrupt enable
+					flip-flop */
+				z80_interrupt(&gb->CPU, INT_VEC_TABLE + i * 0x08);
 			}
 		}
 	}
+
+	return frame;
+}
+
+/*
+ * gb_emu_run_ahead - Emulates a frame and runs ahead of it.
+ *
+ * The frame itself is emulated without being drawn. Then the machine
+ *	state is saved and gb->RunAhead more frames are emulated with
+ *	the same input, of which only the last one is drawn and presented.
+ *	Finally the saved state is restored, so the next call continues
+ *	right after the first frame.
+ *
+ * @return
+ *	GB_EMU_OK if a frame was completed, GB_EMU_ERROR if the emulator
+ *		stopped executing before the frame was done.
+ */
+int gb_emu_run_ahead( Gameboy_t *gb ) {
+	int i, frames = gb->RunAhead, ret;
+
+	gb->RenderSkip = 1;
+	ret = gb_emu_run_frame(gb);
+	gb->RenderSkip = 0;
+
+	if(GB_EMU_ERROR == ret)
+		return GB_EMU_ERROR;
+
+	/* can't run ahead without a snapshot, this frame goes unseen then */
+	if(GB_EMU_ERROR == state_snapshot(gb, &gb->AheadState))
+		return GB_EMU_OK;
+
+	gb->Speculating = 1;
+
+	for(i = 1; i <= frames && ret == GB_EMU_OK; i++) {
+		gb->RenderSkip = (i < frames);
+		ret = gb_emu_run_frame(gb);
+	}
+
+	gb->RenderSkip	= 0;
+	gb->Speculating	= 0;
+
+	state_restore(gb, &gb->AheadState);
+
+	return GB_EMU_OK;
+}
+
+/*
+ * gb_emu_poll_host - Gives the host a chance to do maintenance work.
+ *
+ * This is called in a loop by the presentation thread. host_sys is
+ *	invoked if at least Host.Interval microseconds have passed since
+ *	the last call. The time spent in host_sys is accumulated in
+ *	Host.Time.
+ *
+ */
+void gb_emu_poll_host( void ) {
+	unsigned int now = host_time();
+
+	if(now - Gameboy.Host.Last < Gameboy.Host.Interval)
+		return;
+
+	host_sys();
+
+	Gameboy.Host.Last = host_time();
+	Gameboy.Host.Time += Gameboy.Host.Last - now;
+	Gameboy.Host.Calls++;
 }
 
 /*
@@ -262,8 +1154,8 @@ void gb_emu_run( void ) {
  *	The number of clock cycles the instruction took to execute.
  *
  */
-int gb_emu_single_step( void ) {
-	int ret = z80_run(&Gameboy.CPU, 1);
+int gb_emu_single_step( Gameboy_t *gb ) {
+	int ret = z80_run(&gb->CPU, 1);
 #ifdef WIN32
 		system("cls");
 #else
@@ -272,19 +1164,19 @@ int gb_emu_single_step( void ) {
 		printf(	"A=0x%x (%i)\tB=0x%x (%i)\tD=0x%x (%i)\tH=0x%x (%i)\n"
 				"F=0x%x (%i)\tC=0x%x (%i)\tE=0x%x (%i)\tL=0x%x (%i)\n"
 				"\nPC=0x%x (%i)\t(inst. 0x%x)\nSP=0x%x (%i)\n\nIFF=%i\n",
-			Gameboy.CPU.u_af.A, Gameboy.CPU.u_af.A, Gameboy.CPU.u_bc.B,
-			Gameboy.CPU.u_bc.B, Gameboy.CPU.u_de.D, Gameboy.CPU.u_de.D,
-			Gameboy.CPU.u_hl.H, Gameboy.CPU.u_hl.H, Gameboy.CPU.u_af.F,
-			Gameboy.CPU.u_af.F, Gameboy.CPU.u_bc.C, Gameboy.CPU.u_bc.C,
-			Gameboy.CPU.u_de.E, Gameboy.CPU.u_de.E, Gameboy.CPU.u_hl.L,
-			Gameboy.CPU.u_hl.L, Gameboy.CPU.pc, Gameboy.CPU.pc,
-			Gameboy.CPU.mem_read(Gameboy.CPU.pc), Gameboy.CPU.sp,
-			Gameboy.CPU.sp, Gameboy.CPU.IFF);
+			gb->CPU.u_af.A, gb->CPU.u_af.A, gb->CPU.u_bc.B,
+			gb->CPU.u_bc.B, gb->CPU.u_de.D, gb->CPU.u_de.D,
+			gb->CPU.u_hl.H, gb->CPU.u_hl.H, gb->CPU.u_af.F,
+			gb->CPU.u_af.F, gb->CPU.u_bc.C, gb->CPU.u_bc.C,
+			gb->CPU.u_de.E, gb->CPU.u_de.E, gb->CPU.u_hl.L,
+			gb->CPU.u_hl.L, gb->CPU.pc, gb->CPU.pc,
+			gb->CPU.mem_read(gb, gb->CPU.pc), gb->CPU.sp,
+			gb->CPU.sp, gb->CPU.IFF);
 
 		printf("\nPress Enter to single step. Press 'q' to quit.\n");
 #ifdef WIN32
 		if('q' == getch()) /* quit */
-			Gameboy.Status = GB_EMU_STATUS_SHUTDOWN;
+			gb->Status = GB_EMU_STATUS_SHUTDOWN;
 #else
 		system("read");
 #endif
@@ -21,11 +21,17 @@ MA  02110-1301, USA.
 
 #include "gameboy.h"
 
+/* ROMs copied from memory, shared by every machine running the same
+	cartridge, see mem_rom_copy */
+static MemROM_t *ROMCache;
+static volatile int ROMCacheLock;
+
 /*
  * mem_load_cartridge - Loads a cartridge into the emulator.
  *
  * @param rom
- *	A pointer to a ROM cartridge file in memory.
+ *	A pointer to a ROM cartridge file in memory. The ROM is copied, the
+ *		caller can free the file afterwards.
  * @param rom_size
  *	Size of the cartridge file pointed to by 'rom', in bytes.
  *
@@ -34,114 +40,919 @@ MA  02110-1301, USA.
  *		loaded, otherwise GB_EMU_ERROR is returned.
  *
  */
-int mem_load_cartridge( unsigned char *rom, unsigned int rom_size ) {
+int mem_load_cartridge( Gameboy_t *gb, unsigned char *rom, unsigned int rom_size ) {
+	MemROM_t *ROM;
+
+	if(!(ROM = mem_rom_copy(rom, rom_size)))
+		return GB_EMU_ERROR;
+
+	return mem_insert_cartridge(gb, ROM);
+}
+
+/*
+ * mem_open_cartridge - Loads a cartridge from a ROM file.
+ *
+ * The file is mapped into memory rather than read, so this takes the same
+ *	time no matter how big the cartridge is. The banks are read in by the
+ *	host as the game touches them.
+ *
+ * @param path
+ *	Path of the ROM file.
+ *
+ * @return
+ *	The function returns GB_EMU_OK if the cartridge was successfully
+ *		loaded, otherwise GB_EMU_ERROR is returned.
+ *
+ */
+int mem_open_cartridge( Gameboy_t *gb, const char *path ) {
+	MemROM_t *ROM;
+
+	if(!(ROM = mem_rom_open(path)))
+		return GB_EMU_ERROR;
+
+	return mem_insert_cartridge(gb, ROM);
+}
+
+/*
+ * mem_insert_cartridge - Inserts a cartridge into the emulator.
+ *
+ * Sets up the cartridge's RAM banks and its memory bank controller.
+ *
+ * @param ROM
+ *	The ROM of the cartridge. The machine takes over the caller's
+ *		reference, even if the cartridge can't be inserted.
+ *
+ * @return
+ *	The function returns GB_EMU_OK if the cartridge was successfully
+ *		inserted, otherwise GB_EMU_ERROR is returned.
+ *
+ */
+int mem_insert_cartridge( Gameboy_t *gb, MemROM_t *ROM ) {
 	CartInfo_t *CartInfo;
-	unsigned int i;
+
+	gb->Map.ROM = ROM;
+
+	/* there are always at least 2 ROM banks in a cartridge */
+	if(ROM->NumBanks < 2) {
+		printf("mem_insert_cartridge: ROM is too small (%u bytes)\n",
+			ROM->Size);
+		return GB_EMU_ERROR;
+	}
 
 	/* get a pointer to the cartridge's information area */
-	CartInfo = (CartInfo_t*) (rom + 0x100);
+	CartInfo = (CartInfo_t*) (ROM->Data + 0x100);
 
-	/* calculate the number of ROM banks from the file size */
-	Gameboy.Memory.NumROMBanks = rom_size / 0x4000;
+	gb->Map.NumROMBanks = ROM->NumBanks;
+
+	/* figure out what kind of memory bank controller cartridge uses */
+	if(GB_EMU_ERROR == mem_get_mbc_type(CartInfo, &gb->Map.MBC)) {
+		printf("mem_insert_cartridge: Unknown Memory Bank Controller (%i)\n",
+			CartInfo->CartType);
+		return GB_EMU_ERROR;
+	}
 
 	switch(CartInfo->RAMSize) {
 		case 0:
-			Gameboy.Memory.NumRAMBanks = 0;
+			gb->Map.NumRAMBanks = 0;
 			break;
 		case 1:
 		case 2:
-			Gameboy.Memory.NumRAMBanks = 1;
+			gb->Map.NumRAMBanks = 1;
 			break;
 		case 3:
-			Gameboy.Memory.NumRAMBanks = 4;
+			gb->Map.NumRAMBanks = 4;
 			break;
 		case 4:
-			Gameboy.Memory.NumRAMBanks = 16;
+			gb->Map.NumRAMBanks = 16;
 			break;
 		default:
-			printf("mem_load_cartridge: Unknown RAM size (%i)\n",
+			printf("mem_insert_cartridge: Unknown RAM size (%i)\n",
 				CartInfo->RAMSize);
 			return GB_EMU_ERROR;
 	}
 
-	/* allocate memory for ROM and RAM banks */
-	Gameboy.Memory.ROMBanks = malloc( Gameboy.Memory.NumROMBanks *
-		sizeof(unsigned char*));
-
-	for(i = 0; i < Gameboy.Memory.NumROMBanks; i++) {
-		Gameboy.Memory.ROMBanks[ i ] = malloc(0x4000);
+	/* MBC2 has 512 x 4 bits of RAM built in, which the header doesn't
+		mention. It is kept at the start of a RAM bank of its own */
+	if(gb->Map.MBC == MBC_TYPE_2)
+		gb->Map.NumRAMBanks = 1;
 
-		/* copy ROM data from file into appropriate bank */
-		memcpy( Gameboy.Memory.ROMBanks[ i ], rom + i * 0x4000,
-			0x4000 );
+	/* allocate memory for RAM banks, all in one piece */
+	if(!(gb->Map.Arena = mem_arena_alloc(gb->Map.NumRAMBanks *
+		MEM_BANK_PAGES, gb->Map.NumRAMBanks * MEM_BANK_PAGES))) {
+		gb->Map.NumRAMBanks = 0;
+		return GB_EMU_ERROR;
 	}
 
-	Gameboy.Memory.RAMBanks = malloc( Gameboy.Memory.NumRAMBanks *
-		sizeof(unsigned char*));
+	gb->Map.RAMPages = gb->Map.Arena->Pages;
 
-	for(i = 0; i < Gameboy.Memory.NumRAMBanks; i++)
-		Gameboy.Memory.RAMBanks[ i ] = malloc(0x2000);
+	/* memory bank controllers default to 16 Mbit ROM, 8 KB RAM mode */
+	gb->Map.MBCMode = MBC_MODE_16_8;
 
-	/* figure out what kind of memory bank controller cartridge uses */
-	if(GB_EMU_ERROR == mem_get_mbc_type(CartInfo, &Gameboy.Memory.MBC)) {
-		printf("mem_load_cartridge: Unknown Memory Bank Controller (%i)\n",
-			CartInfo->CartType);
+	/* MBC2 and MBC5 cartridges have to enable their RAM before using
+		it, the others are always treated as enabled */
+	gb->Map.RAMEnable = (gb->Map.MBC != MBC_TYPE_2 &&
+		gb->Map.MBC != MBC_TYPE_5);
+
+	/* ROM0 always points to the first bank in ROM which is the
+		fixed 16 Kb ROM space. SROM points at the first switchable ROM
+		bank by default. SRAM points at the first switchable RAM bank */
+	gb->Map.ROMBankSelect = 1;
+	gb->Map.RAMBankSelect = 0;
+
+	mem_map_banks(gb);
+
+	mem_touch_all(gb);
+
+	rtc_reset(gb, mem_has_rtc(CartInfo));
+
+	/* everything OK */
+	return GB_EMU_OK;
+}
+
+/*
+ * mem_share_cartridge - Inserts another machine's cartridge.
+ *
+ * The ROM banks of the cartridge are shared with the other machine. The
+ *	RAM banks are the machine's own.
+ *
+ * @param from
+ *	The machine the cartridge was loaded into with mem_load_cartridge.
+ *
+ * @return
+ *	The function returns GB_EMU_OK if the cartridge was successfully
+ *		inserted, otherwise GB_EMU_ERROR is returned.
+ *
+ */
+int mem_share_cartridge( Gameboy_t *gb, Gameboy_t *from ) {
+	host_add(&from->Map.ROM->Refs, 1);
+
+	gb->Map.ROM			= from->Map.ROM;
+	gb->Map.NumROMBanks	= from->Map.NumROMBanks;
+
+	if(!(gb->Map.Arena = mem_arena_alloc(from->Map.NumRAMBanks *
+		MEM_BANK_PAGES, from->Map.NumRAMBanks * MEM_BANK_PAGES)))
+		return GB_EMU_ERROR;
+
+	gb->Map.NumRAMBanks	= from->Map.NumRAMBanks;
+	gb->Map.RAMPages		= gb->Map.Arena->Pages;
+
+	gb->Map.MBC		= from->Map.MBC;
+	gb->Map.MBCMode	= MBC_MODE_16_8;
+
+	gb->Map.RAMEnable = (gb->Map.MBC != MBC_TYPE_2 &&
+		gb->Map.MBC != MBC_TYPE_5);
+
+	gb->Map.ROMBankSelect = 1;
+	gb->Map.RAMBankSelect = 0;
+
+	mem_map_banks(gb);
+
+	mem_touch_all(gb);
+
+	rtc_reset(gb, from->RTC.Present);
+
+	return GB_EMU_OK;
+}
+
+/*
+ * mem_fork_cartridge - Copies another machine's memory.
+ *
+ * The machine gets a copy of the other machine's memory, bank selects and
+ *	all. The ROM banks are shared and so are the pages of the RAM banks
+ *	until either machine writes to them. Only the few KB of internal RAM
+ *	are actually copied.
+ *
+ * The other machine must not be running while it is being forked. Both
+ *	machines can be run on different threads afterwards.
+ *
+ * @param from
+ *	The machine to copy the memory from.
+ *
+ * @return
+ *	The function returns GB_EMU_OK if the memory was successfully
+ *		copied, otherwise GB_EMU_ERROR is returned.
+ *
+ */
+int mem_fork_cartridge( Gameboy_t *gb, Gameboy_t *from ) {
+	MemArena_t *Arena;
+	MemPage_t **Pages;
+	unsigned int i, num = from->Map.NumRAMBanks * MEM_BANK_PAGES;
+
+	/* the pages are shared, only the array is the machine's own */
+	if(!(Arena = mem_arena_alloc(num, 0)))
 		return GB_EMU_ERROR;
+
+	Pages = Arena->Pages;
+
+	for(i = 0; i < num; i++) {
+		Pages[ i ] = from->Map.RAMPages[ i ];
+		host_add(&Pages[ i ]->Refs, 1);
 	}
 
-	/* memory bank controllers default to 16 Mbit ROM, 8 KB RAM mode */
-	Gameboy.Memory.MBCMode = MBC_MODE_16_8;
+	host_add(&from->Map.ROM->Refs, 1);
+
+	/* SROM and SRAM point into the shared banks and pages */
+	gb->Map				= from->Map;
+	gb->Memory			= from->Memory;
+	gb->Map.RAMPages	= Pages;
+	gb->Map.Arena		= Arena;
+
+	/* the page table still points into the other machine */
+	mem_map_banks(gb);
+	mem_touch_all(gb);
+
+	return GB_EMU_OK;
+}
 
-	/* ROM0 always points to the first entry in ROMBanks which is the
-		fixed 16 Kb ROM space */
-	Gameboy.Memory.ROM0 = Gameboy.Memory.ROMBanks[ 0 ];
+/*
+ * mem_reset_memory - Resets memory to another machine's.
+ *
+ * Like mem_fork_cartridge but for a machine that already has memory of
+ *	its own. The cartridge is shared with the other machine, which may be
+ *	a different cartridge than the one the machine had before. Unless a
+ *	full reset is asked for, only the blocks of internal RAM that were
+ *	written since the last reset are copied.
+ *
+ * @param from
+ *	The machine to copy the memory from. It must not have run since the
+ *		machine was last reset to it.
+ * @param full
+ *	Set to 1 to copy all of internal RAM, e.g. if the machine was last
+ *		reset to a different machine.
+ *
+ * @return
+ *	The function returns GB_EMU_OK if the memory was successfully
+ *		reset, otherwise GB_EMU_ERROR is returned.
+ *
+ */
+int mem_reset_memory( Gameboy_t *gb, Gameboy_t *from, int full ) {
+	MemArena_t *Arena = gb->Map.Arena;
+	MemPage_t **Pages = gb->Map.RAMPages;
+	unsigned int i, num = from->Map.NumRAMBanks * MEM_BANK_PAGES,
+		old = gb->Map.NumRAMBanks * MEM_BANK_PAGES;
+
+	if(num != old || !Arena) {
+		if(!(Arena = mem_arena_alloc(num, 0)))
+			return GB_EMU_ERROR;
 
-	/* setup SROM to point at the first switchable ROM bank by default.
-		There are always at least 2 ROM banks in a cartridge */
-	Gameboy.Memory.SROM = Gameboy.Memory.ROMBanks[ 1 ];
+		Pages = Arena->Pages;
+	}
 
-	/* setup SRAM to point at the first switchable RAM bank */
-	if( Gameboy.Memory.NumRAMBanks > 0 )
-		Gameboy.Memory.SRAM = Gameboy.Memory.RAMBanks[ 0 ];
+	/* take the new references first, the pages may be the same */
+	for(i = 0; i < num; i++)
+		host_add(&from->Map.RAMPages[ i ]->Refs, 1);
 
-	Gameboy.Memory.ROMBankSelect = 1;
-	Gameboy.Memory.RAMBankSelect = 0;
+	for(i = 0; i < old; i++)
+		mem_page_release(gb->Map.RAMPages[ i ]);
+
+	for(i = 0; i < num; i++)
+		Pages[ i ] = from->Map.RAMPages[ i ];
+
+	if(Arena != gb->Map.Arena && gb->Map.Arena)
+		mem_arena_release(gb->Map.Arena);
+
+	host_add(&from->Map.ROM->Refs, 1);
+
+	if(gb->Map.ROM)
+		mem_rom_release(gb->Map.ROM);
+
+	gb->Map.RAMPages		= Pages;
+	gb->Map.Arena			= Arena;
+	gb->Map.ROM			= from->Map.ROM;
+	gb->Map.NumROMBanks	= from->Map.NumROMBanks;
+	gb->Map.NumRAMBanks	= from->Map.NumRAMBanks;
+	gb->Map.ROMBankSelect	= from->Map.ROMBankSelect;
+	gb->Map.RAMBankSelect	= from->Map.RAMBankSelect;
+	gb->Map.MBC			= from->Map.MBC;
+	gb->Map.MBCMode		= from->Map.MBCMode;
+	gb->Map.RAMEnable		= from->Map.RAMEnable;
+
+	mem_map_banks(gb);
+
+	/* I/O registers are also written by the video hardware, the timer
+		and so on. They are copied along with RAM1 and IE every time */
+	memcpy(gb->Memory.IORegs, from->Memory.IORegs,
+		sizeof(gb->Memory.IORegs));
+	memcpy(gb->Memory.RAM1, from->Memory.RAM1, sizeof(gb->Memory.RAM1));
+	gb->Memory.IE = from->Memory.IE;
+
+	mem_collect_dirty(gb);
+
+	if(full) {
+		for(i = 0; i < MEM_DIRTY_WORDS; i++)
+			gb->PoolDirty[ i ] = ~0U;
+	}
+
+	mem_copy_blocks(gb->Memory.VRAM, gb->Memory.RAM0, gb->Memory.OAM,
+		&from->Memory, gb->PoolDirty);
+
+	/* the blocks copied have changed since the last checkpoint */
+	for(i = 0; i < MEM_DIRTY_WORDS; i++) {
+		gb->CheckDirty[ i ]	|= gb->PoolDirty[ i ];
+		gb->HashDirty[ i ]	|= gb->PoolDirty[ i ];
+		gb->PoolDirty[ i ]	= 0;
+	}
 
-	/* everything OK */
 	return GB_EMU_OK;
 }
 
+/*
+ * mem_copy_blocks - Copies the marked 256 byte blocks of internal RAM.
+ *
+ * @param VRAM
+ *	A pointer to the 8 KB of video RAM to copy to.
+ * @param RAM0
+ *	A pointer to the 8 KB of fixed RAM to copy to.
+ * @param OAM
+ *	A pointer to the Object Attribute Memory to copy to.
+ * @param from
+ *	The memory to copy from.
+ * @param Dirty
+ *	A bitmap of MEM_DIRTY_WORDS words, one bit for each 256 byte block
+ *		of 0x8000 - 0xFFFF. Blocks outside of VRAM, RAM0 and OAM are
+ *		ignored.
+ */
+void mem_copy_blocks( unsigned char *VRAM, unsigned char *RAM0,
+	unsigned char *OAM, Memory_t *from, unsigned int *Dirty ) {
+	unsigned int i, bits, addr;
+
+	for(i = 0; i < MEM_DIRTY_WORDS; i++) {
+		for(bits = Dirty[ i ]; bits; bits &= bits - 1) {
+			/* address of the lowest block left in this word */
+			for(addr = 0; !(bits & (1U << addr)); addr++);
+			addr = 0x8000 + ((i * 32 + addr) << 8);
+
+			if(addr < 0xA000)
+				memcpy(&VRAM[ addr - 0x8000 ],
+					&from->VRAM[ addr - 0x8000 ], 0x100);
+			else if(addr >= 0xC000 && addr < 0xE000)
+				memcpy(&RAM0[ addr - 0xC000 ],
+					&from->RAM0[ addr - 0xC000 ], 0x100);
+			else if(addr == 0xFE00)
+				memcpy(OAM, from->OAM, 0xA0);
+		}
+	}
+}
+
+/*
+ * mem_collect_dirty - Hands the blocks marked by MEM_DIRTY on.
+ *
+ * Pool resets, checkpoints and the state hash each keep track of the
+ *	blocks of internal RAM changed since they last looked. mem_write only
+ *	marks Map.Dirty, which is added to all three and cleared here.
+ *
+ */
+void mem_collect_dirty( Gameboy_t *gb ) {
+	unsigned int i;
+
+	/* writes to 0xE000 - 0xFDFF are marked where they went, fold them
+		back onto RAM0 */
+	gb->Map.Dirty[ 2 ] |= gb->Map.Dirty[ 3 ] & 0x3FFFFFFF;
+	gb->Map.Dirty[ 3 ] &= 0xC0000000;
+
+	for(i = 0; i < MEM_DIRTY_WORDS; i++) {
+		gb->PoolDirty[ i ]	|= gb->Map.Dirty[ i ];
+		gb->CheckDirty[ i ]	|= gb->Map.Dirty[ i ];
+		gb->HashDirty[ i ]	|= gb->Map.Dirty[ i ];
+		gb->Map.Dirty[ i ]	= 0;
+	}
+}
+
+/*
+ * mem_touch_all - Marks all of internal RAM as changed.
+ *
+ * Used when the machine's memory is replaced as a whole, so that no
+ *	checkpoint, pool reset or state hash relies on blocks it saw before.
+ *
+ */
+void mem_touch_all( Gameboy_t *gb ) {
+	unsigned int i;
+
+	for(i = 0; i < MEM_DIRTY_WORDS; i++) {
+		gb->PoolDirty[ i ]	= ~0U;
+		gb->CheckDirty[ i ]	= ~0U;
+		gb->HashDirty[ i ]	= ~0U;
+	}
+}
+
 /*
  * mem_unload_cartridge - Unloads a cartridge.
  *
  */
-int mem_unload_cartridge( void ) {
+int mem_unload_cartridge( Gameboy_t *gb ) {
 	unsigned int i;
 
-	/* free up memory */
-	for(i = 0; i < Gameboy.Memory.NumROMBanks; i++)
-		free(Gameboy.Memory.ROMBanks[ i ]);
-	
-	for(i = 0; i < Gameboy.Memory.NumRAMBanks; i++)
-		free(Gameboy.Memory.RAMBanks[ i ]);
+	/* the RAM banks go to the save file before they are freed */
+	mem_close_save(gb);
+
+	/* free up memory. The ROM banks go when the last machine lets go */
+	if(gb->Map.ROM)
+		mem_rom_release(gb->Map.ROM);
+
+	mem_free_pages(gb);
+
+	gb->Map.NumROMBanks		= 0;
+	gb->Map.NumRAMBanks		= 0;
+	gb->Map.RAMBankSelect	= 0;
+	gb->Map.ROMBankSelect	= 0;
 
-	free(Gameboy.Memory.ROMBanks);
-	free(Gameboy.Memory.RAMBanks);
+	gb->Map.ROM				= NULL;
+	gb->Map.RAMPages			= NULL;
+	gb->Map.Arena				= NULL;
+	gb->Map.SROM				= NULL;
+	gb->Map.ROM0				= NULL;
 
-	Gameboy.Memory.NumROMBanks		= 0;
-	Gameboy.Memory.NumRAMBanks		= 0;
-	Gameboy.Memory.RAMBankSelect	= 0;
-	Gameboy.Memory.ROMBankSelect	= 0;
+	for(i = 0; i < MEM_BANK_PAGES; i++)
+		gb->Map.SRAM[ i ]	= NULL;
 
-	Gameboy.Memory.ROMBanks			= NULL;
-	Gameboy.Memory.RAMBanks			= NULL;
-	Gameboy.Memory.SROM				= NULL;
-	Gameboy.Memory.SRAM				= NULL;
-	Gameboy.Memory.ROM0				= NULL;
+	for(i = 0; i < MEM_NUM_PAGES; i++)
+		gb->ReadPage[ i ]	= NULL;
 
 	return GB_EMU_OK;
 }
 
+/*
+ * mem_arena_alloc - Allocates a machine's cartridge RAM.
+ *
+ * The array of page pointers and the pages are carved out of a single
+ *	allocation, so loading a cartridge takes one malloc and the pages
+ *	sit next to each other in memory. The pages are cleared.
+ *
+ * @param num
+ *	Number of entries in the array of page pointers.
+ * @param pages
+ *	Number of pages to allocate, either 0 or 'num'. Machines that share
+ *		the pages of another machine only need the array.
+ *
+ * @return
+ *	A pointer to the arena, or NULL if memory could not be allocated.
+ */
+MemArena_t *mem_arena_alloc( unsigned int num, unsigned int pages ) {
+	unsigned char *Raw, *Next;
+	MemArena_t *Arena;
+	MemPage_t *Page;
+	unsigned int i;
+
+	/* room for everything, each piece rounded up to a cache line, plus
+		the slack needed to align the first one */
+	if(!(Raw = calloc(1, CACHE_LINE + MEM_ARENA_ROUND(sizeof(MemArena_t)) +
+		MEM_ARENA_ROUND(num * sizeof(MemPage_t*)) +
+		pages * MEM_ARENA_ROUND(sizeof(MemPage_t)))))
+		return NULL;
+
+	Next = (unsigned char*) MEM_ARENA_ROUND((size_t) Raw);
+
+	Arena			= (MemArena_t*) mem_arena_carve(&Next, sizeof(MemArena_t));
+	Arena->Raw		= Raw;
+	Arena->Refs		= 1 + pages;
+	Arena->Pages	= (MemPage_t**) mem_arena_carve(&Next,
+		num * sizeof(MemPage_t*));
+
+	for(i = 0; i < pages; i++) {
+		Page			= (MemPage_t*) mem_arena_carve(&Next, sizeof(MemPage_t));
+		Page->Refs		= 1;
+		Page->Hashed	= 0;
+		Page->Arena		= Arena;
+
+		Arena->Pages[ i ] = Page;
+	}
+
+	return Arena;
+}
+
+/*
+ * mem_arena_carve - Takes the next piece of an arena.
+ *
+ * @param Next
+ *	A pointer to the next free byte of the arena, advanced past the
+ *		piece to the next cache line.
+ * @param size
+ *	Size of the piece, in bytes.
+ *
+ * @return
+ *	A pointer to the piece.
+ */
+unsigned char *mem_arena_carve( unsigned char **Next, unsigned int size ) {
+	unsigned char *Piece = *Next;
+
+	*Next += MEM_ARENA_ROUND(size);
+
+	return Piece;
+}
+
+/*
+ * mem_arena_release - Lets go of an arena or one of its pages.
+ *
+ * The arena is freed in one go once the machine has let go of the array
+ *	and none of its pages is used anymore.
+ *
+ */
+void mem_arena_release( MemArena_t *Arena ) {
+	if(host_add(&Arena->Refs, -1) == 1)
+		free(Arena->Raw);
+}
+
+/*
+ * mem_free_pages - Lets go of a machine's cartridge RAM.
+ *
+ */
+void mem_free_pages( Gameboy_t *gb ) {
+	unsigned int i;
+
+	for(i = 0; i < gb->Map.NumRAMBanks * MEM_BANK_PAGES; i++)
+		mem_page_release(gb->Map.RAMPages[ i ]);
+
+	if(gb->Map.Arena)
+		mem_arena_release(gb->Map.Arena);
+}
+
+/*
+ * mem_page_alloc - Allocates a page of cartridge RAM.
+ *
+ * This is used for the copies made when a shared page is written, the
+ *	pages of a cartridge come from mem_arena_alloc.
+ *
+ * @return
+ *	A pointer to the page, used by a single machine, or NULL if memory
+ *		could not be allocated.
+ */
+MemPage_t *mem_page_alloc( void ) {
+	MemPage_t *Page;
+
+	if((Page = malloc(sizeof(MemPage_t)))) {
+		Page->Refs		= 1;
+		Page->Hashed	= 0;
+		Page->Arena		= NULL;
+	}
+
+	return Page;
+}
+
+/*
+ * mem_page_release - Lets go of a page of cartridge RAM.
+ *
+ * The page is freed once no machine is using it anymore. Pages of an
+ *	arena go back to the arena.
+ *
+ */
+void mem_page_release( MemPage_t *Page ) {
+	if(!Page || host_add(&Page->Refs, -1) != 1)
+		return;
+
+	if(Page->Arena)
+		mem_arena_release(Page->Arena);
+	else
+		free(Page);
+}
+
+/*
+ * mem_page_unshare - Makes sure a page is used by one machine only.
+ *
+ * If the page is shared with other machines, it is replaced with a copy.
+ *
+ * @param Page
+ *	A pointer to the machine's pointer to the page.
+ *
+ * @return
+ *	A pointer to the page, or NULL if memory could not be allocated.
+ */
+MemPage_t *mem_page_unshare( MemPage_t **Page ) {
+	MemPage_t *Copy;
+
+	/* only forks of this machine could raise the count, and they are
+		made on the thread that runs it */
+	if((*Page)->Refs == 1)
+		return *Page;
+
+	if(!(Copy = mem_page_alloc()))
+		return NULL;
+
+	memcpy(Copy->Data, (*Page)->Data, MEM_PAGE_SIZE);
+
+	mem_page_release(*Page);
+
+	return *Page = Copy;
+}
+
+/*
+ * mem_unshare_sram - Gets a private copy of a switched-in RAM page.
+ *
+ * This is called when the CPU writes to a page of the switched-in RAM
+ *	bank that is shared with a forked machine.
+ *
+ * @param page
+ *	Index of the page within the RAM bank.
+ *
+ * @return
+ *	A pointer to the page, or NULL if memory could not be allocated.
+ */
+MemPage_t *mem_unshare_sram( Gameboy_t *gb, unsigned int page ) {
+	MemPage_t *Page = mem_page_unshare(&gb->Map.RAMPages
+		[ gb->Map.RAMBankSelect * MEM_BANK_PAGES + page ]);
+
+	unsigned int i;
+
+	if(Page) {
+		gb->Map.SRAM[ page ] = Page;
+
+		for(i = 0; i < MEM_PAGE_SIZE >> 8; i++)
+			gb->ReadPage[ 0xA0 + (page << (MEM_PAGE_SHIFT - 8)) + i ] =
+				&Page->Data[ i << 8 ];
+	}
+
+	return Page;
+}
+
+/*
+ * mem_rom_copy - Makes a ROM of a cartridge file in memory.
+ *
+ * ROMs copied from memory are kept in a process-wide cache keyed by a
+ *	hash of their contents. If the same cartridge has been loaded before
+ *	and is still in use, its ROM is shared instead of making another
+ *	copy.
+ *
+ * @param rom
+ *	A pointer to the cartridge file.
+ * @param rom_size
+ *	Size of the cartridge file, in bytes.
+ *
+ * @return
+ *	A pointer to the ROM, or NULL if memory could not be allocated.
+ */
+MemROM_t *mem_rom_copy( unsigned char *rom, unsigned int rom_size ) {
+	u64 Hash = hash_bytes(rom, rom_size, 0);
+	MemROM_t *ROM;
+
+	if((ROM = mem_rom_find(rom, rom_size, Hash)))
+		return ROM;
+
+	if(!(ROM = malloc(sizeof(MemROM_t))))
+		return NULL;
+
+	if(!(ROM->Data = malloc(rom_size ? rom_size : 1))) {
+		free(ROM);
+		return NULL;
+	}
+
+	/* the banks stay back to back, as they are in the file */
+	memcpy(ROM->Data, rom, rom_size);
+
+	ROM->Size		= rom_size;
+	ROM->NumBanks	= rom_size / 0x4000;
+	ROM->Mapped		= 0;
+	ROM->Refs		= 1;
+	ROM->Hash		= Hash;
+
+	mem_cache_lock();
+
+	/* another thread may have loaded the same cartridge meanwhile */
+	if(!mem_rom_lookup(rom, rom_size, Hash)) {
+		ROM->Next	= ROMCache;
+		ROMCache	= ROM;
+		ROM->Cached	= 1;
+	}
+	else
+		ROM->Cached	= 0;
+
+	mem_cache_unlock();
+
+	return ROM;
+}
+
+/*
+ * mem_rom_find - Looks for a cached ROM.
+ *
+ * @param rom
+ *	A pointer to the cartridge file.
+ * @param rom_size
+ *	Size of the cartridge file, in bytes.
+ * @param Hash
+ *	The hash of the cartridge file, see hash_bytes.
+ *
+ * @return
+ *	A pointer to the ROM with a reference taken for the caller, or NULL
+ *		if the cartridge is not in the cache.
+ */
+MemROM_t *mem_rom_find( unsigned char *rom, unsigned int rom_size, u64 Hash ) {
+	MemROM_t *ROM;
+
+	mem_cache_lock();
+
+	if((ROM = mem_rom_lookup(rom, rom_size, Hash)))
+		host_add(&ROM->Refs, 1);
+
+	mem_cache_unlock();
+
+	return ROM;
+}
+
+/*
+ * mem_rom_lookup - Finds a ROM in the cache.
+ *
+ * The cache lock must be held. The contents are compared as well, two
+ *	cartridges with the same hash are never mixed up.
+ *
+ */
+MemROM_t *mem_rom_lookup( unsigned char *rom, unsigned int rom_size,
+	u64 Hash ) {
+	MemROM_t *ROM;
+
+	for(ROM = ROMCache; ROM; ROM = ROM->Next) {
+		if(ROM->Hash == Hash && ROM->Size == rom_size &&
+			!memcmp(ROM->Data, rom, rom_size))
+			return ROM;
+	}
+
+	return NULL;
+}
+
+/*
+ * mem_cache_lock - Acquires the spinlock of the ROM cache.
+ *
+ */
+void mem_cache_lock( void ) {
+	while(host_xchg(&ROMCacheLock, 1))
+		;
+}
+
+/*
+ * mem_cache_unlock - Releases the spinlock of the ROM cache.
+ *
+ */
+void mem_cache_unlock( void ) {
+	host_xchg(&ROMCacheLock, 0);
+}
+
+/*
+ * mem_rom_open - Makes a ROM of a cartridge file.
+ *
+ * The file is mapped read-only with host_map_file and the banks are
+ *	addressed within the mapping, nothing is copied. Mapped ROMs are not
+ *	cached, hashing them would read in the whole file. Mappings of the
+ *	same file share the host's pages anyway.
+ *
+ * @param path
+ *	Path of the cartridge file.
+ *
+ * @return
+ *	A pointer to the ROM, used by a single machine, or NULL if the file
+ *		could not be mapped.
+ */
+MemROM_t *mem_rom_open( const char *path ) {
+	MemROM_t *ROM;
+
+	if(!(ROM = malloc(sizeof(MemROM_t))))
+		return NULL;
+
+	if(!(ROM->Data = host_map_file(path, &ROM->Size))) {
+		free(ROM);
+		return NULL;
+	}
+
+	ROM->NumBanks	= ROM->Size / 0x4000;
+	ROM->Mapped		= 1;
+	ROM->Cached		= 0;
+	ROM->Refs		= 1;
+
+	return ROM;
+}
+
+/*
+ * mem_rom_release - Lets go of the ROM banks of a cartridge.
+ *
+ * The banks are freed, or unmapped, once no machine is using them
+ *	anymore.
+ *
+ */
+void mem_rom_release( MemROM_t *ROM ) {
+	MemROM_t **Link;
+
+	if(!ROM->Cached) {
+		if(host_add(&ROM->Refs, -1) != 1)
+			return;
+	}
+	else {
+		/* the last reference has to go under the lock, so the ROM can't
+			be found in the cache while it is being freed */
+		mem_cache_lock();
+
+		if(host_add(&ROM->Refs, -1) != 1) {
+			mem_cache_unlock();
+			return;
+		}
+
+		for(Link = &ROMCache; *Link != ROM; Link = &(*Link)->Next)
+			;
+
+		*Link = ROM->Next;
+
+		mem_cache_unlock();
+	}
+
+	if(ROM->Mapped)
+		host_unmap_file(ROM->Data, ROM->Size);
+	else
+		free(ROM->Data);
+
+	free(ROM);
+}
+
+/*
+ * mem_map_banks - Maps in the selected ROM and RAM banks.
+ *
+ * Points SROM and SRAM at the banks selected by ROMBankSelect and
+ *	RAMBankSelect and sets up the read page table. This is used after the
+ *	bank selects have been set directly, e.g. when a save state is
+ *	restored, and whenever the machine's memory has been copied.
+ *
+ */
+void mem_map_banks( Gameboy_t *gb ) {
+	unsigned int i;
+
+	gb->Map.ROM0 = gb->Map.ROM->Data;
+
+	for(i = 0x00; i < 0x40; i++)
+		gb->ReadPage[ i ] = gb->Map.ROM0 + (i << 8);
+
+	mem_map_rom(gb);
+	mem_map_sram(gb);
+
+	for(i = 0x80; i < 0xA0; i++)
+		gb->ReadPage[ i ] = &gb->Memory.VRAM[ (i - 0x80) << 8 ];
+
+	/* 0xE000 - 0xFDFF echoes RAM0 */
+	for(i = 0xC0; i < 0xFE; i++)
+		gb->ReadPage[ i ] = &gb->Memory.RAM0[ ((i - 0xC0) << 8) & 0x1FFF ];
+
+	/* OAM shares its page with unusable memory, the I/O registers have
+		to be handled one by one */
+	gb->ReadPage[ 0xFE ] = NULL;
+	gb->ReadPage[ 0xFF ] = NULL;
+
+	for(i = 0; i < MEM_NUM_PAGES; i++)
+		mem_map_write(gb, i);
+}
+
+/*
+ * mem_map_rom - Maps in the selected ROM bank.
+ *
+ * Called by the memory bank controller whenever ROMBankSelect changes.
+ *
+ */
+void mem_map_rom( Gameboy_t *gb ) {
+	unsigned int i, bank = gb->Map.ROMBankSelect;
+
+	/* selecting ROM bank 0 selects ROM bank 1, except on MBC5 */
+	if(!bank && gb->Map.MBC != MBC_TYPE_5)
+		bank = 1;
+
+	/* the cartridge ignores the bits it has no banks for */
+	if(bank >= gb->Map.ROM->NumBanks)
+		bank %= gb->Map.ROM->NumBanks;
+
+	gb->Map.SROM = gb->Map.ROM->Data + 0x4000 * bank;
+
+	for(i = 0x40; i < 0x80; i++)
+		gb->ReadPage[ i ] = gb->Map.SROM + ((i - 0x40) << 8);
+}
+
+/*
+ * mem_map_sram - Maps in the selected RAM bank.
+ *
+ * Called by the memory bank controller whenever RAMBankSelect changes.
+ *
+ */
+void mem_map_sram( Gameboy_t *gb ) {
+	unsigned int i;
+
+	/* the 512 bytes of MBC2 RAM repeat all over 0xA000 - 0xBFFF. Only
+		the lower 4 bits are stored, so they are read by mem_read_slow */
+	if(gb->Map.MBC == MBC_TYPE_2) {
+		for(i = 0; i < MEM_BANK_PAGES; i++)
+			gb->Map.SRAM[ i ] = (gb->Map.NumRAMBanks && gb->Map.RAMEnable) ?
+				gb->Map.RAMPages[0] : NULL;
+
+		for(i = 0xA0; i < 0xC0; i++)
+			gb->ReadPage[ i ] = NULL;
+		return;
+	}
+
+	/* reads from a RAM bank that doesn't exist, or while RAM is disabled,
+		return 0 */
+	for(i = 0; i < MEM_BANK_PAGES; i++) {
+		if( gb->Map.RAMBankSelect < gb->Map.NumRAMBanks &&
+			gb->Map.RAMEnable )
+			gb->Map.SRAM[ i ] = gb->Map.RAMPages
+				[ gb->Map.RAMBankSelect * MEM_BANK_PAGES + i ];
+		else
+			gb->Map.SRAM[ i ] = NULL;
+	}
+
+	for(i = 0xA0; i < 0xC0; i++)
+		gb->ReadPage[ i ] = gb->Map.SRAM[0] ? &gb->Map.SRAM[ (i - 0xA0) >>
+			(MEM_PAGE_SHIFT - 8) ]->Data[ (i << 8) & MEM_PAGE_MASK ] : NULL;
+}
+
 /*
  * mem_get_mbc_type - Figure out which MBC type catridge contains.
  *
@@ -166,6 +977,7 @@ int mem_get_mbc_type( CartInfo_t *CartInfo, unsigned char *MBC ) {
 		case 0x05: case 0x06:
 			*MBC = MBC_TYPE_2;
 			break;
+		case 0x0F: case 0x10: case 0x11:
 		case 0x12: case 0x13:
 			*MBC = MBC_TYPE_3;
 			break;
@@ -177,7 +989,210 @@ int mem_get_mbc_type( CartInfo_t *CartInfo, unsigned char *MBC ) {
 			return GB_EMU_ERROR;
 	}
 
-	return GB_EMU_OK;
+	return GB_EMU_OK;
+}
+
+/*
+ * mem_has_battery - Figure out if a cartridge has battery-backed RAM.
+ *
+ * @param CartInfo
+ *	A pointer to a CartInfo_t structure.
+ *
+ * @return
+ *	1 if the cartridge keeps its RAM when switched off, otherwise 0.
+ *
+ */
+int mem_has_battery( CartInfo_t *CartInfo ) {
+	switch(CartInfo->CartType) {
+		case 0x03: case 0x06: case 0x09: case 0x0D:
+		case 0x0F: case 0x10: case 0x13:
+		case 0x1B: case 0x1E: case 0xFF:
+			return 1;
+		default:
+			return 0;
+	}
+}
+
+/*
+ * mem_has_rtc - Figure out if a cartridge has a real-time clock.
+ *
+ * @param CartInfo
+ *	A pointer to a CartInfo_t structure.
+ *
+ * @return
+ *	1 if the cartridge is an MBC3 cartridge with a clock, otherwise 0.
+ *
+ */
+int mem_has_rtc( CartInfo_t *CartInfo ) {
+	return CartInfo->CartType == 0x0F || CartInfo->CartType == 0x10;
+}
+
+/*
+ * mem_open_save - Opens the save file of a battery-backed cartridge.
+ *
+ * The save file is named after the ROM file, with the extension replaced
+ *	by .sav, and holds the RAM banks back to back, followed by the clock
+ *	of cartridges that have one. It is mapped with host_map_save and
+ *	created if it doesn't exist yet. The RAM banks are loaded from the
+ *	file. Writes go to the banks as usual and to the file as well, see
+ *	mem_write_sram.
+ *
+ * @param path
+ *	Path of the ROM file of the cartridge.
+ *
+ * @return
+ *	GB_EMU_OK if the save file was opened or the cartridge has no battery,
+ *		GB_EMU_ERROR if the file could not be mapped.
+ *
+ */
+int mem_open_save( Gameboy_t *gb, const char *path ) {
+	CartInfo_t *CartInfo = (CartInfo_t*) (gb->Map.ROM->Data + 0x100);
+	unsigned int i, len = strlen(path), Size;
+	unsigned char *Data;
+	char *name;
+
+	if(!mem_has_battery(CartInfo) ||
+		(!gb->Map.NumRAMBanks && !gb->RTC.Present))
+		return GB_EMU_OK;
+
+	if(!(name = malloc(len + sizeof(".sav"))))
+		return GB_EMU_ERROR;
+
+	/* replace the extension of the file name, if there is one */
+	strcpy(name, path);
+
+	for(i = len; i && name[ i - 1 ] != '.' && name[ i - 1 ] != '/' &&
+		name[ i - 1 ] != '\\'; i--)
+		;
+
+	strcpy((i && name[ i - 1 ] == '.') ? &name[ i - 1 ] : &name[ len ],
+		".sav");
+
+	/* MBC2 saves are just the 512 bytes of its built-in RAM */
+	Size = (gb->Map.MBC == MBC_TYPE_2) ? 0x200 :
+		gb->Map.NumRAMBanks * 0x2000;
+	Data = host_map_save(name, Size + (gb->RTC.Present ?
+		RTC_SAVE_SIZE : 0));
+
+	free(name);
+
+	if(!Data)
+		return GB_EMU_ERROR;
+
+	for(i = 0; i * MEM_PAGE_SIZE < Size; i++) {
+		memcpy(gb->Map.RAMPages[ i ]->Data, Data + i * MEM_PAGE_SIZE,
+			mem_save_chunk(Size, i));
+		gb->Map.RAMPages[ i ]->Hashed = 0;
+	}
+
+	if(gb->RTC.Present)
+		rtc_load(gb, Data + Size);
+
+	gb->Save.Data		= Data;
+	gb->Save.Size		= Size + (gb->RTC.Present ? RTC_SAVE_SIZE : 0);
+	gb->Save.RAMSize	= Size;
+	gb->Save.Last		= host_time();
+	gb->Save.Dirty		= 0;
+
+	return GB_EMU_OK;
+}
+
+/*
+ * mem_flush_save - Writes the save file back to disk.
+ *
+ * This is called after every frame but does its work at most once every
+ *	MEM_SAVE_INTERVAL microseconds. The game's writes are already in the
+ *	file, which is mapped shared, so they survive a crash of the emulator
+ *	right away. The host is asked to write the file back without waiting
+ *	for it, so the game never waits for the disk. What can still be lost
+ *	is up to MEM_SAVE_INTERVAL of writes if the host itself goes down,
+ *	and RAM banks replaced by loading a state, which are only copied
+ *	here if they differ from the file.
+ *
+ * @param force
+ *	Set to 1 to copy the pages right away, e.g. when the cartridge is
+ *		pulled.
+ */
+void mem_flush_save( Gameboy_t *gb, int force ) {
+	unsigned char *Data = gb->Save.Data;
+	unsigned int i, now = host_time();
+	int changed;
+
+	if(!Data || (!force && now - gb->Save.Last < MEM_SAVE_INTERVAL))
+		return;
+
+	gb->Save.Last	= now;
+	changed			= gb->Save.Dirty;
+	gb->Save.Dirty	= 0;
+
+	for(i = 0; i * MEM_PAGE_SIZE < gb->Save.RAMSize; i++) {
+		if(!memcmp(Data + i * MEM_PAGE_SIZE, gb->Map.RAMPages[ i ]->Data,
+			mem_save_chunk(gb->Save.RAMSize, i)))
+			continue;
+
+		memcpy(Data + i * MEM_PAGE_SIZE, gb->Map.RAMPages[ i ]->Data,
+			mem_save_chunk(gb->Save.RAMSize, i));
+		changed = 1;
+	}
+
+	/* the clock changes every second. It is copied, but only written
+		back along with the RAM banks or when the file is closed */
+	if(gb->RTC.Present) {
+		rtc_save(gb, Data + gb->Save.RAMSize);
+		changed |= force;
+	}
+
+	if(changed)
+		host_flush_file(Data, gb->Save.Size);
+}
+
+/*
+ * mem_save_chunk - Returns how much of a page is kept in the save file.
+ *
+ * @param Size
+ *	Size of the save file, in bytes.
+ * @param page
+ *	Index of the page.
+ */
+unsigned int mem_save_chunk( unsigned int Size, unsigned int page ) {
+	Size -= page * MEM_PAGE_SIZE;
+
+	return (Size < MEM_PAGE_SIZE) ? Size : MEM_PAGE_SIZE;
+}
+
+/*
+ * mem_close_save - Writes back and closes the save file.
+ *
+ */
+void mem_close_save( Gameboy_t *gb ) {
+	if(!gb->Save.Data)
+		return;
+
+	mem_flush_save(gb, 1);
+	host_unmap_file(gb->Save.Data, gb->Save.Size);
+
+	gb->Save.Data	= NULL;
+	gb->Save.Size	= 0;
+}
+
+/*
+ * mem_checksum - Computes a checksum of a block of memory.
+ *
+ * This is the 32-bit FNV-1a hash. It is used to make sure movies and
+ *	such are used with the ROM image they were made for, so unlike the
+ *	checksum in the cartridge header it covers every byte.
+ *
+ */
+unsigned int mem_checksum( unsigned char *data, unsigned int size ) {
+	unsigned int hash = 2166136261U;
+	unsigned int i;
+
+	for(i = 0; i < size; i++) {
+		hash ^= data[ i ];
+		hash *= 16777619U;
+	}
+
+	return hash;
 }
 
 /*
@@ -228,14 +1243,10 @@ int mem_normalize_addr( unsigned short *addr ) {
 		*addr = *addr - 0xFEA0;
 		return MEMORY_INV0;
 	}
-	else if( t < 0xFF4C ) {
+	else if( t < 0xFF80 ) {
 		*addr = *addr - 0xFF00;
 		return MEMORY_IOREG;
 	}
-	else if( t < 0xFF80 ) {
-		*addr = *addr - 0xFF4C;
-		return MEMORY_INV1;
-	}
 	else if( t < 0xFFFF ) {
 		*addr = *addr - 0xFF80;
 		return MEMORY_RAM1;
@@ -250,8 +1261,11 @@ int mem_normalize_addr( unsigned short *addr ) {
  *
  * The address of this function is passed to the Z80 CPU simulator
  *	which then invokes it whenever it needs to fetch a byte from
- *	memory.
+ *	memory. Pages of plain memory are read through the read page table,
+ *	see mem_map_banks, everything else goes to mem_read_slow.
  *
+ * @param ctx
+ *	The Gameboy_t instance the CPU belongs to.
  * @param addr
  *	Memory address to read.
  *
@@ -259,55 +1273,50 @@ int mem_normalize_addr( unsigned short *addr ) {
  *	data in Gameboy memory at 'addr'.
  *
  */
-unsigned char mem_read( unsigned short addr ) {
-	/* normalize addr and retrieve memory map identifier */
-	switch(mem_normalize_addr(&addr)) {
+unsigned char mem_read( void *ctx, unsigned short addr ) {
+	unsigned char *Page = ((Gameboy_t*) ctx)->ReadPage[ addr >> 8 ];
+
+	if(Page)
+		return Page[ addr & 0xFF ];
 
-		case MEMORY_ROM0:
-			return Gameboy.Memory.ROM0[ addr ];
+	return mem_read_slow((Gameboy_t*) ctx, addr);
+}
 
-		case MEMORY_SROM:
-			return Gameboy.Memory.SROM[ addr ];
+/*
+ * mem_read_slow - Reads from a page that is not in the read page table.
+ *
+ * These are the I/O registers and the rest of 0xFE00 - 0xFFFF, MBC2 RAM,
+ *	and cartridge RAM if there is none or it is disabled.
+ *
+ */
+unsigned char mem_read_slow( Gameboy_t *gb, unsigned short addr ) {
+	/* the I/O registers, high RAM and IE are read most often, like
+		mem_write_io they go straight to their handler */
+	if(addr >= 0xFF00) {
+		if(addr < 0xFF80)
+			return gb->IORead[ addr - 0xFF00 ](gb, addr - 0xFF00);
+		else if(addr < 0xFFFF)
+			return gb->Memory.RAM1[ addr - 0xFF80 ];
+		else
+			return gb->IORead[MEM_IO_IE](gb, MEM_IO_IE);
+	}
 
-		case MEMORY_VRAM:
-			return Gameboy.Memory.VRAM[ addr ];
+	/* normalize addr and retrieve memory map identifier */
+	switch(mem_normalize_addr(&addr)) {
 
 		case MEMORY_SRAM:
-			if(Gameboy.Memory.SRAM)
-				return Gameboy.Memory.SRAM[ addr ];
-			return 0;
-
-		case MEMORY_RAM0:
-			return Gameboy.Memory.RAM0[ addr ];
+			/* the upper 4 bits of MBC2 RAM are not connected and read as 1,
+				like all of it while it is disabled */
+			if(gb->Map.MBC == MBC_TYPE_2)
+				return gb->Map.SRAM[0] ?
+					0xF0 | gb->Map.SRAM[0]->Data[ addr & 0x1FF ] : 0xFF;
 
-		/* echo of 8 KB fixed RAM */
-		case MEMORY_ECHO:
-			return Gameboy.Memory.RAM0[ addr ];
+			return rtc_read(gb);
 
 		case MEMORY_OAM:
-			return Gameboy.Memory.OAM[ addr ];
-
-		case MEMORY_IOREG:
-			switch(addr) {
-				case IO_REG_P1:
-					return Gameboy.Memory.IORegs[ addr ] | 0x0F;
-
-				case IO_REG_DIV:
-					printf("Reading divider reg\n");
-
-				default:
-					return Gameboy.Memory.IORegs[ addr ];
-			}
-			return Gameboy.Memory.IORegs[ addr ];
-
-		case MEMORY_RAM1:
-			return Gameboy.Memory.RAM1[ addr ];
-
-		case MEMORY_IE:
-			return Gameboy.Memory.IE;
+			return gb->Memory.OAM[ addr ];
 
 		case MEMORY_INV0:
-		case MEMORY_INV1:
 			printf("mem_read: read from invalid memory address (0x%x)\n",
 				addr);
 			return 0;
@@ -324,8 +1333,11 @@ unsigned char mem_read( unsigned short addr ) {
  *
  * The address of this function is passed to the Z80 CPU simulator
  *	which then invokes it whenever it needs to write a byte to
- *	memory.
+ *	memory. Every page has a handler, see mem_map_write, so a write is
+ *	a single indirect call with no test for the kind of page.
  *
+ * @param ctx
+ *	The Gameboy_t instance the CPU belongs to.
  * @param addr
  *	Memory address to write.
  *
@@ -333,83 +1345,333 @@ unsigned char mem_read( unsigned short addr ) {
  *	Value that will be written into memory at address 'addr'.
  *
  */
-void mem_write( unsigned short addr, unsigned char value ) {
-	unsigned short temp = addr;
-	/* normalize addr and retrieve memory map identifier */
-	switch(mem_normalize_addr(&addr)) {
-		/* writes to ROM are caught by the memory bank controller */
-		case MEMORY_ROM0:
-		case MEMORY_SROM:
-			mem_rom_write(temp, value);
-			break;
+void mem_write( void *ctx, unsigned short addr, unsigned char value ) {
+	Gameboy_t *gb = (Gameboy_t*) ctx;
 
-		case MEMORY_VRAM:
-			Gameboy.Memory.VRAM[ addr ] = value;
-			break;
+	gb->WriteHandler[ addr >> 8 ](gb, addr, value);
+}
 
-		case MEMORY_SRAM:
-			if(Gameboy.Memory.SRAM)
-				Gameboy.Memory.SRAM[ addr ] = value;
-			break;
+/*
+ * mem_map_write - Sets up the write handler of a page.
+ *
+ * Pages of plain memory are stored to by mem_write_ram, through the same
+ *	pointer the read page table holds. Trapped pages are written by
+ *	mem_write_trap, which hands the write on to the usual handler.
+ *
+ * @param page
+ *	Index of the page, i.e. the upper 8 bits of its address.
+ */
+void mem_map_write( Gameboy_t *gb, unsigned int page ) {
+	if(gb->Traps[ page >> 5 ] & (1U << (page & 31)))
+		gb->WriteHandler[ page ] = mem_write_trap;
+	else
+		gb->WriteHandler[ page ] = mem_write_handler(gb, page);
+}
 
-		case MEMORY_RAM0:
-			Gameboy.Memory.RAM0[ addr ] = value;
-			break;
+/*
+ * mem_write_handler - Returns the function that handles writes to a page.
+ *
+ * @param page
+ *	Index of the page, i.e. the upper 8 bits of its address.
+ */
+MemWrite_t mem_write_handler( Gameboy_t *gb, unsigned int page ) {
+	/* writes to ROM are caught by the memory bank controller */
+	if(page < 0x80) {
+		switch(gb->Map.MBC) {
+			case MBC_TYPE_1:
+				return mem_mbc1_write;
+			case MBC_TYPE_2:
+				return mem_mbc2_write;
+			case MBC_TYPE_3:
+				return mem_mbc3_write;
+			case MBC_TYPE_5:
+				return mem_mbc5_write;
+			default:
+				return mem_rom_write;
+		}
+	}
 
-		/* writes into this memory region echo into RAM0 */
-		case MEMORY_ECHO:
-			Gameboy.Memory.RAM0[ addr ] = value;
-			break;
+	/* cartridge RAM may be shared with a forked machine */
+	if(page >= 0xA0 && page < 0xC0)
+		return (gb->Map.MBC == MBC_TYPE_2) ? mem_mbc2_write_sram :
+			mem_write_sram;
 
-		case MEMORY_OAM:
-			Gameboy.Memory.OAM[ addr ] = value;
-			break;
+	if(page == 0xFE)
+		return mem_write_oam;
 
-		/* some I/O registers need special treatment */
-		case MEMORY_IOREG:
-			switch(addr) {
-				case IO_REG_DMA:
-					mem_do_dma(value);
-					break;
+	if(page == 0xFF)
+		return mem_write_io;
 
-				case IO_REG_TMA:
-				case IO_REG_TAC:
-					printf("Writing timer reg\n");
-					break;
-			}
+	return mem_write_ram;
+}
 
-			Gameboy.Memory.IORegs[ addr ] = value;
-			break;
+/*
+ * mem_write_ram - Writes to a page of plain memory.
+ *
+ * This is the handler of every page of internal RAM and VRAM, the store
+ *	goes through the read page table.
+ *
+ */
+void mem_write_ram( Gameboy_t *gb, unsigned short addr, unsigned char value ) {
+	gb->ReadPage[ addr >> 8 ][ addr & 0xFF ] = value;
+	MEM_DIRTY(gb, addr);
+}
 
-		case MEMORY_RAM1:
-			Gameboy.Memory.RAM1[ addr ] = value;
-			break;
+/*
+ * mem_write_sram - Writes to 0xA000 - 0xBFFF.
+ *
+ * Cartridge RAM is never written directly. The cartridge may have no
+ *	RAM, or the page may be shared with a forked machine and has to be
+ *	copied first.
+ *
+ */
+void mem_write_sram( Gameboy_t *gb, unsigned short addr, unsigned char value ) {
+	unsigned int page = (addr - 0xA000) >> MEM_PAGE_SHIFT;
+	MemPage_t *Page;
 
-		case MEMORY_IE:
-			Gameboy.Memory.IE = value;
-			break;
+	/* no RAM bank is switched in, but a clock register may be */
+	if(!(Page = gb->Map.SRAM[ page ])) {
+		rtc_write(gb, value);
+		return;
+	}
 
-		case MEMORY_INV0:
-		case MEMORY_INV1:
+	/* the page is shared with a forked machine, copy on write */
+	if(Page->Refs > 1 && !(Page = mem_unshare_sram(gb, page)))
+		return;
+
+	Page->Data[ addr & MEM_PAGE_MASK ] = value;
+	Page->Hashed = 0;
+
+	/* the save file gets every write as well, so it is up to date even
+		if the emulator crashes, see mem_flush_save */
+	if(gb->Save.Data) {
+		gb->Save.Data[ (gb->Map.RAMBankSelect * MEM_BANK_PAGES + page) *
+			MEM_PAGE_SIZE + (addr & MEM_PAGE_MASK) ] = value;
+		gb->Save.Dirty = 1;
+	}
+}
+
+/*
+ * mem_mbc2_write_sram - Writes to 0xA000 - 0xBFFF of MBC2 cartridges.
+ *
+ * MBC2 RAM is 512 half-bytes, mirrored all over the area. Only the lower
+ *	4 bits of value are stored, the upper 4 bits read back as 1, see
+ *	mem_read_slow.
+ *
+ */
+void mem_mbc2_write_sram( Gameboy_t *gb, unsigned short addr,
+	unsigned char value ) {
+	MemPage_t *Page;
+
+	if(!(Page = gb->Map.SRAM[0]))
+		return;
+
+	/* the page is shared with a forked machine, copy on write */
+	if(Page->Refs > 1) {
+		if(!(Page = mem_page_unshare(&gb->Map.RAMPages[0])))
+			return;
+
+		mem_map_sram(gb);
+	}
+
+	Page->Data[ addr & 0x1FF ] = value & 0x0F;
+	Page->Hashed = 0;
+
+	if(gb->Save.Data) {
+		gb->Save.Data[ addr & 0x1FF ] = value & 0x0F;
+		gb->Save.Dirty = 1;
+	}
+}
+
+/*
+ * mem_write_oam - Writes to 0xFE00 - 0xFEFF.
+ *
+ */
+void mem_write_oam( Gameboy_t *gb, unsigned short addr, unsigned char value ) {
+	if(addr < 0xFEA0) {
+		gb->Memory.OAM[ addr - 0xFE00 ] = value;
+		MEM_DIRTY(gb, addr);
+	}
 #ifdef DEBUG
-			printf("mem_write: write into invalid memory address at 0x%x (v=0x%x)\n",
-				temp, value);
+	else
+		printf("mem_write: write into invalid memory address at 0x%x (v=0x%x)\n",
+			addr, value);
 #endif
-			break;
+}
 
-		default:
-			printf("mem_write: write into unknown memory region (0x%x)\n",
-				temp);
-			break;
+/*
+ * mem_write_io - Writes to 0xFF00 - 0xFFFF.
+ *
+ * The I/O registers and IE are written by their handlers, see
+ *	mem_init_io.
+ *
+ */
+void mem_write_io( Gameboy_t *gb, unsigned short addr, unsigned char value ) {
+	if(addr < 0xFF80)
+		gb->IOWrite[ addr - 0xFF00 ](gb, addr - 0xFF00, value);
+	else if(addr < 0xFFFF)
+		gb->Memory.RAM1[ addr - 0xFF80 ] = value;
+	else
+		gb->IOWrite[MEM_IO_IE](gb, MEM_IO_IE, value);
+}
+
+/*
+ * mem_init_io - Sets up the handlers of the I/O registers.
+ *
+ * Registers are plain storage unless the hardware behind them installs
+ *	handlers of its own with mem_io_register. Addresses without a
+ *	register read as 0 and ignore writes.
+ *
+ */
+void mem_init_io( Gameboy_t *gb ) {
+	unsigned int i;
+
+	for(i = 0; i < MEM_IO_REGS; i++) {
+		if(i < sizeof(gb->Memory.IORegs)) {
+			gb->IORead[ i ]		= mem_io_read_reg;
+			gb->IOWrite[ i ]	= mem_io_write_reg;
+		}
+		else {
+			gb->IORead[ i ]		= mem_io_read_none;
+			gb->IOWrite[ i ]	= mem_io_write_none;
+		}
+	}
+
+	gb->IORead[MEM_IO_IE]	= mem_io_read_ie;
+	gb->IOWrite[MEM_IO_IE]	= mem_io_write_ie;
+
+	mem_io_register(gb, IO_REG_DMA, NULL, mem_io_write_dma);
+
+	joypad_register_io(gb);
+	serial_register_io(gb);
+	timer_register_io(gb);
+	sound_register_io(gb);
+	video_register_io(gb);
+}
+
+/*
+ * mem_io_register - Installs the handlers of an I/O register.
+ *
+ * @param reg
+ *	Offset of the register from 0xFF00, or MEM_IO_IE.
+ * @param Read
+ *	Function that computes the value of the register, or NULL to keep
+ *		the current one.
+ * @param Write
+ *	Function that handles writes to the register, or NULL to keep the
+ *		current one. It has to store the value itself.
+ */
+void mem_io_register( Gameboy_t *gb, unsigned int reg, MemIORead_t Read,
+	MemIOWrite_t Write ) {
+	if(Read)
+		gb->IORead[ reg ] = Read;
+
+	if(Write)
+		gb->IOWrite[ reg ] = Write;
+}
+
+/*
+ * mem_io_read_reg - Reads a register that is plain storage.
+ *
+ */
+unsigned char mem_io_read_reg( Gameboy_t *gb, unsigned int reg ) {
+	return gb->Memory.IORegs[ reg ];
+}
+
+/*
+ * mem_io_write_reg - Writes a register that is plain storage.
+ *
+ */
+void mem_io_write_reg( Gameboy_t *gb, unsigned int reg, unsigned char value ) {
+	gb->Memory.IORegs[ reg ] = value;
+}
+
+/*
+ * mem_io_read_none - Reads an address without a register.
+ *
+ */
+unsigned char mem_io_read_none( Gameboy_t *gb, unsigned int reg ) {
+	return 0;
+}
+
+/*
+ * mem_io_write_none - Writes an address without a register.
+ *
+ */
+void mem_io_write_none( Gameboy_t *gb, unsigned int reg, unsigned char value ) {
+}
+
+/*
+ * mem_io_read_ie - Reads the IE register.
+ *
+ */
+unsigned char mem_io_read_ie( Gameboy_t *gb, unsigned int reg ) {
+	return gb->Memory.IE;
+}
+
+/*
+ * mem_io_write_ie - Writes the IE register.
+ *
+ */
+void mem_io_write_ie( Gameboy_t *gb, unsigned int reg, unsigned char value ) {
+	gb->Memory.IE = value;
+}
+
+/*
+ * mem_io_write_dma - Writes the DMA register, starting a DMA transfer.
+ *
+ */
+void mem_io_write_dma( Gameboy_t *gb, unsigned int reg, unsigned char value ) {
+	mem_do_dma(gb, value);
+
+	gb->Memory.IORegs[ reg ] = value;
+}
+
+/*
+ * mem_write_trap - Writes to a trapped page.
+ *
+ * The machine's trap hook gets to see the write before it is carried out
+ *	as usual.
+ *
+ */
+void mem_write_trap( Gameboy_t *gb, unsigned short addr, unsigned char value ) {
+	if(gb->TrapHook)
+		gb->TrapHook(gb, addr, value);
+
+	mem_write_handler(gb, addr >> 8)(gb, addr, value);
+}
+
+/*
+ * mem_trap_writes - Traps or untraps writes to a range of pages.
+ *
+ * @param first
+ *	Index of the first page, i.e. the upper 8 bits of its address.
+ * @param last
+ *	Index of the last page.
+ * @param on
+ *	1 to trap the pages, 0 to write them as usual again.
+ */
+void mem_trap_writes( Gameboy_t *gb, unsigned int first, unsigned int last,
+	int on ) {
+	unsigned int i;
+
+	for(i = first; i <= last && i < MEM_NUM_PAGES; i++) {
+		if(on)
+			gb->Traps[ i >> 5 ] |= 1U << (i & 31);
+		else
+			gb->Traps[ i >> 5 ] &= ~(1U << (i & 31));
+
+		mem_map_write(gb, i);
 	}
 }
 
 /*
- * mem_rom_write - Handles memory bank controllers.
+ * mem_rom_write - Handles writes to ROM without a memory bank controller.
  *
  * A Gameboy cartridge can contain a memory bank controller that intercepts
  *	attempts to write to read-only memory to blend in switchable ROM/RAM
- *	banks into the Gameboy's address space.
+ *	banks into the Gameboy's address space. Without one, writes to ROM
+ *	are ignored.
  *
  * @param addr
  *	Memory address to write.
@@ -417,115 +1679,166 @@ void mem_write( unsigned short addr, unsigned char value ) {
  * @param value
  *	Value that will be written into memory at address 'addr'.
  */
-void mem_rom_write( unsigned short addr, unsigned char value ) {
-	if(Gameboy.Memory.MBC == MBC_TYPE_NONE)
-		return;
+void mem_rom_write( Gameboy_t *gb, unsigned short addr, unsigned char value ) {
+}
 
+/*
+ * mem_mbc1_write - Handles writes to ROM for MBC1 cartridges.
+ *
+ */
+void mem_mbc1_write( Gameboy_t *gb, unsigned short addr, unsigned char value ) {
 	/* writing into ROM at 0x6000 - 0x7FFF selects the MBC mode */
-	if(addr >= 0x6000 && addr < 0x8000) {
-		Gameboy.Memory.MBCMode = value & 0x1;
+	if(addr >= 0x6000) {
+		gb->Map.MBCMode = value & 0x1;
 		return;
 	}
 
-	/* FIXME: add support for MBC2 and others */
-	if(Gameboy.Memory.MBC != MBC_TYPE_1 && Gameboy.Memory.MBC != MBC_TYPE_3) {
-		printf("mem_rom_write: unsupported memory bank controller.\n");
-		while(1);
-	}
-
 	/* writing into 0x2000 - 0x3FFF selects a ROM bank */
 	if(addr >= 0x2000 && addr < 0x4000) {
-		switch(Gameboy.Memory.MBC) {
-			case MBC_TYPE_1:
-				/* only the lower 5 bits matter for MBC1 */
-				value = value & 31;
+		/* only the lower 5 bits matter for MBC1 */
+		value = value & 31;
 
-				/* clear the lower 5 bits */
-				Gameboy.Memory.ROMBankSelect &= ~31;
+		/* clear the lower 5 bits */
+		gb->Map.ROMBankSelect &= ~31;
 
-				/* the remaining 2 bits needed to form the 7 bit index for
-					selecting one of the possible 128 ROM banks is provided
-					by a write into ROM at 0x4000 - 0x5FFF */
-				Gameboy.Memory.ROMBankSelect |= value;
+		/* the remaining 2 bits needed to form the 7 bit index for
+			selecting one of the possible 128 ROM banks is provided
+			by a write into ROM at 0x4000 - 0x5FFF */
+		gb->Map.ROMBankSelect |= value;
 
-				/* trying to load in ROM bank 0 will load ROM bank 1 */
-				if(Gameboy.Memory.ROMBankSelect == 0)
-					value = 1;
-				else
-					value = Gameboy.Memory.ROMBankSelect;
+		/* switch it in, trying to load in ROM bank 0 will load
+			ROM bank 1 */
+		mem_map_rom(gb);
+		return;
+	}
 
-				/* switch it in */
-				Gameboy.Memory.SROM = Gameboy.Memory.ROMBanks[ value ];
-				return;
+	/* writing into 0x4000 - 0x5FFF selects the higher 2 bits needed to
+		form the ROM bank index. If controller mode is MBC_MODE_4_32 this
+		will select one of the 4 possible RAM banks instead. */
+	if(addr >= 0x4000) {
+		/* only the lower 2 bits matter */
+		value = value & 0x03;
+
+		if(gb->Map.MBCMode == MBC_MODE_16_8) {
+			/* clear the upper 3 bits */
+			gb->Map.ROMBankSelect &= 31;
+			gb->Map.ROMBankSelect |= (value << 5);
+
+			/* switch it in, trying to load in ROM bank 0 will load
+				ROM bank 1 */
+			mem_map_rom(gb);
+		}
+		else {
+			/* select one of the 4 possible RAM banks */
+			gb->Map.RAMBankSelect = value;
 
-			case MBC_TYPE_3:
-				/* MBC3 reads the 7 bit index in one go */
-				value = value & 127;
+			/* switch it in */
+			mem_map_sram(gb);
+		}
+	}
+}
 
-				if(value == 0)
-					value = 1;
+/*
+ * mem_mbc2_write - Handles writes to ROM for MBC2 cartridges.
+ *
+ * MBC2 tells its two registers apart by bit 8 of the address. In
+ *	0x0000 - 0x3FFF, writes with the bit clear enable or disable RAM,
+ *	writes with the bit set select one of up to 16 ROM banks.
+ *
+ */
+void mem_mbc2_write( Gameboy_t *gb, unsigned short addr, unsigned char value ) {
+	/* 0x4000 - 0x7FFF is not used */
+	if(addr >= 0x4000)
+		return;
 
-				Gameboy.Memory.ROMBankSelect = value;
-				Gameboy.Memory.SROM = Gameboy.Memory.ROMBanks
-					[ Gameboy.Memory.ROMBankSelect ];
-				return;
+	if(addr & 0x100) {
+		gb->Map.ROMBankSelect = value & 0x0F;
+		mem_map_rom(gb);
+		return;
+	}
 
-			default:
-				return;
-		}
+	if(gb->Map.RAMEnable != ((value & 0x0F) == 0x0A)) {
+		gb->Map.RAMEnable = ((value & 0x0F) == 0x0A);
+		mem_map_sram(gb);
 	}
+}
 
-	/* writing into 0x4000 - 0x5FFF selects the higher 2 bits needed to
-		form the ROM bank index for MBC 1. If controller mode is
-		MBC_MODE_4_32 this will select one of the 4 possible RAM banks
-		instead. */
-	if(addr >= 0x4000 && addr < 0x6000) {
-		switch(Gameboy.Memory.MBC) {
-			case MBC_TYPE_1:
-				if(Gameboy.Memory.MBCMode == MBC_MODE_16_8) {
-					/* only the lower 2 bits matter */
-					value = value & 0x03;
-
-					/* clear the upper 3 bits */
-					Gameboy.Memory.ROMBankSelect &= 31;
-					Gameboy.Memory.ROMBankSelect |= (value << 5);
-
-					/* trying to load in ROM bank 0 will load ROM bank 1 */
-					if(Gameboy.Memory.ROMBankSelect == 0)
-						value = 1;
-					else
-						value = Gameboy.Memory.ROMBankSelect;
-
-					/* switch it in */
-					Gameboy.Memory.SROM = Gameboy.Memory.ROMBanks[ value ];
-				}
-				else {
-					/* select one of the 4 possible RAM banks */
-					value = value & 0x03;
-
-					Gameboy.Memory.RAMBankSelect = value;
-
-					/* switch it in */
-					Gameboy.Memory.SRAM = Gameboy.Memory.RAMBanks
-						[ Gameboy.Memory.RAMBankSelect ];
-				}
-				return;
+/*
+ * mem_mbc3_write - Handles writes to ROM for MBC3 cartridges.
+ *
+ */
+void mem_mbc3_write( Gameboy_t *gb, unsigned short addr, unsigned char value ) {
+	/* writing 0x00 and then 0x01 into 0x6000 - 0x7FFF latches the clock */
+	if(addr >= 0x6000) {
+		rtc_latch(gb, value);
+		return;
+	}
 
-			case MBC_TYPE_3:
-				/* select one of the 4 possible RAM banks */
-				value = value & 0x03;
+	/* writing into 0x2000 - 0x3FFF selects a ROM bank */
+	if(addr >= 0x2000 && addr < 0x4000) {
+		/* MBC3 reads the 7 bit index in one go */
+		value = value & 127;
 
-				Gameboy.Memory.RAMBankSelect = value;
+		if(value == 0)
+			value = 1;
 
-				Gameboy.Memory.SRAM = Gameboy.Memory.RAMBanks
-					[ Gameboy.Memory.RAMBankSelect ];
-				break;
+		gb->Map.ROMBankSelect = value;
+		mem_map_rom(gb);
+		return;
+	}
 
-			default:
-				return;
+	/* writing into 0x4000 - 0x5FFF selects one of the 4 possible RAM
+		banks, or one of the clock registers with 0x08 - 0x0C. Those
+		leave 0xA000 - 0xBFFF unmapped and are accessed through
+		rtc_read and rtc_write */
+	if(addr >= 0x4000) {
+		gb->Map.RAMBankSelect = value & 0x0F;
+
+		mem_map_sram(gb);
+	}
+}
+
+/*
+ * mem_mbc5_write - Handles writes to ROM for MBC5 cartridges.
+ *
+ * MBC5 selects one of up to 512 ROM banks with 9 bits, written in two
+ *	parts, and one of up to 16 RAM banks. Unlike MBC1, bank 0 can be
+ *	switched in at 0x4000 as well. Some games switch banks all the time,
+ *	each switch only remaps the affected entries of the page tables.
+ *
+ */
+void mem_mbc5_write( Gameboy_t *gb, unsigned short addr, unsigned char value ) {
+	/* writing 0x0A into 0x0000 - 0x1FFF enables RAM, anything else
+		disables it */
+	if(addr < 0x2000) {
+		if(gb->Map.RAMEnable != ((value & 0x0F) == 0x0A)) {
+			gb->Map.RAMEnable = ((value & 0x0F) == 0x0A);
+			mem_map_sram(gb);
 		}
+		return;
+	}
+
+	/* writing into 0x2000 - 0x2FFF selects the lower 8 bits of the ROM
+		bank, 0x3000 - 0x3FFF the 9th bit */
+	if(addr < 0x3000) {
+		gb->Map.ROMBankSelect = (gb->Map.ROMBankSelect & 0x100) | value;
+		mem_map_rom(gb);
+		return;
 	}
 
+	if(addr < 0x4000) {
+		gb->Map.ROMBankSelect = (gb->Map.ROMBankSelect & 0xFF) |
+			((value & 0x01) << 8);
+		mem_map_rom(gb);
+		return;
+	}
+
+	/* writing into 0x4000 - 0x5FFF selects one of the 16 possible RAM
+		banks. 0x6000 - 0x7FFF is not used */
+	if(addr < 0x6000) {
+		gb->Map.RAMBankSelect = value & 0x0F;
+		mem_map_sram(gb);
+	}
 }
 
 /*
@@ -537,34 +1850,13 @@ void mem_rom_write( unsigned short addr, unsigned char value ) {
  *	by 0x100.
  *
  */
-void mem_do_dma( unsigned char from ) {
-	/* figure out the source address */
-	unsigned short addr = (from * 0x100);
+void mem_do_dma( Gameboy_t *gb, unsigned char from ) {
+	/* all of OAM is overwritten */
+	MEM_DIRTY(gb, 0xFE00);
 
 	/* according to Gameboy docs the source address must be between 0x0000
-		and 0xF100 */
-	switch(mem_normalize_addr(&addr)) {
-		case MEMORY_ROM0:
-			memcpy(Gameboy.Memory.OAM, &Gameboy.Memory.ROM0[ addr ], 160);
-			break;
-
-		case MEMORY_SROM:
-			memcpy(Gameboy.Memory.OAM, &Gameboy.Memory.SROM[ addr ], 160);
-			break;
-
-		case MEMORY_VRAM:
-			memcpy(Gameboy.Memory.OAM, &Gameboy.Memory.VRAM[ addr ], 160);
-			break;
-
-		case MEMORY_SRAM:
-			if(Gameboy.Memory.SRAM)
-				memcpy(Gameboy.Memory.OAM, &Gameboy.Memory.SRAM[ addr ],
-					160);
-			break;
-
-		case MEMORY_RAM0:
-		case MEMORY_ECHO:
-			memcpy(Gameboy.Memory.OAM, &Gameboy.Memory.RAM0[ addr ], 160);
-			break;
-	}
+		and 0xF100. The 160 bytes never cross a page of the read page
+		table, anything not in there is ignored */
+	if(gb->ReadPage[ from ])
+		memcpy(gb->Memory.OAM, gb->ReadPage[ from ], 160);
 }
@@ -22,36 +22,147 @@ MA  02110-1301, USA.
 #ifndef _MEMORY_H_
 #define _MEMORY_H_
 
-/* Gameboy Memory */
+/* cartridge RAM is kept in pages of this size */
+#define MEM_PAGE_SHIFT	12
+#define MEM_PAGE_SIZE	(1 << MEM_PAGE_SHIFT)
+#define MEM_PAGE_MASK	(MEM_PAGE_SIZE - 1)
+
+/* number of pages in an 8 KB RAM bank */
+#define MEM_BANK_PAGES	(0x2000 / MEM_PAGE_SIZE)
+
+typedef struct MemArena_s MemArena_t;
+
+/* A page of cartridge RAM. A forked machine shares the pages of its
+	parent until one of them writes to a page, which then gets a copy
+	of its own. See mem_fork_cartridge */
 typedef struct {
-	unsigned char IE;				/* Interrupt Enable Register */ 
-	unsigned char RAM1	[0x0007F];	/* small amount of RAM located at 0xFF80 */
+	unsigned char Data[MEM_PAGE_SIZE];
+	volatile int Refs;				/* machines using the page */
 
-	unsigned char IORegs[0x0004C];	/* Memory-mapped I/O Registers */
+	u64 Hash;						/* hash of Data, see hash_state */
+	int Hashed;						/* Hash is valid */
 
-	unsigned char OAM	[0x000A0];	/* Object Attribute Memory */
-	unsigned char RAM0	[0x02000];	/* 8 Kb fixed RAM bank */
+	MemArena_t *Arena;				/* arena holding the page, or NULL */
 
-	unsigned char VRAM	[0x02000];	/* 8 Kb video RAM */
-	unsigned char *ROM0;			/* pointer to 16 Kb fixed ROM bank */
+} MemPage_t;
 
-	unsigned char *SROM;			/* pointer to switched-in ROM bank */
-	unsigned char *SRAM;			/* pointer to switched-in RAM bank */
+/* A machine's cartridge RAM is allocated in one piece: the array of page
+	pointers followed by the pages themselves, each on a cache line
+	boundary. Pages shared with forked machines may outlive the machine,
+	so the arena is freed with the last of its pages, see mem_arena_alloc */
+/* rounds a size up to a multiple of CACHE_LINE */
+#define MEM_ARENA_ROUND(size)	(((size) + CACHE_LINE - 1) & ~(CACHE_LINE - 1))
 
-	unsigned char **ROMBanks;		/* 16 KB switchable ROM banks */
-	unsigned char **RAMBanks;		/* 8 KB switchable RAM banks */
+struct MemArena_s {
+	volatile int Refs;				/* pages in use, plus one for the array */
+	void *Raw;						/* pointer returned by malloc */
+	MemPage_t **Pages;				/* the array of page pointers */
+};
 
-	unsigned int NumROMBanks;		/* Number of ROM banks cartridge uses */
-	unsigned int NumRAMBanks;		/* Number of RAM banks cartridge uses */
+/* ROM of a cartridge, shared by all machines running it. The banks are
+	stored back to back, bank n starts at n * 0x4000. Data is either a
+	copy of the cartridge file or the file mapped by host_map_file.
+	Copies are kept in a cache so that machines loading the same
+	cartridge share them, see mem_rom_copy */
+typedef struct MemROM_s {
+	unsigned char *Data;
+	unsigned int Size;				/* size of Data, in bytes */
+	unsigned int NumBanks;
+	int Mapped;						/* Data is mapped, not allocated */
+	volatile int Refs;				/* machines using the ROM */
+
+	u64 Hash;						/* hash of Data, see hash_bytes */
+	int Cached;						/* ROM is in the cache */
+	struct MemROM_s *Next;			/* next ROM in the cache */
+
+} MemROM_t;
+
+/* one bit for each 256 byte block of 0x8000 - 0xFFFF */
+#define MEM_DIRTY_WORDS	4
+
+/* The memory map, i.e. which banks are switched in. This is looked at for
+	every memory access and is kept with the other hot fields at the start
+	of Gameboy_t. The pointers to the switched-in banks are derived from
+	the bank selects, see mem_map_banks */
+typedef struct {
+	unsigned char *ROM0;			/* pointer to 16 Kb fixed ROM bank */
+	unsigned char *SROM;			/* pointer to switched-in ROM bank */
+	MemPage_t *SRAM[MEM_BANK_PAGES];	/* pages of switched-in RAM bank */
 
 	unsigned int ROMBankSelect;		/* index of currently selected ROM bank */
 	unsigned int RAMBankSelect;		/* index of currently selected RAM bank */
 
+	unsigned int NumROMBanks;		/* Number of ROM banks cartridge uses */
+	unsigned int NumRAMBanks;		/* Number of RAM banks cartridge uses */
+
 	unsigned char MBC;				/* Memory bank controller type */
+	unsigned char RAMEnable;		/* RAM banks can be accessed */
 	unsigned int MBCMode;			/* Memory bank controller mode */
 
+	MemROM_t *ROM;					/* ROM banks */
+	MemPage_t **RAMPages;			/* pages of the 8 KB switchable RAM banks */
+	MemArena_t *Arena;				/* arena holding RAMPages */
+
+	/* 256 byte blocks of VRAM, RAM0 and OAM written since they were
+		last handed on, see MEM_DIRTY and mem_collect_dirty */
+	unsigned int Dirty[MEM_DIRTY_WORDS];
+
+} MemMap_t;
+
+/* Battery-backed RAM banks and clock of the cartridge, kept in a save
+	file mapped with host_map_save, see mem_open_save */
+typedef struct {
+	unsigned char *Data;			/* the mapped save file */
+	unsigned int Size;				/* size of Data, in bytes */
+	unsigned int RAMSize;			/* bytes of RAM banks, the clock follows */
+	unsigned int Last;				/* host_time of the last flush */
+	int Dirty;						/* written since the last flush */
+
+} MemSave_t;
+
+/* minimum time between two copies of the RAM banks to the save file, in
+	microseconds */
+#define MEM_SAVE_INTERVAL	1000000
+
+/* Gameboy Memory. Gameboy_t keeps this on a cache line boundary and the
+	two big banks come first, so they are cache line aligned as well */
+typedef struct {
+	unsigned char VRAM	[0x02000];	/* 8 Kb video RAM */
+	unsigned char RAM0	[0x02000];	/* 8 Kb fixed RAM bank */
+
+	unsigned char OAM	[0x000A0];	/* Object Attribute Memory */
+	unsigned char IORegs[0x0004C];	/* Memory-mapped I/O Registers */
+	unsigned char RAM1	[0x0007F];	/* small amount of RAM located at 0xFF80 */
+	unsigned char IE;				/* Interrupt Enable Register */ 
+
 } Memory_t;
 
+/* number of 256 byte pages in the address space, see mem_read */
+#define MEM_NUM_PAGES	256
+
+/* handles writes to a page, see mem_map_write */
+typedef void (*MemWrite_t)( Gameboy_t *gb, unsigned short addr,
+	unsigned char value );
+
+/* I/O registers 0xFF00 - 0xFF7F and IE are read and written through
+	handlers, indexed by the register's offset from 0xFF00. IE is kept in
+	the entry after the registers. See mem_init_io */
+#define MEM_IO_REGS		0x80
+#define MEM_IO_IE		MEM_IO_REGS
+#define MEM_IO_SIZE		(MEM_IO_REGS + 1)
+
+typedef unsigned char (*MemIORead_t)( Gameboy_t *gb, unsigned int reg );
+typedef void (*MemIOWrite_t)( Gameboy_t *gb, unsigned int reg,
+	unsigned char value );
+
+/* called before a write to a trapped page is carried out */
+typedef void (*MemTrap_t)( Gameboy_t *gb, unsigned short addr,
+	unsigned char value );
+
+/* marks the 256 byte block at 'addr' (0x8000 - 0xFFFF) as written */
+#define MEM_DIRTY(gb, addr)	((gb)->Map.Dirty[ ((addr) >> 13) & 3 ] |= \
+								1U << (((addr) >> 8) & 31))
+
 
 /* Memory bank controller types */
 enum {
@@ -98,8 +209,7 @@ enum {
 	MEMORY_ECHO,				/* 0xE000 - 0xFDFF */
 	MEMORY_OAM,					/* 0xFE00 - 0xFE9F */
 	MEMORY_INV0,				/* 0xFEA0 - 0xFEFF */
-	MEMORY_IOREG,				/* 0xFF00 - 0xFF4B */
-	MEMORY_INV1,				/* 0xFF4C - 0xFF7F */
+	MEMORY_IOREG,				/* 0xFF00 - 0xFF7F */
 	MEMORY_RAM1,				/* 0xFF80 - 0xFFFE */
 	MEMORY_IE					/* 0xFFFF - 0xFFFF */
 };
@@ -157,13 +267,74 @@ enum {
 
 /* function declarations */
 
-int mem_load_cartridge( unsigned char *rom, unsigned int rom_size );
-int mem_unload_cartridge( void );
+int mem_load_cartridge( Gameboy_t *gb, unsigned char *rom, unsigned int rom_size );
+int mem_open_cartridge( Gameboy_t *gb, const char *path );
+int mem_insert_cartridge( Gameboy_t *gb, MemROM_t *ROM );
+int mem_share_cartridge( Gameboy_t *gb, Gameboy_t *from );
+int mem_fork_cartridge( Gameboy_t *gb, Gameboy_t *from );
+int mem_reset_memory( Gameboy_t *gb, Gameboy_t *from, int full );
+void mem_copy_blocks( unsigned char *VRAM, unsigned char *RAM0,
+	unsigned char *OAM, Memory_t *from, unsigned int *Dirty );
+void mem_collect_dirty( Gameboy_t *gb );
+void mem_touch_all( Gameboy_t *gb );
+int mem_unload_cartridge( Gameboy_t *gb );
+MemArena_t *mem_arena_alloc( unsigned int num, unsigned int pages );
+unsigned char *mem_arena_carve( unsigned char **Next, unsigned int size );
+void mem_arena_release( MemArena_t *Arena );
+void mem_free_pages( Gameboy_t *gb );
+MemPage_t *mem_page_alloc( void );
+void mem_page_release( MemPage_t *Page );
+MemPage_t *mem_page_unshare( MemPage_t **Page );
+MemPage_t *mem_unshare_sram( Gameboy_t *gb, unsigned int page );
+MemROM_t *mem_rom_copy( unsigned char *rom, unsigned int rom_size );
+MemROM_t *mem_rom_find( unsigned char *rom, unsigned int rom_size, u64 Hash );
+MemROM_t *mem_rom_lookup( unsigned char *rom, unsigned int rom_size,
+	u64 Hash );
+void mem_cache_lock( void );
+void mem_cache_unlock( void );
+MemROM_t *mem_rom_open( const char *path );
+void mem_rom_release( MemROM_t *ROM );
+void mem_map_banks( Gameboy_t *gb );
+void mem_map_rom( Gameboy_t *gb );
+void mem_map_sram( Gameboy_t *gb );
 int mem_get_mbc_type( CartInfo_t *CartInfo, unsigned char *MBC );
+int mem_has_battery( CartInfo_t *CartInfo );
+int mem_has_rtc( CartInfo_t *CartInfo );
+int mem_open_save( Gameboy_t *gb, const char *path );
+void mem_flush_save( Gameboy_t *gb, int force );
+unsigned int mem_save_chunk( unsigned int Size, unsigned int page );
+void mem_close_save( Gameboy_t *gb );
+unsigned int mem_checksum( unsigned char *data, unsigned int size );
 int mem_normalize_addr( unsigned short *addr );
-unsigned char mem_read( unsigned short addr );
-void mem_write( unsigned short addr, unsigned char value );
-void mem_rom_write( unsigned short addr, unsigned char value );
-void mem_do_dma( unsigned char from );
+unsigned char mem_read( void *ctx, unsigned short addr );
+unsigned char mem_read_slow( Gameboy_t *gb, unsigned short addr );
+void mem_write( void *ctx, unsigned short addr, unsigned char value );
+void mem_map_write( Gameboy_t *gb, unsigned int page );
+MemWrite_t mem_write_handler( Gameboy_t *gb, unsigned int page );
+void mem_init_io( Gameboy_t *gb );
+void mem_io_register( Gameboy_t *gb, unsigned int reg, MemIORead_t Read,
+	MemIOWrite_t Write );
+unsigned char mem_io_read_reg( Gameboy_t *gb, unsigned int reg );
+void mem_io_write_reg( Gameboy_t *gb, unsigned int reg, unsigned char value );
+unsigned char mem_io_read_none( Gameboy_t *gb, unsigned int reg );
+void mem_io_write_none( Gameboy_t *gb, unsigned int reg, unsigned char value );
+unsigned char mem_io_read_ie( Gameboy_t *gb, unsigned int reg );
+void mem_io_write_ie( Gameboy_t *gb, unsigned int reg, unsigned char value );
+void mem_io_write_dma( Gameboy_t *gb, unsigned int reg, unsigned char value );
+void mem_write_ram( Gameboy_t *gb, unsigned short addr, unsigned char value );
+void mem_write_sram( Gameboy_t *gb, unsigned short addr, unsigned char value );
+void mem_mbc2_write_sram( Gameboy_t *gb, unsigned short addr,
+	unsigned char value );
+void mem_write_oam( Gameboy_t *gb, unsigned short addr, unsigned char value );
+void mem_write_io( Gameboy_t *gb, unsigned short addr, unsigned char value );
+void mem_write_trap( Gameboy_t *gb, unsigned short addr, unsigned char value );
+void mem_trap_writes( Gameboy_t *gb, unsigned int first, unsigned int last,
+	int on );
+void mem_rom_write( Gameboy_t *gb, unsigned short addr, unsigned char value );
+void mem_mbc1_write( Gameboy_t *gb, unsigned short addr, unsigned char value );
+void mem_mbc2_write( Gameboy_t *gb, unsigned short addr, unsigned char value );
+void mem_mbc3_write( Gameboy_t *gb, unsigned short addr, unsigned char value );
+void mem_mbc5_write( Gameboy_t *gb, unsigned short addr, unsigned char value );
+void mem_do_dma( Gameboy_t *gb, unsigned char from );
 
 #endif /* _MEMORY_H_ */
@@ -0,0 +1,300 @@
+/*
+=================================================================
+Copyright (C) 2008 Torben Koenke
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+MA  02110-1301, USA.
+=================================================================
+*/
+
+
+#include "gameboy.h"
+
+/*
+ * movie_record - Starts recording a movie.
+ *
+ * Any states in the movie are discarded, the buffer is reused.
+ *
+ * @param Movie
+ *	A pointer to a Movie_t structure. The structure must be zeroed out
+ *		before it is used for the first time.
+ * @param checksum
+ *	Checksum of the ROM image the movie is recorded for.
+ */
+void movie_record( Movie_t *Movie, u32 checksum ) {
+	Movie->Mode		= MOVIE_RECORD;
+	Movie->Start	= MOVIE_START_POWER_ON;
+	Movie->Checksum	= checksum;
+	Movie->Frames	= 0;
+	Movie->Size		= 0;
+}
+
+/*
+ * movie_play - Starts playing back a movie from the first frame.
+ *
+ */
+void movie_play( Movie_t *Movie ) {
+	Movie->Mode		= MOVIE_PLAY;
+	Movie->Frame	= 0;
+	Movie->Pos		= 0;
+	Movie->Left		= 0;
+}
+
+/*
+ * movie_append - Records the joypad state of a frame.
+ *
+ * @return
+ *	GB_EMU_OK on success, GB_EMU_ERROR if memory could not be allocated.
+ */
+int movie_append( Movie_t *Movie, unsigned char buttons ) {
+	unsigned char *Data;
+	unsigned int size;
+
+	/* same state as the frame before, extend the run */
+	if(Movie->Size && Movie->Data[ Movie->Size - 1 ] == buttons &&
+		Movie->Data[ Movie->Size - 2 ] < 255) {
+		Movie->Data[ Movie->Size - 2 ]++;
+		Movie->Frames++;
+		return GB_EMU_OK;
+	}
+
+	if(Movie->Size + 2 > Movie->Capacity) {
+		size = Movie->Capacity ? Movie->Capacity * 2 : 256;
+
+		if(!(Data = realloc(Movie->Data, size)))
+			return GB_EMU_ERROR;
+
+		Movie->Data		= Data;
+		Movie->Capacity	= size;
+	}
+
+	Movie->Data[ Movie->Size++ ] = 1;
+	Movie->Data[ Movie->Size++ ] = buttons;
+	Movie->Frames++;
+
+	return GB_EMU_OK;
+}
+
+/*
+ * movie_next - Retrieves the joypad state of the next frame.
+ *
+ * @param buttons
+ *	A pointer to a variable that receives the joypad state. It is left
+ *		untouched once the movie is over.
+ *
+ * @return
+ *	GB_EMU_OK if a state was retrieved, GB_EMU_ERROR if the movie is over.
+ */
+int movie_next( Movie_t *Movie, unsigned char *buttons ) {
+	if(Movie->Frame >= Movie->Frames || Movie->Pos + 2 > Movie->Size)
+		return GB_EMU_ERROR;
+
+	if(!Movie->Left)
+		Movie->Left = Movie->Data[ Movie->Pos ];
+
+	*buttons = Movie->Data[ Movie->Pos + 1 ];
+
+	/* move on to the next run */
+	if(!--Movie->Left)
+		Movie->Pos += 2;
+
+	Movie->Frame++;
+
+	return GB_EMU_OK;
+}
+
+/*
+ * movie_free - Releases the states of a movie.
+ *
+ */
+void movie_free( Movie_t *Movie ) {
+	free(Movie->Data);
+
+	Movie->Data		= NULL;
+	Movie->Size		= 0;
+	Movie->Capacity	= 0;
+	Movie->Frames	= 0;
+}
+
+/*
+ * movie_save - Serializes a movie.
+ *
+ * @param data
+ *	A pointer to a variable that receives a pointer to the movie file
+ *		image. The caller releases it with free.
+ * @param size
+ *	A pointer to a variable that receives the size of the image, in bytes.
+ *
+ * @return
+ *	GB_EMU_OK on success, GB_EMU_ERROR if memory could not be allocated.
+ */
+int movie_save( Movie_t *Movie, unsigned char **data, unsigned int *size ) {
+	unsigned char *p;
+
+	*size = MOVIE_HEADER_SIZE + Movie->Size;
+
+	if(!(*data = p = malloc(*size)))
+		return GB_EMU_ERROR;
+
+	memcpy(p, MOVIE_MAGIC, 4);
+
+	p[4]	= MOVIE_VERSION & 0xFF;
+	p[5]	= MOVIE_VERSION >> 8;
+	p[6]	= Movie->Start;
+	p[7]	= 0;
+
+	p[8]	= (unsigned char) Movie->Checksum;
+	p[9]	= (unsigned char) (Movie->Checksum >> 8);
+	p[10]	= (unsigned char) (Movie->Checksum >> 16);
+	p[11]	= (unsigned char) (Movie->Checksum >> 24);
+
+	p[12]	= (unsigned char) Movie->Frames;
+	p[13]	= (unsigned char) (Movie->Frames >> 8);
+	p[14]	= (unsigned char) (Movie->Frames >> 16);
+	p[15]	= (unsigned char) (Movie->Frames >> 24);
+
+	if(Movie->Size)
+		memcpy(p + MOVIE_HEADER_SIZE, Movie->Data, Movie->Size);
+
+	return GB_EMU_OK;
+}
+
+/*
+ * movie_load - Deserializes a movie.
+ *
+ * @param Movie
+ *	A pointer to a Movie_t structure that receives the movie. Its
+ *		previous states are released. The movie is set up for playback.
+ * @param data
+ *	A pointer to a movie file image as created by movie_save.
+ * @param size
+ *	Size of the image, in bytes.
+ *
+ * @return
+ *	GB_EMU_OK on success, GB_EMU_ERROR if the image is not a valid movie
+ *		or memory could not be allocated.
+ */
+int movie_load( Movie_t *Movie, unsigned char *data, unsigned int size ) {
+	unsigned int i;
+	u32 frames = 0;
+
+	if(size < MOVIE_HEADER_SIZE || memcmp(data, MOVIE_MAGIC, 4))
+		return GB_EMU_ERROR;
+
+	if((data[4] | (data[5] << 8)) != MOVIE_VERSION)
+		return GB_EMU_ERROR;
+
+	if(data[6] != MOVIE_START_POWER_ON)
+		return GB_EMU_ERROR;
+
+	/* the runs must add up to the number of frames */
+	if((size - MOVIE_HEADER_SIZE) & 1)
+		return GB_EMU_ERROR;
+
+	for(i = MOVIE_HEADER_SIZE; i < size; i += 2) {
+		if(!data[ i ])
+			return GB_EMU_ERROR;
+		frames += data[ i ];
+	}
+
+	if(frames != (data[12] | (data[13] << 8) | (data[14] << 16) |
+		((u32) data[15] << 24)))
+		return GB_EMU_ERROR;
+
+	movie_free(Movie);
+
+	if(size > MOVIE_HEADER_SIZE) {
+		if(!(Movie->Data = malloc(size - MOVIE_HEADER_SIZE)))
+			return GB_EMU_ERROR;
+
+		memcpy(Movie->Data, data + MOVIE_HEADER_SIZE, size - MOVIE_HEADER_SIZE);
+	}
+
+	Movie->Size		= size - MOVIE_HEADER_SIZE;
+	Movie->Capacity	= Movie->Size;
+	Movie->Start	= data[6];
+	Movie->Checksum	= data[8] | (data[9] << 8) | (data[10] << 16) |
+		((u32) data[11] << 24);
+	Movie->Frames	= frames;
+
+	movie_play(Movie);
+
+	return GB_EMU_OK;
+}
+
+/*
+ * movie_decode - Expands a movie into one joypad state per frame.
+ *
+ * The result can be used as the input script of a batch job.
+ *
+ * @param Input
+ *	A pointer to a buffer of Movie->Frames bytes.
+ *
+ * @return
+ *	The number of states written into the buffer.
+ */
+int movie_decode( Movie_t *Movie, unsigned char *Input ) {
+	unsigned int i, n = 0;
+	unsigned char j;
+
+	for(i = 0; i + 1 < Movie->Size && n < Movie->Frames; i += 2) {
+		for(j = 0; j < Movie->Data[ i ] && n < Movie->Frames; j++)
+			Input[ n++ ] = Movie->Data[ i + 1 ];
+	}
+
+	return n;
+}
+
+/*
+ * movie_replay - Plays back a movie as fast as possible.
+ *
+ * The machine is powered up with the ROM and stepped through all frames
+ *	of the movie. The cartridge is left loaded so the caller can inspect
+ *	the machine afterwards and must unload it with mem_unload_cartridge,
+ *	whether the movie could be played back or not.
+ *
+ * @param gb
+ *	The machine to play the movie back on. It must not be the machine
+ *		run by the emulation thread.
+ *
+ * @return
+ *	GB_EMU_OK if the movie was played back to the end. GB_EMU_ERROR if
+ *		it doesn't belong to the ROM, the ROM could not be loaded or
+ *		the machine stopped before the last frame.
+ */
+int movie_replay( Gameboy_t *gb, Movie_t *Movie, unsigned char *rom,
+	unsigned int rom_size ) {
+	u32 i;
+
+	gb_emu_init_headless(gb);
+
+	if(mem_checksum(rom, rom_size) != Movie->Checksum)
+		return GB_EMU_ERROR;
+
+	if(GB_EMU_ERROR == mem_load_cartridge(gb, rom, rom_size))
+		return GB_EMU_ERROR;
+
+	movie_play(Movie);
+	gb->Movie = Movie;
+
+	for(i = 0; i < Movie->Frames; i++) {
+		if(GB_EMU_ERROR == gb_emu_run_frame(gb))
+			break;
+	}
+
+	gb->Movie = NULL;
+
+	return (i == Movie->Frames) ? GB_EMU_OK : GB_EMU_ERROR;
+}
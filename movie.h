@@ -0,0 +1,80 @@
+/*
+=================================================================
+Copyright (C) 2008 Torben Koenke
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+MA  02110-1301, USA.
+=================================================================
+*/
+
+
+#ifndef _MOVIE_H_
+#define _MOVIE_H_
+
+/* Movie file layout, all values little-endian:
+
+	offset	size	contents
+	0		4		MOVIE_MAGIC
+	4		2		MOVIE_VERSION
+	6		1		start state, one of MOVIE_START_*
+	7		1		reserved, 0
+	8		4		checksum of the ROM image, see mem_checksum
+	12		4		number of frames
+	16		...		joypad states
+
+	The joypad states are run-length encoded as pairs of bytes, the number
+	of frames (1 - 255) followed by the state applied at the end of each
+	of these frames */
+#define MOVIE_MAGIC			"GBMV"
+#define MOVIE_VERSION		1
+#define MOVIE_HEADER_SIZE	16
+
+/* state the machine is in when a movie starts */
+#define MOVIE_START_POWER_ON	0
+
+/* what a movie is being used for */
+#define MOVIE_RECORD		0
+#define MOVIE_PLAY			1
+
+typedef struct {
+	int Mode;					/* MOVIE_RECORD or MOVIE_PLAY */
+	unsigned char Start;		/* one of MOVIE_START_* */
+	u32 Checksum;				/* checksum of the ROM the movie belongs to */
+	u32 Frames;					/* number of frames in the movie */
+
+	unsigned char *Data;		/* run-length encoded joypad states */
+	unsigned int Size;			/* bytes used in Data */
+	unsigned int Capacity;		/* bytes allocated for Data */
+
+	u32 Frame;					/* frames played back so far */
+	unsigned int Pos;			/* offset of the run being played back */
+	unsigned int Left;			/* frames left in that run */
+
+} Movie_t;
+
+/* function declarations */
+
+void movie_record( Movie_t *Movie, u32 checksum );
+void movie_play( Movie_t *Movie );
+int movie_append( Movie_t *Movie, unsigned char buttons );
+int movie_next( Movie_t *Movie, unsigned char *buttons );
+void movie_free( Movie_t *Movie );
+int movie_save( Movie_t *Movie, unsigned char **data, unsigned int *size );
+int movie_load( Movie_t *Movie, unsigned char *data, unsigned int size );
+int movie_decode( Movie_t *Movie, unsigned char *Input );
+int movie_replay( Gameboy_t *gb, Movie_t *Movie, unsigned char *rom,
+	unsigned int rom_size );
+
+#endif /* _MOVIE_H_ */
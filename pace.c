@@ -0,0 +1,105 @@
+/*
+=================================================================
+Copyright (C) 2008 Torben Koenke
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+MA  02110-1301, USA.
+=================================================================
+*/
+
+
+#include "gameboy.h"
+
+/*
+ * pace_reset - Resets frame pacing.
+ *
+ * The function makes the next frame due one frame time from now. It is
+ *	called whenever the emulator starts or resumes executing a ROM so
+ *	that the time spent stopped or paused is not made up for.
+ *
+ */
+void pace_reset( Gameboy_t *gb ) {
+	gb->Pace.Next	= host_time();
+	gb->Pace.Rem	= 0;
+
+	pace_frame_advance(gb);
+}
+
+/*
+ * pace_frame_advance - Moves the deadline ahead by one frame.
+ *
+ * The frame time is divided by the speed multiplier, so at a speed of
+ *	200 percent frames are due twice as often.
+ *
+ */
+void pace_frame_advance( Gameboy_t *gb ) {
+	unsigned int nsec = PACE_FRAME_NSEC;
+
+	if(gb->Pace.Speed)
+		nsec = (PACE_FRAME_NSEC * 100U) / gb->Pace.Speed;
+
+	gb->Pace.Rem	+= nsec % 1000;
+	gb->Pace.Next	+= nsec / 1000 + gb->Pace.Rem / 1000;
+	gb->Pace.Rem	%= 1000;
+}
+
+/*
+ * pace_frame - Waits until the next frame is due.
+ *
+ * This is called after every emulated frame. Sleeping is cheap but coarse
+ *	so the function sleeps until shortly before the deadline and spins
+ *	for the rest of the time. The difference between the deadline and
+ *	the time the function actually returns is recorded as jitter.
+ *
+ */
+void pace_frame( Gameboy_t *gb ) {
+	unsigned int now = host_time(), jitter;
+	int left = (int)(gb->Pace.Next - now);
+
+	/* speed was changed or we are way behind, don't try to catch up */
+	if(gb->Pace.Resync || left < -PACE_RESYNC_USEC) {
+		if(!gb->Pace.Resync)
+			gb->Pace.Late++;
+
+		gb->Pace.Resync = 0;
+		pace_reset(gb);
+		return;
+	}
+
+	/* the frame took longer than it should have */
+	if(left < 0)
+		gb->Pace.Late++;
+
+	/* sleep off most of the time left */
+	if(left > PACE_SPIN_USEC) {
+		host_sleep((left - PACE_SPIN_USEC) / 1000);
+		now = host_time();
+	}
+
+	/* and spin for the rest */
+	while((int)(gb->Pace.Next - now) > 0)
+		now = host_time();
+
+	/* record how far off the deadline we are */
+	jitter = now - gb->Pace.Next;
+
+	if(jitter > gb->Pace.JitterMax)
+		gb->Pace.JitterMax = jitter;
+
+	gb->Pace.JitterSum += jitter;
+	gb->Pace.Frames++;
+
+	pace_frame_advance(gb);
+}
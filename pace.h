@@ -0,0 +1,59 @@
+/*
+=================================================================
+Copyright (C) 2008 Torben Koenke
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+MA  02110-1301, USA.
+=================================================================
+*/
+
+
+#ifndef _PACE_H_
+#define _PACE_H_
+
+/* the Gameboy runs at 4194304 Hz and a frame takes 70224 clock cycles
+	which makes for a frame time of 16742.706 usec (~59.73 Hz). This is
+	kept in nanoseconds so no precision is lost when accumulating. */
+#define PACE_FRAME_NSEC		16742706
+
+/* sleep until this many usec before a frame is due and busy wait for
+	the rest. Sleep granularity on most hosts is about a millisecond */
+#define PACE_SPIN_USEC		2000
+
+/* if we fall behind by more than this many usec (e.g. after the emulator
+	was paused) don't try to catch up but start over from now */
+#define PACE_RESYNC_USEC	100000
+
+/* Frame pacing state and statistics */
+typedef struct {
+	unsigned int Speed;			/* emulation speed in percent of a real GB */
+	unsigned int Next;			/* timestamp at which next frame is due */
+	unsigned int Rem;			/* fractional part of Next, in nsec */
+	volatile int Resync;		/* set by other threads to restart pacing */
+
+	unsigned int Frames;		/* number of paced frames */
+	unsigned int Late;			/* frames that finished after their deadline */
+	unsigned int JitterMax;		/* largest deviation from deadline, in usec */
+	unsigned int JitterSum;		/* sum of all deviations, in usec */
+
+} Pace_t;
+
+/* function declarations */
+
+void pace_reset( Gameboy_t *gb );
+void pace_frame( Gameboy_t *gb );
+void pace_frame_advance( Gameboy_t *gb );
+
+#endif /* _PACE_H_ */
@@ -0,0 +1,135 @@
+/*
+=================================================================
+Copyright (C) 2008 Torben Koenke
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+MA  02110-1301, USA.
+=================================================================
+*/
+
+
+
+
+#include "gameboy.h"
+
+/* last id handed out to a pool state */
+static volatile int PoolSerial;
+
+/*
+ * pool_add - Adds the state of a machine to a pool.
+ *
+ * @param Pool
+ *	A pointer to a ResetPool_t structure. The structure must be zeroed
+ *		out before it is used for the first time.
+ * @param gb
+ *	The machine whose state is added. It must not be run by another
+ *		thread meanwhile.
+ *
+ * @return
+ *	GB_EMU_OK on success, GB_EMU_ERROR if memory could not be allocated.
+ */
+int pool_add( ResetPool_t *Pool, Gameboy_t *gb ) {
+	Gameboy_t **States, *State;
+	unsigned int size;
+
+	if(Pool->NumStates == Pool->Capacity) {
+		size = Pool->Capacity ? Pool->Capacity * 2 : 8;
+
+		if(!(States = realloc(Pool->States, size * sizeof(Gameboy_t*))))
+			return GB_EMU_ERROR;
+
+		Pool->States	= States;
+		Pool->Capacity	= size;
+	}
+
+	if(!(State = gb_emu_fork(gb)))
+		return GB_EMU_ERROR;
+
+	/* machines tell their last pool state by this, not by its address
+		which may be reused once the pool is freed */
+	State->PoolId = host_add(&PoolSerial, 1) + 1;
+
+	Pool->States[ Pool->NumStates++ ] = State;
+
+	return GB_EMU_OK;
+}
+
+/*
+ * pool_reset - Resets a machine to a state of a pool.
+ *
+ * The machine continues from the state as if it had been forked from it.
+ *	If the machine was last reset to the same state, only the blocks of
+ *	internal RAM it has written since are copied back.
+ *
+ * @param index
+ *	Index of the state in the pool, in the order the states were added.
+ *
+ * @return
+ *	GB_EMU_OK on success, GB_EMU_ERROR if there is no such state or
+ *	memory could not be allocated.
+ */
+int pool_reset( Gameboy_t *gb, ResetPool_t *Pool, unsigned int index ) {
+	Gameboy_t *State;
+
+	if(index >= Pool->NumStates)
+		return GB_EMU_ERROR;
+
+	State = Pool->States[ index ];
+
+	if(GB_EMU_ERROR == mem_reset_memory(gb, State,
+		gb->ResetFrom != State->PoolId))
+		return GB_EMU_ERROR;
+
+	gb->ResetFrom		= State->PoolId;
+
+	gb->CPU				= State->CPU;
+	gb->CPU.ctx			= gb;
+	gb->Timer			= State->Timer;
+	gb->RTC				= State->RTC;
+	gb->Cycles			= State->Cycles;
+	gb->Joypad.Buttons	= State->Joypad.Buttons;
+	gb->Screen.WndLine	= State->Screen.WndLine;
+	gb->Status			= GB_EMU_STATUS_EXECUTING;
+
+	memcpy(gb->Counters, State->Counters, sizeof(gb->Counters));
+
+#ifdef DEBUG
+	/* copying back only the blocks written since the last reset has to
+		give the same memory as a full copy */
+	if(memcmp(&gb->Memory, &State->Memory, sizeof(Memory_t)))
+		printf("pool_reset: memory differs from pool state %u\n", index);
+#endif
+
+	return GB_EMU_OK;
+}
+
+/*
+ * pool_free - Releases all states of a pool.
+ *
+ * Machines that were reset to the states are not affected.
+ *
+ */
+void pool_free( ResetPool_t *Pool ) {
+	unsigned int i;
+
+	for(i = 0; i < Pool->NumStates; i++)
+		gb_emu_destroy(Pool->States[ i ]);
+
+	free(Pool->States);
+
+	Pool->States	= NULL;
+	Pool->NumStates	= 0;
+	Pool->Capacity	= 0;
+}
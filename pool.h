@@ -0,0 +1,45 @@
+/*
+=================================================================
+Copyright (C) 2008 Torben Koenke
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+MA  02110-1301, USA.
+=================================================================
+*/
+
+
+#ifndef _POOL_H_
+#define _POOL_H_
+
+/* A pool of prepared machine states, e.g. the states right after the
+	intro of a game from which every episode of a reinforcement learning
+	environment starts. Each state is a fork of the machine it was taken
+	from and is never run itself, so a machine that is reset to the same
+	state again only needs to copy back the memory it has written since,
+	see mem_reset_memory. */
+typedef struct {
+	Gameboy_t **States;
+	unsigned int NumStates;
+	unsigned int Capacity;
+
+} ResetPool_t;
+
+/* function declarations */
+
+int pool_add( ResetPool_t *Pool, Gameboy_t *gb );
+int pool_reset( Gameboy_t *gb, ResetPool_t *Pool, unsigned int index );
+void pool_free( ResetPool_t *Pool );
+
+#endif /* _POOL_H_ */
@@ -22,13 +22,15 @@
 #define IDM_SETTINGS_CONSOLE            40007
 #define ID_SETTINGS_CONTROLS            40008
 #define IDM_SETTINGS_CONTROLS           40008
+#define IDM_SETTINGS_TURBO              40009
+#define IDM_SETTINGS_RUNAHEAD           40010
 
 // Next default values for new objects
 // 
 #ifdef APSTUDIO_INVOKED
 #ifndef APSTUDIO_READONLY_SYMBOLS
 #define _APS_NEXT_RESOURCE_VALUE        106
-#define _APS_NEXT_COMMAND_VALUE         40009
+#define _APS_NEXT_COMMAND_VALUE         40011
 #define _APS_NEXT_CONTROL_VALUE         1007
 #define _APS_NEXT_SYMED_VALUE           101
 #endif
@@ -0,0 +1,357 @@
+/*
+=================================================================
+Copyright (C) 2008 Torben Koenke
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+MA  02110-1301, USA.
+=================================================================
+*/
+
+
+
+
+#include "gameboy.h"
+
+/*
+ * rewind_init - Sets up the rewind buffer.
+ *
+ * Any states in the buffer are discarded.
+ *
+ * @param Rewind
+ *	A pointer to a Rewind_t structure. The structure must be zeroed out
+ *		before it is used for the first time.
+ * @param size
+ *	Size of the ring buffer for the deltas, in bytes. Pass 0 to release
+ *		the buffer and disable rewinding.
+ *
+ * @return
+ *	GB_EMU_OK on success, GB_EMU_ERROR if memory could not be allocated.
+ */
+int rewind_init( Rewind_t *Rewind, unsigned int size ) {
+	rewind_free(Rewind);
+
+	if(!size)
+		return GB_EMU_OK;
+
+	if(!(Rewind->Buffer = malloc(size)))
+		return GB_EMU_ERROR;
+
+	Rewind->Capacity = size;
+	return GB_EMU_OK;
+}
+
+/*
+ * rewind_free - Releases the rewind buffer.
+ *
+ */
+void rewind_free( Rewind_t *Rewind ) {
+	free(Rewind->Buffer);
+	free(Rewind->Delta);
+
+	state_free(&Rewind->Current);
+	state_free(&Rewind->Next);
+
+	Rewind->Buffer		= NULL;
+	Rewind->Capacity	= 0;
+	Rewind->Delta		= NULL;
+	Rewind->DeltaSize	= 0;
+
+	rewind_clear(Rewind);
+}
+
+/*
+ * rewind_clear - Discards all states in the rewind buffer.
+ *
+ */
+void rewind_clear( Rewind_t *Rewind ) {
+	Rewind->Head	= 0;
+	Rewind->Tail	= 0;
+	Rewind->End		= 0;
+	Rewind->Wrapped	= 0;
+	Rewind->Count	= 0;
+
+	Rewind->Current.Size = 0;
+}
+
+/*
+ * rewind_capture - Adds the state of the machine to the rewind buffer.
+ *
+ * This is called at the end of every frame. The state becomes the newest
+ *	state and the previous one is stored as a delta against it.
+ *
+ * @return
+ *	GB_EMU_OK on success, GB_EMU_ERROR if memory could not be allocated.
+ *	Does nothing if the rewind buffer has not been set up.
+ */
+int rewind_capture( Gameboy_t *gb, Rewind_t *Rewind ) {
+	Snapshot_t Temp;
+	unsigned char *Delta;
+	unsigned int size;
+
+	if(!Rewind->Buffer)
+		return GB_EMU_OK;
+
+	if(GB_EMU_ERROR == state_snapshot(gb, &Rewind->Next))
+		return GB_EMU_ERROR;
+
+	/* states of the same cartridge are always the same size */
+	if(Rewind->Current.Size && Rewind->Current.Size == Rewind->Next.Size) {
+		/* in the worst case every 128 bytes take an extra byte */
+		size = Rewind->Next.Size + Rewind->Next.Size / 64 + 16;
+
+		if(size > Rewind->DeltaSize) {
+			if(!(Delta = realloc(Rewind->Delta, size)))
+				return GB_EMU_ERROR;
+
+			Rewind->Delta		= Delta;
+			Rewind->DeltaSize	= size;
+		}
+
+		size = rewind_encode(Rewind->Current.Data, Rewind->Next.Data,
+			Rewind->Next.Size, Rewind->Delta);
+
+		rewind_push(Rewind, Rewind->Delta, size);
+	}
+	else
+		rewind_clear(Rewind);
+
+	/* the state just taken is the newest one now */
+	Temp				= Rewind->Current;
+	Rewind->Current		= Rewind->Next;
+	Rewind->Next		= Temp;
+
+	return GB_EMU_OK;
+}
+
+/*
+ * rewind_step - Goes back one state.
+ *
+ * Takes the newest delta off the rewind buffer and restores the state
+ *	before the newest one.
+ *
+ * @return
+ *	GB_EMU_OK on success, GB_EMU_ERROR if there are no more states to go
+ *	back to.
+ */
+int rewind_step( Gameboy_t *gb, Rewind_t *Rewind ) {
+	unsigned int size;
+
+	if(!Rewind->Count)
+		return GB_EMU_ERROR;
+
+	size = state_get32(Rewind->Buffer + Rewind->Head - REWIND_ENTRY_HEADER);
+	Rewind->Head -= size + 2 * REWIND_ENTRY_HEADER;
+
+	rewind_decode(Rewind->Buffer + Rewind->Head + REWIND_ENTRY_HEADER, size,
+		Rewind->Current.Data);
+
+	if(!--Rewind->Count) {
+		Rewind->Head = Rewind->Tail = Rewind->End = 0;
+		Rewind->Wrapped = 0;
+	}
+	/* the delta before this one is at the end of the buffer */
+	else if(Rewind->Wrapped && !Rewind->Head) {
+		Rewind->Head	= Rewind->End;
+		Rewind->Wrapped	= 0;
+	}
+
+	return state_restore(gb, &Rewind->Current);
+}
+
+/*
+ * rewind_frame - Emulates a frame backwards.
+ *
+ * Goes back one state and emulates the frame that follows it so there is
+ *	something to present. The frame is rolled back afterwards, so the
+ *	next call goes back another frame.
+ *
+ * @return
+ *	GB_EMU_OK if a frame was completed, GB_EMU_ERROR if the emulator
+ *		stopped executing before the frame was done.
+ */
+int rewind_frame( Gameboy_t *gb ) {
+	int ret;
+
+	/* the beginning of the recording, keep showing the last frame */
+	if(GB_EMU_ERROR == rewind_step(gb, &gb->Rewind))
+		return GB_EMU_OK;
+
+	gb->Speculating = 1;
+	ret = gb_emu_run_frame(gb);
+	gb->Speculating = 0;
+
+	state_restore(gb, &gb->Rewind.Current);
+
+	return ret;
+}
+
+/*
+ * rewind_encode - Encodes the difference between two states.
+ *
+ * @param from
+ *	A pointer to the first state image.
+ * @param to
+ *	A pointer to the second state image.
+ * @param size
+ *	Size of both images, in bytes.
+ * @param out
+ *	A pointer to a buffer that receives the delta. It must be large enough
+ *		for the worst case of size + size / 128 + 1 bytes.
+ *
+ * @return
+ *	Size of the delta, in bytes.
+ */
+unsigned int rewind_encode( unsigned char *from, unsigned char *to,
+	unsigned int size, unsigned char *out ) {
+	unsigned int i = 0, j, n, o = 0;
+
+	while(i < size) {
+		/* count the bytes that didn't change */
+		for(j = i; j < size && j - i < REWIND_SKIP_MAX && from[ j ] == to[ j ];
+			j++);
+
+		/* unchanged bytes at the end need not be stored at all */
+		if(j == size)
+			break;
+
+		/* a skip takes 2 bytes, shorter runs go into the literal */
+		if(j - i >= 3) {
+			n = j - i - 1;
+
+			out[ o++ ] = 0x80 | (n >> 8);
+			out[ o++ ] = n & 0xFF;
+
+			i = j;
+			continue;
+		}
+
+		/* the literal ends where the next run of unchanged bytes begins */
+		for(j = i; j < size && j - i < REWIND_LITERAL_MAX; j++) {
+			if(j + 2 < size && from[ j ] == to[ j ] &&
+				from[ j + 1 ] == to[ j + 1 ] && from[ j + 2 ] == to[ j + 2 ])
+				break;
+		}
+
+		out[ o++ ] = j - i - 1;
+
+		for(; i < j; i++)
+			out[ o++ ] = from[ i ] ^ to[ i ];
+	}
+
+	return o;
+}
+
+/*
+ * rewind_decode - Applies a delta to a state.
+ *
+ * @param delta
+ *	A pointer to a delta created by rewind_encode.
+ * @param delta_size
+ *	Size of the delta, in bytes.
+ * @param state
+ *	A pointer to one of the two state images the delta was created from.
+ *		It is turned into the other one.
+ */
+void rewind_decode( unsigned char *delta, unsigned int delta_size,
+	unsigned char *state ) {
+	unsigned int p = 0, i = 0, n;
+
+	while(p < delta_size) {
+		n = delta[ p++ ];
+
+		if(n & 0x80) {
+			i += (((n & 0x7F) << 8) | delta[ p++ ]) + 1;
+			continue;
+		}
+
+		for(n++; n; n--)
+			state[ i++ ] ^= delta[ p++ ];
+	}
+}
+
+/*
+ * rewind_push - Adds a delta to the ring buffer.
+ *
+ * The oldest deltas are dropped until there is room for the new one.
+ *
+ * @return
+ *	GB_EMU_OK on success. If the delta is larger than the whole buffer,
+ *	the buffer is emptied and GB_EMU_ERROR is returned.
+ */
+int rewind_push( Rewind_t *Rewind, unsigned char *delta,
+	unsigned int size ) {
+	unsigned int total = size + 2 * REWIND_ENTRY_HEADER;
+
+	if(total > Rewind->Capacity) {
+		/* older deltas are useless without this one */
+		Rewind->Head = Rewind->Tail = Rewind->End = 0;
+		Rewind->Wrapped = 0;
+		Rewind->Count = 0;
+		return GB_EMU_ERROR;
+	}
+
+	while(1) {
+		if(!Rewind->Wrapped) {
+			/* room behind the newest delta */
+			if(Rewind->Capacity - Rewind->Head >= total)
+				break;
+
+			/* room at the start of the buffer */
+			if(Rewind->Tail >= total) {
+				Rewind->End		= Rewind->Head;
+				Rewind->Head	= 0;
+				Rewind->Wrapped	= 1;
+				break;
+			}
+		}
+		/* room between the newest and the oldest delta */
+		else if(Rewind->Tail - Rewind->Head >= total)
+			break;
+
+		rewind_drop(Rewind);
+	}
+
+	state_put32(Rewind->Buffer + Rewind->Head, size);
+	memcpy(Rewind->Buffer + Rewind->Head + REWIND_ENTRY_HEADER, delta, size);
+	state_put32(Rewind->Buffer + Rewind->Head + REWIND_ENTRY_HEADER + size,
+		size);
+
+	Rewind->Head += total;
+	Rewind->Count++;
+
+	return GB_EMU_OK;
+}
+
+/*
+ * rewind_drop - Drops the oldest delta from the ring buffer.
+ *
+ */
+void rewind_drop( Rewind_t *Rewind ) {
+	if(!Rewind->Count)
+		return;
+
+	Rewind->Tail += state_get32(Rewind->Buffer + Rewind->Tail) +
+		2 * REWIND_ENTRY_HEADER;
+
+	if(!--Rewind->Count) {
+		Rewind->Head = Rewind->Tail = Rewind->End = 0;
+		Rewind->Wrapped = 0;
+	}
+	/* the deltas at the end of the buffer are gone */
+	else if(Rewind->Wrapped && Rewind->Tail == Rewind->End) {
+		Rewind->Tail	= 0;
+		Rewind->Wrapped	= 0;
+	}
+}
@@ -0,0 +1,83 @@
+/*
+=================================================================
+Copyright (C) 2008 Torben Koenke
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+MA  02110-1301, USA.
+=================================================================
+*/
+
+
+#ifndef _REWIND_H_
+#define _REWIND_H_
+
+/* The rewind buffer keeps the state of the machine at the end of every
+	frame. Only the newest state is kept as a whole, see state_snapshot.
+	Every other state is stored as the difference to the state that was
+	taken after it: the two images are XORed, which leaves zeros wherever
+	memory didn't change, and the result is run-length encoded.
+
+	The deltas live in a ring buffer of a fixed size. Each is stored with
+	its size in front and behind it, so the oldest delta can be dropped
+	to make room and the newest one can be taken off when rewinding. At
+	roughly 100 bytes per frame, 64 MB hold well over 10 minutes of most
+	games. */
+
+/* encoding of the deltas:
+
+	0x00 - 0x7F		(n + 1) bytes follow that are XORed into the state
+	0x80 - 0xFF		followed by a byte b, ((n & 0x7F) << 8 | b) + 1 bytes
+					that didn't change */
+#define REWIND_LITERAL_MAX	0x80
+#define REWIND_SKIP_MAX		0x8000
+
+/* size of the length fields around each delta */
+#define REWIND_ENTRY_HEADER	4
+
+typedef struct {
+	unsigned char *Buffer;		/* ring buffer of deltas */
+	unsigned int Capacity;		/* size of Buffer, in bytes */
+
+	unsigned int Head;			/* offset just past the newest delta */
+	unsigned int Tail;			/* offset of the oldest delta */
+	unsigned int End;			/* end of the deltas before Head wrapped */
+	int Wrapped;				/* deltas wrap around the end of Buffer */
+	unsigned int Count;			/* number of deltas in Buffer */
+
+	Snapshot_t Current;			/* the newest state */
+	Snapshot_t Next;			/* state being captured */
+
+	unsigned char *Delta;		/* delta being encoded */
+	unsigned int DeltaSize;		/* bytes allocated for Delta */
+
+} Rewind_t;
+
+/* function declarations */
+
+int rewind_init( Rewind_t *Rewind, unsigned int size );
+void rewind_free( Rewind_t *Rewind );
+void rewind_clear( Rewind_t *Rewind );
+int rewind_capture( Gameboy_t *gb, Rewind_t *Rewind );
+int rewind_step( Gameboy_t *gb, Rewind_t *Rewind );
+int rewind_frame( Gameboy_t *gb );
+unsigned int rewind_encode( unsigned char *from, unsigned char *to,
+	unsigned int size, unsigned char *out );
+void rewind_decode( unsigned char *delta, unsigned int delta_size,
+	unsigned char *state );
+int rewind_push( Rewind_t *Rewind, unsigned char *delta,
+	unsigned int size );
+void rewind_drop( Rewind_t *Rewind );
+
+#endif /* _REWIND_H_ */
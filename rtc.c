@@ -0,0 +1,201 @@
+/*
+=================================================================
+Copyright (C) 2008 Torben Koenke
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+MA  02110-1301, USA.
+=================================================================
+*/
+
+
+#include "gameboy.h"
+
+/* bits of the clock registers that exist */
+unsigned char RtcMask[RTC_NUM_REGS] = { 0x3F, 0x3F, 0x1F, 0xFF,
+	RTC_DAY_HIGH | RTC_HALT | RTC_CARRY };
+
+/*
+ * rtc_reset - Resets the clock of a cartridge.
+ *
+ * The clock starts out at day 0, 00:00:00 and running.
+ *
+ * @param present
+ *	Set to 1 if the cartridge has a clock.
+ */
+void rtc_reset( Gameboy_t *gb, int present ) {
+	memset(&gb->RTC, 0, sizeof(gb->RTC));
+
+	gb->RTC.Present	= present;
+	gb->RTC.Cycle	= gb->CPU.cycles;
+	gb->RTC.Clock	= host_clock();
+}
+
+/*
+ * rtc_update - Brings the clock registers up to date.
+ *
+ * The time passed since they were last updated is taken from the clock
+ *	cycle counter in turbo mode, so machines running unthrottled see the
+ *	same time for the same input, and from the host's wall clock when the
+ *	emulator is paced. Since the cycle counter wraps around, this is also
+ *	called once per frame, see gb_emu_end_slice.
+ *
+ */
+void rtc_update( Gameboy_t *gb ) {
+	u32 now = host_clock(), seconds, cycles;
+
+	if(gb->Turbo) {
+		cycles	= gb->CPU.cycles - gb->RTC.Cycle + gb->RTC.Rem;
+		seconds	= cycles >> RTC_CYCLES_SHIFT;
+
+		gb->RTC.Rem = cycles & ((1 << RTC_CYCLES_SHIFT) - 1);
+	}
+	else
+		seconds = now - gb->RTC.Clock;
+
+	gb->RTC.Cycle = gb->CPU.cycles;
+	gb->RTC.Clock = now;
+
+	if(!(gb->RTC.Regs[RTC_DH] & RTC_HALT))
+		rtc_advance(gb, seconds);
+}
+
+/*
+ * rtc_advance - Moves the clock registers forward.
+ *
+ * The day counter has 9 bits, the carry bit is set when it overflows and
+ *	stays set until the CPU clears it.
+ *
+ * @param seconds
+ *	Number of seconds to move forward.
+ */
+void rtc_advance( Gameboy_t *gb, u32 seconds ) {
+	unsigned char *Regs = gb->RTC.Regs;
+	u32 t, days;
+
+	if(!seconds)
+		return;
+
+	t = seconds + Regs[RTC_S] + 60 * (Regs[RTC_M] + 60 * Regs[RTC_H]);
+	days = t / 86400 + Regs[RTC_DL] + ((Regs[RTC_DH] & RTC_DAY_HIGH) << 8);
+
+	if(days > 511)
+		Regs[RTC_DH] |= RTC_CARRY;
+
+	Regs[RTC_S]		= (unsigned char) (t % 60);
+	Regs[RTC_M]		= (unsigned char) (t / 60 % 60);
+	Regs[RTC_H]		= (unsigned char) (t / 3600 % 24);
+	Regs[RTC_DL]	= (unsigned char) days;
+	Regs[RTC_DH]	= (Regs[RTC_DH] & ~RTC_DAY_HIGH) |
+		((days >> 8) & RTC_DAY_HIGH);
+}
+
+/*
+ * rtc_latch - Handles writes to 0x6000 - 0x7FFF.
+ *
+ * Writing 0x00 and then 0x01 copies the clock registers to the latched
+ *	registers the CPU reads.
+ *
+ */
+void rtc_latch( Gameboy_t *gb, unsigned char value ) {
+	if(!gb->RTC.Latch && value == 1) {
+		rtc_update(gb);
+		memcpy(gb->RTC.Latched, gb->RTC.Regs, RTC_NUM_REGS);
+	}
+
+	gb->RTC.Latch = value;
+}
+
+/*
+ * rtc_read - Reads the selected clock register.
+ *
+ * @return
+ *	The latched value of the register, or 0 if no clock register is
+ *		selected.
+ */
+unsigned char rtc_read( Gameboy_t *gb ) {
+	unsigned int reg = gb->Map.RAMBankSelect - 0x08;
+
+	if(!gb->RTC.Present || reg >= RTC_NUM_REGS)
+		return 0;
+
+	return gb->RTC.Latched[ reg ];
+}
+
+/*
+ * rtc_write - Writes the selected clock register.
+ *
+ * Writing the seconds also restarts the current second.
+ *
+ */
+void rtc_write( Gameboy_t *gb, unsigned char value ) {
+	unsigned int reg = gb->Map.RAMBankSelect - 0x08;
+
+	if(!gb->RTC.Present || reg >= RTC_NUM_REGS)
+		return;
+
+	rtc_update(gb);
+
+	gb->RTC.Regs[ reg ] = value & RtcMask[ reg ];
+
+	if(reg == RTC_S)
+		gb->RTC.Rem = 0;
+}
+
+/*
+ * rtc_save - Stores the clock in RTC_SAVE_SIZE bytes of the save file.
+ *
+ */
+void rtc_save( Gameboy_t *gb, unsigned char *p ) {
+	unsigned int i;
+
+	for(i = 0; i < RTC_NUM_REGS; i++)
+		p = state_put32(p, gb->RTC.Regs[ i ]);
+
+	for(i = 0; i < RTC_NUM_REGS; i++)
+		p = state_put32(p, gb->RTC.Latched[ i ]);
+
+	p = state_put32(p, gb->RTC.Clock);
+	state_put32(p, 0);
+}
+
+/*
+ * rtc_load - Restores the clock from the save file.
+ *
+ * The clock kept running while the emulator was not, so it is moved
+ *	forward by the time passed since it was saved. A save file without
+ *	a time, i.e. a new one, leaves the clock as it is.
+ *
+ */
+void rtc_load( Gameboy_t *gb, unsigned char *p ) {
+	unsigned int i;
+	u32 Clock = state_get32(p + 2 * RTC_NUM_REGS * 4), now = host_clock();
+
+	if(!Clock)
+		return;
+
+	for(i = 0; i < RTC_NUM_REGS; i++) {
+		gb->RTC.Regs[ i ] = (unsigned char) state_get32(p + i * 4) &
+			RtcMask[ i ];
+		gb->RTC.Latched[ i ] = (unsigned char) state_get32(p +
+			(RTC_NUM_REGS + i) * 4) & RtcMask[ i ];
+	}
+
+	/* the time passed is real time, even in turbo mode */
+	if(!(gb->RTC.Regs[RTC_DH] & RTC_HALT) && (s32)(now - Clock) > 0)
+		rtc_advance(gb, now - Clock);
+
+	gb->RTC.Cycle = gb->CPU.cycles;
+	gb->RTC.Clock = now;
+}
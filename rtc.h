@@ -0,0 +1,78 @@
+/*
+=================================================================
+Copyright (C) 2008 Torben Koenke
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+MA  02110-1301, USA.
+=================================================================
+*/
+
+
+#ifndef _RTC_H_
+#define _RTC_H_
+
+/* clock registers, selected by writing 0x08 - 0x0C to 0x4000 - 0x5FFF */
+#define RTC_S				0		/* seconds */
+#define RTC_M				1		/* minutes */
+#define RTC_H				2		/* hours */
+#define RTC_DL				3		/* lower 8 bits of the day counter */
+#define RTC_DH				4		/* day counter bit 8, halt and carry */
+
+#define RTC_NUM_REGS		5
+
+/* RTC_DH bits */
+#define RTC_DAY_HIGH		(1 << 0)
+#define RTC_HALT			(1 << 6)
+#define RTC_CARRY			(1 << 7)
+
+/* clock cycles per second of emulated time */
+#define RTC_CYCLES_SHIFT	22
+
+/* bytes of clock data appended to the save file. This is the layout
+	other emulators use: the registers and the latched registers as
+	32-bit values, then the host_clock time they were current at as a
+	64-bit value */
+#define RTC_SAVE_SIZE		(2 * RTC_NUM_REGS * 4 + 8)
+
+/* The clock of MBC3 cartridges. Like the timer it is never clocked. The
+	registers hold the time as of Cycle and Clock and are brought up to
+	date when they are latched or written, going by the clock cycle
+	counter in turbo mode and by the host's wall clock otherwise */
+typedef struct {
+	unsigned char Present;		/* cartridge has a clock */
+	unsigned char Regs[RTC_NUM_REGS];
+	unsigned char Latched[RTC_NUM_REGS];	/* registers as read by the CPU */
+	unsigned char Latch;		/* last value written to 0x6000 - 0x7FFF */
+
+	u32 Cycle;					/* clock cycle Regs were last updated at */
+	u32 Rem;					/* clock cycles left over from then */
+	u32 Clock;					/* host_clock Regs were last updated at */
+
+} Rtc_t;
+
+/* function declarations */
+
+void rtc_reset( Gameboy_t *gb, int present );
+void rtc_update( Gameboy_t *gb );
+void rtc_advance( Gameboy_t *gb, u32 seconds );
+void rtc_latch( Gameboy_t *gb, unsigned char value );
+unsigned char rtc_read( Gameboy_t *gb );
+void rtc_write( Gameboy_t *gb, unsigned char value );
+void rtc_save( Gameboy_t *gb, unsigned char *p );
+void rtc_load( Gameboy_t *gb, unsigned char *p );
+
+extern unsigned char RtcMask[RTC_NUM_REGS];
+
+#endif /* _RTC_H_ */
@@ -0,0 +1,325 @@
+/*
+=================================================================
+Copyright (C) 2008 Torben Koenke
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+MA  02110-1301, USA.
+=================================================================
+*/
+
+
+#include "gameboy.h"
+
+/*
+ * runner_run - Runs a batch of jobs on a pool of worker threads.
+ *
+ * The jobs are dealt out to the workers round robin. Every worker runs
+ *	the jobs in its own deque one after another, stepping the machine a
+ *	frame at a time, and steals jobs from the other workers once its own
+ *	deque is empty. The function returns when all jobs are done.
+ *
+ * @param Jobs
+ *	Array of jobs to run. The results are stored in the jobs.
+ * @param NumJobs
+ *	Number of jobs in the array.
+ * @param Workers
+ *	Number of worker threads to start. This is clamped to the number of
+ *		jobs and to RUNNER_MAX_WORKERS.
+ * @param Stats
+ *	A pointer to a RunStats_t structure that receives the aggregate
+ *		frames per second and job latencies of the batch.
+ *
+ * @return
+ *	GB_EMU_OK if the batch was run, GB_EMU_ERROR if memory for the workers
+ *		could not be allocated. Whether the individual jobs succeeded is
+ *		stored in their Result fields.
+ */
+int runner_run( RunJob_t *Jobs, unsigned int NumJobs, unsigned int Workers,
+	RunStats_t *Stats ) {
+	Runner_t *Runner;
+	RunWorker_t *Worker;
+	RunDeque_t *Deque;
+	unsigned int i, started = 0;
+	double latency = 0;
+#ifdef DEBUG
+	unsigned int taken = 0;
+#endif
+
+	memset(Stats, 0, sizeof(RunStats_t));
+
+	if(!NumJobs)
+		return GB_EMU_OK;
+
+	if(Workers > RUNNER_MAX_WORKERS)
+		Workers = RUNNER_MAX_WORKERS;
+
+	if(Workers > NumJobs)
+		Workers = NumJobs;
+
+	if(!Workers)
+		Workers = 1;
+
+	if(!(Runner = calloc(1, sizeof(Runner_t))))
+		return GB_EMU_ERROR;
+
+	Runner->Jobs		= Jobs;
+	Runner->NumJobs		= NumJobs;
+	Runner->NumWorkers	= Workers;
+
+	for(i = 0; i < Workers; i++) {
+		Worker = &Runner->Workers[ i ];
+
+		Worker->Runner			= Runner;
+		Worker->Index			= i;
+		Worker->Deque.Jobs		= malloc(NumJobs * sizeof(int));
+		Worker->Machine			= gb_emu_alloc();
+
+		if(!Worker->Deque.Jobs || !Worker->Machine) {
+			runner_free(Runner);
+			return GB_EMU_ERROR;
+		}
+	}
+
+	/* deal out the jobs */
+	for(i = 0; i < NumJobs; i++) {
+		Deque = &Runner->Workers[ i % Workers ].Deque;
+		Deque->Jobs[ Deque->Bottom++ ] = i;
+
+		Jobs[ i ].Result	= GB_EMU_ERROR;
+		Jobs[ i ].Worker	= -1;
+	}
+
+	Runner->Start = host_time();
+
+	/* the jobs of a worker that could not be started are stolen by the
+		others */
+	for(i = 0; i < Workers; i++) {
+		if(host_thread(runner_worker, &Runner->Workers[ i ]) == GB_EMU_OK)
+			started++;
+		else
+			Runner->Workers[ i ].Done = 1;
+	}
+
+	/* no threads at all, do it ourselves */
+	if(!started)
+		runner_worker(&Runner->Workers[ 0 ]);
+
+	for(i = 0; i < Workers; i++) {
+		while(!Runner->Workers[ i ].Done)
+			host_sleep(1);
+	}
+
+	Stats->Time = host_time() - Runner->Start;
+
+	/* sum up */
+	for(i = 0; i < Workers; i++) {
+		Worker = &Runner->Workers[ i ];
+
+		Stats->Frames += Worker->Frames;
+		Stats->Steals += Worker->Steals;
+	}
+
+#ifdef DEBUG
+	for(i = 0; i < Workers; i++)
+		taken += Runner->Workers[ i ].Jobs;
+
+	/* a job that was both popped by its owner and stolen runs twice, a
+		job that slipped between them doesn't run at all */
+	if(taken != NumJobs)
+		printf("runner_run: %u jobs were run, %u were queued\n", taken,
+			NumJobs);
+#endif
+
+	for(i = 0; i < NumJobs; i++) {
+		if(Jobs[ i ].Result != GB_EMU_OK)
+			continue;
+
+		Stats->Jobs++;
+		latency += Jobs[ i ].Latency;
+
+		if(Jobs[ i ].Latency > Stats->LatencyMax)
+			Stats->LatencyMax = Jobs[ i ].Latency;
+	}
+
+	if(Stats->Jobs)
+		Stats->LatencyAvg = (unsigned int) (latency / Stats->Jobs);
+
+	if(Stats->Time)
+		Stats->FPS = (unsigned int) ((double) Stats->Frames * 1000000.0 /
+			Stats->Time);
+
+	runner_free(Runner);
+	return GB_EMU_OK;
+}
+
+/*
+ * runner_free - Releases a runner and its workers.
+ *
+ */
+void runner_free( Runner_t *Runner ) {
+	unsigned int i;
+
+	for(i = 0; i < Runner->NumWorkers; i++) {
+		free(Runner->Workers[ i ].Deque.Jobs);
+		gb_emu_free(Runner->Workers[ i ].Machine);
+	}
+
+	free(Runner);
+}
+
+/*
+ * runner_worker - Entry point of a worker thread.
+ *
+ * Runs jobs until there are none left to run or steal.
+ *
+ */
+void runner_worker( void *arg ) {
+	RunWorker_t *Worker = (RunWorker_t*) arg;
+	int job;
+
+	while((job = runner_next_job(Worker)) >= 0)
+		runner_run_job(Worker, &Worker->Runner->Jobs[ job ]);
+
+	/* the runner frees the worker as soon as it sees this */
+	host_xchg(&Worker->Done, 1);
+}
+
+/*
+ * runner_next_job - Picks the next job for a worker.
+ *
+ * The worker's own deque is tried first. If it is empty, the deques of
+ *	the other workers are searched for a job to steal. Since jobs are
+ *	never added once the batch is running, finding all deques empty
+ *	means the worker is done.
+ *
+ * @return
+ *	Index of the job to run, or -1 if there are no jobs left.
+ */
+int runner_next_job( RunWorker_t *Worker ) {
+	Runner_t *Runner = Worker->Runner;
+	unsigned int i;
+	int job;
+
+	if((job = runner_pop(&Worker->Deque)) >= 0)
+		return job;
+
+	for(i = 1; i < Runner->NumWorkers; i++) {
+		job = runner_steal(&Runner->Workers[ (Worker->Index + i) %
+			Runner->NumWorkers ].Deque);
+
+		if(job >= 0) {
+			Worker->Steals++;
+			return job;
+		}
+	}
+
+	return -1;
+}
+
+/*
+ * runner_run_job - Runs a single job.
+ *
+ * The worker's machine is powered up with the job's ROM and stepped a
+ *	frame at a time, with the next state from the input script queued
+ *	before every frame. Frames are drawn but never presented.
+ *
+ */
+void runner_run_job( RunWorker_t *Worker, RunJob_t *Job ) {
+	Gameboy_t *gb = Worker->Machine;
+	unsigned int i, start = host_time();
+
+	Job->Worker = Worker->Index;
+	Worker->Jobs++;
+
+	gb_emu_init_headless(gb);
+
+	if(GB_EMU_ERROR == mem_load_cartridge(gb, Job->ROM, Job->ROMSize)) {
+		mem_unload_cartridge(gb);
+		Job->Result = GB_EMU_ERROR;
+		return;
+	}
+
+	for(i = 0; i < Job->Frames; i++) {
+		if(Job->InputSize)
+			joypad_push(gb, Job->Input[ i < Job->InputSize ? i :
+				Job->InputSize - 1 ]);
+
+		if(GB_EMU_ERROR == gb_emu_run_frame(gb))
+			break;
+	}
+
+	mem_unload_cartridge(gb);
+
+	Worker->Frames += i;
+
+	Job->Result		= (i == Job->Frames) ? GB_EMU_OK : GB_EMU_ERROR;
+	Job->Time		= host_time() - start;
+	Job->Latency	= host_time() - Worker->Runner->Start;
+}
+
+/*
+ * runner_lock - Acquires the spinlock of a deque.
+ *
+ */
+void runner_lock( RunDeque_t *Deque ) {
+	while(host_xchg(&Deque->Lock, 1))
+		;
+}
+
+/*
+ * runner_unlock - Releases the spinlock of a deque.
+ *
+ */
+void runner_unlock( RunDeque_t *Deque ) {
+	host_xchg(&Deque->Lock, 0);
+}
+
+/*
+ * runner_pop - Takes the job at the bottom of a worker's own deque.
+ *
+ * @return
+ *	Index of the job or -1 if the deque is empty.
+ */
+int runner_pop( RunDeque_t *Deque ) {
+	int job = -1;
+
+	runner_lock(Deque);
+
+	if(Deque->Bottom > Deque->Top)
+		job = Deque->Jobs[ --Deque->Bottom ];
+
+	runner_unlock(Deque);
+
+	return job;
+}
+
+/*
+ * runner_steal - Takes the job at the top of another worker's deque.
+ *
+ * @return
+ *	Index of the job or -1 if the deque is empty.
+ */
+int runner_steal( RunDeque_t *Deque ) {
+	int job = -1;
+
+	runner_lock(Deque);
+
+	if(Deque->Bottom > Deque->Top)
+		job = Deque->Jobs[ Deque->Top++ ];
+
+	runner_unlock(Deque);
+
+	return job;
+}
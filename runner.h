@@ -0,0 +1,108 @@
+/*
+=================================================================
+Copyright (C) 2008 Torben Koenke
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+MA  02110-1301, USA.
+=================================================================
+*/
+
+
+#ifndef _RUNNER_H_
+#define _RUNNER_H_
+
+/* maximum number of worker threads of the batch runner */
+#define RUNNER_MAX_WORKERS	32
+
+/* A batch job. The runner loads the ROM into a fresh machine, feeds it one
+	joypad state per frame and emulates the given number of frames as fast
+	as it can. If the input script is shorter than that, the last state
+	is held */
+typedef struct {
+	unsigned char *ROM;			/* ROM image, may be shared between jobs */
+	unsigned int ROMSize;		/* size of ROM image, in bytes */
+	unsigned char *Input;		/* input script, one JOYPAD_* state per frame */
+	unsigned int InputSize;		/* number of states in the input script */
+	unsigned int Frames;		/* number of frames to emulate */
+
+	/* filled in by the runner */
+	int Result;					/* GB_EMU_OK if all frames were emulated */
+	int Worker;					/* index of the worker that ran the job */
+	unsigned int Latency;		/* usec from start of batch until job was done */
+	unsigned int Time;			/* usec spent emulating the job */
+
+} RunJob_t;
+
+/* batch statistics returned by gb_emu_run_jobs */
+typedef struct {
+	unsigned int Jobs;			/* number of jobs that completed */
+	unsigned int Frames;		/* total number of frames emulated */
+	unsigned int Time;			/* wall-clock time of the batch, in usec */
+	unsigned int FPS;			/* aggregate frames per second */
+	unsigned int Steals;		/* number of jobs stolen by idle workers */
+	unsigned int LatencyAvg;	/* average job latency, in usec */
+	unsigned int LatencyMax;	/* worst job latency, in usec */
+
+} RunStats_t;
+
+/* Deque of job indices. Every worker takes jobs from the bottom of its own
+	deque and steals from the top of the others' once it runs dry. Jobs
+	are coarse enough for a spinlock to do */
+typedef struct {
+	int *Jobs;
+	int Top;					/* next job to be stolen */
+	int Bottom;					/* one past the owner's next job */
+	volatile int Lock;
+
+} RunDeque_t;
+
+typedef struct Runner_s Runner_t;
+
+typedef struct {
+	Runner_t *Runner;
+	int Index;
+	RunDeque_t Deque;
+	Gameboy_t *Machine;			/* reused for all jobs the worker runs */
+
+	unsigned int Frames;		/* number of frames emulated */
+	unsigned int Jobs;			/* number of jobs run, stolen or not */
+	unsigned int Steals;		/* number of jobs stolen */
+	volatile int Done;			/* worker thread has finished */
+
+} RunWorker_t;
+
+struct Runner_s {
+	RunJob_t *Jobs;
+	unsigned int NumJobs;
+	unsigned int NumWorkers;
+	unsigned int Start;			/* timestamp the batch was started at */
+
+	RunWorker_t Workers[RUNNER_MAX_WORKERS];
+};
+
+/* function declarations */
+
+int runner_run( RunJob_t *Jobs, unsigned int NumJobs, unsigned int Workers,
+	RunStats_t *Stats );
+void runner_free( Runner_t *Runner );
+void runner_worker( void *arg );
+int runner_next_job( RunWorker_t *Worker );
+void runner_run_job( RunWorker_t *Worker, RunJob_t *Job );
+void runner_lock( RunDeque_t *Deque );
+void runner_unlock( RunDeque_t *Deque );
+int runner_pop( RunDeque_t *Deque );
+int runner_steal( RunDeque_t *Deque );
+
+#endif /* _RUNNER_H_ */
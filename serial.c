@@ -0,0 +1,61 @@
+/*
+=================================================================
+Copyright (C) 2008 Torben Koenke
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+MA  02110-1301, USA.
+=================================================================
+*/
+
+
+#include "gameboy.h"
+
+/*
+ * serial_register_io - Installs the handlers of the serial registers.
+ *
+ * SB is plain storage.
+ *
+ */
+void serial_register_io( Gameboy_t *gb ) {
+	mem_io_register(gb, IO_REG_SC, serial_read_sc, serial_write_sc);
+}
+
+/*
+ * serial_read_sc - Reads the SC register.
+ *
+ * Bits 1 - 6 are not used and read as 1.
+ *
+ */
+unsigned char serial_read_sc( Gameboy_t *gb, unsigned int reg ) {
+	return gb->Memory.IORegs[IO_REG_SC] | 0x7E;
+}
+
+/*
+ * serial_write_sc - Writes the SC register.
+ *
+ * A transfer on the internal clock completes at once. With nothing on the
+ *	other end of the cable, SB receives 0xFF and an INT_SIO interrupt is
+ *	requested.
+ *
+ */
+void serial_write_sc( Gameboy_t *gb, unsigned int reg, unsigned char value ) {
+	if((value & (SC_START | SC_INTERNAL)) == (SC_START | SC_INTERNAL)) {
+		gb->Memory.IORegs[IO_REG_SB] = 0xFF;
+		gb->Memory.IORegs[IO_REG_IF] |= INT_SIO;
+		value &= ~SC_START;
+	}
+
+	gb->Memory.IORegs[IO_REG_SC] = value;
+}
@@ -0,0 +1,44 @@
+/*
+=================================================================
+Copyright (C) 2008 Torben Koenke
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+MA  02110-1301, USA.
+=================================================================
+*/
+
+
+#ifndef _SERIAL_H_
+#define _SERIAL_H_
+
+/* SC register bits */
+
+/* set to start a transfer, cleared by hardware when it is complete */
+#define SC_START			(1 << 7)
+
+/* the Gameboy supplies the clock of the transfer */
+#define SC_INTERNAL			(1 << 0)
+
+/* There is never a link cable plugged in. A transfer the Gameboy clocks
+	itself completes right away and shifts in 1 bits, one clocked by the
+	other side never completes */
+
+/* function declarations */
+
+void serial_register_io( Gameboy_t *gb );
+unsigned char serial_read_sc( Gameboy_t *gb, unsigned int reg );
+void serial_write_sc( Gameboy_t *gb, unsigned int reg, unsigned char value );
+
+#endif /* _SERIAL_H_ */
@@ -0,0 +1,92 @@
+/*
+=================================================================
+Copyright (C) 2008 Torben Koenke
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+MA  02110-1301, USA.
+=================================================================
+*/
+
+
+#include "gameboy.h"
+
+/* bits of the registers from NR10 up to wave pattern RAM that can't be
+	read back and read as 1. This includes the addresses without a
+	register */
+unsigned char SoundReadMask[IO_REG_WPR - IO_REG_NR10] = {
+	0x80, 0x3F, 0x00, 0xFF, 0xBF,			/* NR10 - NR14 */
+	0xFF, 0x3F, 0x00, 0xFF, 0xBF,			/* unused, NR21 - NR24 */
+	0x7F, 0xFF, 0x9F, 0xFF, 0xBF,			/* NR30 - NR34 */
+	0xFF, 0xFF, 0x00, 0x00, 0xBF,			/* unused, NR41 - NR44 */
+	0x00, 0x00, 0x70,						/* NR50 - NR52 */
+	0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF
+};
+
+/*
+ * sound_register_io - Installs the handlers of the sound registers.
+ *
+ * Wave pattern RAM is plain storage.
+ *
+ */
+void sound_register_io( Gameboy_t *gb ) {
+	unsigned int i;
+
+	for(i = IO_REG_NR10; i < IO_REG_WPR; i++)
+		mem_io_register(gb, i, sound_read_reg, (i < IO_REG_NR52) ?
+			sound_write_reg : NULL);
+
+	mem_io_register(gb, IO_REG_NR52, NULL, sound_write_nr52);
+}
+
+/*
+ * sound_read_reg - Reads a sound register.
+ *
+ */
+unsigned char sound_read_reg( Gameboy_t *gb, unsigned int reg ) {
+	return gb->Memory.IORegs[ reg ] | SoundReadMask[ reg - IO_REG_NR10 ];
+}
+
+/*
+ * sound_write_reg - Writes one of the registers NR10 - NR51.
+ *
+ * The registers can't be written while the sound circuits are off.
+ *
+ */
+void sound_write_reg( Gameboy_t *gb, unsigned int reg, unsigned char value ) {
+	if(gb->Memory.IORegs[IO_REG_NR52] & NR52_POWER)
+		gb->Memory.IORegs[ reg ] = value;
+}
+
+/*
+ * sound_write_nr52 - Writes the NR52 register.
+ *
+ * Only the power bit can be written, the lower 4 bits tell which
+ *	channels are playing. Turning the sound circuits off clears all
+ *	sound registers.
+ *
+ */
+void sound_write_nr52( Gameboy_t *gb, unsigned int reg, unsigned char value ) {
+	unsigned int i;
+
+	if(!(value & NR52_POWER)) {
+		for(i = IO_REG_NR10; i < IO_REG_NR52; i++)
+			gb->Memory.IORegs[ i ] = 0;
+
+		gb->Memory.IORegs[IO_REG_NR52] = 0;
+		return;
+	}
+
+	gb->Memory.IORegs[IO_REG_NR52] |= NR52_POWER;
+}
@@ -0,0 +1,44 @@
+/*
+=================================================================
+Copyright (C) 2008 Torben Koenke
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+MA  02110-1301, USA.
+=================================================================
+*/
+
+
+#ifndef _SOUND_H_
+#define _SOUND_H_
+
+/* NR52 register bits */
+
+/* turns all sound circuits on or off */
+#define NR52_POWER			(1 << 7)
+
+/* There is no sound output. The sound registers are kept as plain storage,
+	but they read back the way the hardware's do and ignore writes while
+	the sound circuits are off */
+
+/* function declarations */
+
+void sound_register_io( Gameboy_t *gb );
+unsigned char sound_read_reg( Gameboy_t *gb, unsigned int reg );
+void sound_write_reg( Gameboy_t *gb, unsigned int reg, unsigned char value );
+void sound_write_nr52( Gameboy_t *gb, unsigned int reg, unsigned char value );
+
+extern unsigned char SoundReadMask[IO_REG_WPR - IO_REG_NR10];
+
+#endif /* _SOUND_H_ */
@@ -0,0 +1,618 @@
+/*
+=================================================================
+Copyright (C) 2008 Torben Koenke
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+MA  02110-1301, USA.
+=================================================================
+*/
+
+
+
+
+#include "gameboy.h"
+
+/*
+ * state_snapshot - Takes a snapshot of the emulated machine.
+ *
+ * @param Snapshot
+ *	A pointer to a Snapshot_t structure that receives the machine state.
+ *		The structure must be zeroed out before it is used for the first
+ *		time. The buffer is reused between snapshots and only reallocated
+ *		when the state needs a bigger one.
+ *
+ * @return
+ *	GB_EMU_OK on success, GB_EMU_ERROR if memory could not be allocated.
+ */
+int state_snapshot( Gameboy_t *gb, Snapshot_t *Snapshot ) {
+	unsigned int size = state_size(gb);
+
+	if(size > Snapshot->Capacity) {
+		free(Snapshot->Data);
+
+		if(!(Snapshot->Data = malloc(size))) {
+			Snapshot->Capacity	= 0;
+			Snapshot->Size		= 0;
+			return GB_EMU_ERROR;
+		}
+		Snapshot->Capacity = size;
+	}
+
+	Snapshot->Size = size;
+
+	return state_save(gb, Snapshot->Data);
+}
+
+/*
+ * state_restore - Restores a snapshot of the emulated machine.
+ *
+ * @param Snapshot
+ *	A pointer to a Snapshot_t structure filled in by state_snapshot while
+ *		the current cartridge was loaded.
+ *
+ * @return
+ *	GB_EMU_OK on success, GB_EMU_ERROR if the snapshot doesn't belong to
+ *		the current cartridge.
+ */
+int state_restore( Gameboy_t *gb, Snapshot_t *Snapshot ) {
+	return state_load(gb, Snapshot->Data, Snapshot->Size);
+}
+
+/*
+ * state_free - Releases the buffer of a snapshot.
+ *
+ */
+void state_free( Snapshot_t *Snapshot ) {
+	free(Snapshot->Data);
+
+	Snapshot->Data		= NULL;
+	Snapshot->Size		= 0;
+	Snapshot->Capacity	= 0;
+}
+
+/*
+ * state_size - Returns the size of the machine's state image.
+ *
+ */
+unsigned int state_size( Gameboy_t *gb ) {
+	return STATE_HEADER_SIZE +
+		STATE_CHUNK_HEADER + STATE_CART_SIZE +
+		STATE_CHUNK_HEADER + STATE_CPU_SIZE +
+		STATE_CHUNK_HEADER + STATE_MEM_SIZE +
+		STATE_CHUNK_HEADER + gb->Map.NumRAMBanks * 0x2000 +
+		STATE_CHUNK_HEADER + STATE_TIMER_SIZE +
+		STATE_CHUNK_HEADER + STATE_MISC_SIZE +
+		STATE_CHUNK_HEADER + STATE_MBC_SIZE;
+}
+
+/*
+ * state_save - Saves the state of the emulated machine.
+ *
+ * @param data
+ *	A pointer to a buffer of at least state_size bytes that receives
+ *		the state image.
+ *
+ * @return
+ *	GB_EMU_OK on success, GB_EMU_ERROR if no cartridge is loaded.
+ */
+int state_save( Gameboy_t *gb, unsigned char *data ) {
+	unsigned char *p = data;
+	unsigned int i, size;
+
+	if(!gb->Map.ROM0)
+		return GB_EMU_ERROR;
+
+	memcpy(p, STATE_MAGIC, 4);
+	p = state_put16(p + 4, STATE_VERSION);
+	p = state_put16(p, 0);
+
+	/* title and global checksum from the cartridge header */
+	memcpy(p, STATE_CHUNK_CART, 4);
+	p = state_put32(p + 4, STATE_CART_SIZE);
+	memcpy(p, gb->Map.ROM0 + 0x134, 16);
+	memcpy(p + 16, gb->Map.ROM0 + 0x14E, 2);
+	p = state_put32(p + 18, gb->Map.NumROMBanks);
+	p = state_put32(p, gb->Map.NumRAMBanks);
+	*p++ = gb->Map.MBC;
+
+	memcpy(p, STATE_CHUNK_CPU, 4);
+	p = state_put32(p + 4, STATE_CPU_SIZE);
+	p = state_save_cpu(gb, p);
+
+	memcpy(p, STATE_CHUNK_MEM, 4);
+	p = state_put32(p + 4, STATE_MEM_SIZE);
+	*p++ = gb->Memory.IE;
+	memcpy(p, gb->Memory.RAM1, 0x7F);		p += 0x7F;
+	memcpy(p, gb->Memory.IORegs, 0x4C);		p += 0x4C;
+	memcpy(p, gb->Memory.OAM, 0xA0);		p += 0xA0;
+	memcpy(p, gb->Memory.RAM0, 0x2000);		p += 0x2000;
+	memcpy(p, gb->Memory.VRAM, 0x2000);		p += 0x2000;
+	p = state_put32(p, gb->Map.ROMBankSelect);
+	p = state_put32(p, gb->Map.RAMBankSelect);
+	p = state_put32(p, gb->Map.MBCMode);
+
+	size = gb->Map.NumRAMBanks * 0x2000;
+
+	memcpy(p, STATE_CHUNK_SRAM, 4);
+	p = state_put32(p + 4, size);
+
+	for(i = 0; i < gb->Map.NumRAMBanks * MEM_BANK_PAGES; i++,
+		p += MEM_PAGE_SIZE)
+		memcpy(p, gb->Map.RAMPages[ i ]->Data, MEM_PAGE_SIZE);
+
+	memcpy(p, STATE_CHUNK_TIMER, 4);
+	p = state_put32(p + 4, STATE_TIMER_SIZE);
+	p = state_save_timer(gb, p);
+
+	memcpy(p, STATE_CHUNK_MISC, 4);
+	p = state_put32(p + 4, STATE_MISC_SIZE);
+	p = state_save_misc(gb, p);
+
+	memcpy(p, STATE_CHUNK_MBC, 4);
+	p = state_put32(p + 4, STATE_MBC_SIZE);
+	state_save_mbc(gb, p);
+
+	return GB_EMU_OK;
+}
+
+/*
+ * state_save_cpu - Stores the contents of the CPU chunk.
+ *
+ * @return
+ *	A pointer to the byte following the contents.
+ */
+unsigned char *state_save_cpu( Gameboy_t *gb, unsigned char *p ) {
+	p = state_put16(p, gb->CPU.pc);
+	p = state_put16(p, gb->CPU.sp);
+	p = state_put16(p, gb->CPU.u_af.AF);
+	p = state_put16(p, gb->CPU.u_bc.BC);
+	p = state_put16(p, gb->CPU.u_de.DE);
+	p = state_put16(p, gb->CPU.u_hl.HL);
+	*p++ = gb->CPU.IFF;
+
+	return state_put32(p, gb->CPU.cycles);
+}
+
+/*
+ * state_save_timer - Stores the contents of the TIMR chunk.
+ *
+ * @return
+ *	A pointer to the byte following the contents.
+ */
+unsigned char *state_save_timer( Gameboy_t *gb, unsigned char *p ) {
+	p = state_put32(p, gb->Timer.DivBase);
+	p = state_put32(p, gb->Timer.TimaTicks);
+	p = state_put32(p, gb->Timer.Event);
+	*p++ = gb->Timer.TimaValue;
+	*p++ = gb->Timer.Armed;
+	*p++ = gb->Timer.Pending;
+
+	return p;
+}
+
+/*
+ * state_save_misc - Stores the contents of the MISC chunk.
+ *
+ * @return
+ *	A pointer to the byte following the contents.
+ */
+unsigned char *state_save_misc( Gameboy_t *gb, unsigned char *p ) {
+	unsigned int i;
+
+	for(i = 0; i < CNT_NUM_CNT; i++)
+		p = state_put32(p, gb->Counters[ i ]);
+
+	p = state_put32(p, gb->Cycles);
+	*p++ = gb->Joypad.Buttons;
+
+	return state_put32(p, gb->Screen.WndLine);
+}
+
+/*
+ * state_save_mbc - Stores the contents of the MBC chunk.
+ *
+ * The bank selects are part of the MEM chunk, this holds the state
+ *	only some memory bank controllers have, i.e. the RAM enable and the
+ *	clock of MBC3 cartridges.
+ *
+ * @return
+ *	A pointer to the byte following the contents.
+ */
+unsigned char *state_save_mbc( Gameboy_t *gb, unsigned char *p ) {
+	*p++ = gb->Map.RAMEnable;
+
+	memcpy(p, gb->RTC.Regs, RTC_NUM_REGS);		p += RTC_NUM_REGS;
+	memcpy(p, gb->RTC.Latched, RTC_NUM_REGS);	p += RTC_NUM_REGS;
+	*p++ = gb->RTC.Latch;
+	p = state_put32(p, gb->RTC.Cycle);
+	p = state_put32(p, gb->RTC.Rem);
+
+	return state_put32(p, gb->RTC.Clock);
+}
+
+/*
+ * state_load - Restores the state of the emulated machine.
+ *
+ * The image is checked before anything is touched, so the machine is
+ *	left as it was if the state can't be restored.
+ *
+ * @param data
+ *	A pointer to a state image as created by state_save.
+ * @param size
+ *	Size of the image, in bytes.
+ *
+ * @return
+ *	GB_EMU_OK on success, GB_EMU_ERROR if the image is not a valid state,
+ *		was made by a newer version of the emulator or doesn't belong to
+ *		the cartridge that is loaded.
+ */
+int state_load( Gameboy_t *gb, unsigned char *data, unsigned int size ) {
+	unsigned char *cart, *cpu, *mem, *sram, *timer, *misc, *mbc, *p;
+	unsigned int i, len[7], rom, ram;
+
+	if(!gb->Map.ROM0 || !data || size < STATE_HEADER_SIZE)
+		return GB_EMU_ERROR;
+
+	if(memcmp(data, STATE_MAGIC, 4) ||
+		state_get16(data + 4) > STATE_VERSION)
+		return GB_EMU_ERROR;
+
+	/* all chunks must be present and at least as large as we expect */
+	cart	= state_chunk(data, size, STATE_CHUNK_CART, &len[0]);
+	cpu		= state_chunk(data, size, STATE_CHUNK_CPU, &len[1]);
+	mem		= state_chunk(data, size, STATE_CHUNK_MEM, &len[2]);
+	sram	= state_chunk(data, size, STATE_CHUNK_SRAM, &len[3]);
+	timer	= state_chunk(data, size, STATE_CHUNK_TIMER, &len[4]);
+	misc	= state_chunk(data, size, STATE_CHUNK_MISC, &len[5]);
+
+	if(!cart || !cpu || !mem || !sram || !timer || !misc)
+		return GB_EMU_ERROR;
+
+	/* older states saved before the MBC chunk was added don't have it
+		and older MBC chunks end before the clock. A missing or short
+		chunk in a newer state means the image is damaged */
+	mbc = state_chunk(data, size, STATE_CHUNK_MBC, &len[6]);
+
+	if(state_get16(data + 4) >= STATE_VERSION_MBC) {
+		if(!mbc || len[6] < STATE_MBC_SIZE)
+			return GB_EMU_ERROR;
+	}
+	else if(mbc && len[6] < STATE_MBC_SIZE_OLD)
+		return GB_EMU_ERROR;
+
+	if(len[0] < STATE_CART_SIZE || len[1] < STATE_CPU_SIZE ||
+		len[2] < STATE_MEM_SIZE || len[4] < STATE_TIMER_SIZE ||
+		len[5] < STATE_MISC_SIZE)
+		return GB_EMU_ERROR;
+
+	/* make sure the state was saved with this cartridge */
+	if(memcmp(cart, gb->Map.ROM0 + 0x134, 16) ||
+		memcmp(cart + 16, gb->Map.ROM0 + 0x14E, 2) ||
+		state_get32(cart + 18) != gb->Map.NumROMBanks ||
+		state_get32(cart + 22) != gb->Map.NumRAMBanks ||
+		cart[26] != gb->Map.MBC)
+		return GB_EMU_ERROR;
+
+	if(len[3] < gb->Map.NumRAMBanks * 0x2000)
+		return GB_EMU_ERROR;
+
+	/* any bank select is fine, mem_map_rom wraps selects beyond the end
+		of ROM and RAM banks that don't exist read as 0 */
+	p	= mem + 1 + 0x7F + 0x4C + 0xA0 + 0x2000 + 0x2000;
+	rom	= state_get32(p);
+	ram	= state_get32(p + 4);
+
+	/* RAM pages shared with a forked machine are about to be written */
+	for(i = 0; i < gb->Map.NumRAMBanks * MEM_BANK_PAGES; i++) {
+		if(!mem_page_unshare(&gb->Map.RAMPages[ i ]))
+			return GB_EMU_ERROR;
+	}
+
+	gb->CPU.pc		= state_get16(cpu);
+	gb->CPU.sp		= state_get16(cpu + 2);
+	gb->CPU.u_af.AF	= state_get16(cpu + 4);
+	gb->CPU.u_bc.BC	= state_get16(cpu + 6);
+	gb->CPU.u_de.DE	= state_get16(cpu + 8);
+	gb->CPU.u_hl.HL	= state_get16(cpu + 10);
+	gb->CPU.IFF		= cpu[12];
+	gb->CPU.cycles	= state_get32(cpu + 13);
+
+	gb->Memory.IE = *mem++;
+	memcpy(gb->Memory.RAM1, mem, 0x7F);		mem += 0x7F;
+	memcpy(gb->Memory.IORegs, mem, 0x4C);	mem += 0x4C;
+	memcpy(gb->Memory.OAM, mem, 0xA0);		mem += 0xA0;
+	memcpy(gb->Memory.RAM0, mem, 0x2000);	mem += 0x2000;
+	memcpy(gb->Memory.VRAM, mem, 0x2000);	mem += 0x2000;
+
+	gb->Map.ROMBankSelect	= rom;
+	gb->Map.RAMBankSelect	= ram;
+	gb->Map.MBCMode			= state_get32(mem + 8);
+	gb->Map.RAMEnable		= mbc ? mbc[0] : 1;
+
+	if(mbc && len[6] >= STATE_MBC_SIZE) {
+		mbc++;
+		memcpy(gb->RTC.Regs, mbc, RTC_NUM_REGS);	mbc += RTC_NUM_REGS;
+		memcpy(gb->RTC.Latched, mbc, RTC_NUM_REGS);	mbc += RTC_NUM_REGS;
+		gb->RTC.Latch	= *mbc++;
+		gb->RTC.Cycle	= state_get32(mbc);
+		gb->RTC.Rem		= state_get32(mbc + 4);
+		gb->RTC.Clock	= state_get32(mbc + 8);
+	}
+
+	for(i = 0; i < gb->Map.NumRAMBanks * MEM_BANK_PAGES; i++) {
+		memcpy(gb->Map.RAMPages[ i ]->Data, sram + i * MEM_PAGE_SIZE,
+			MEM_PAGE_SIZE);
+		gb->Map.RAMPages[ i ]->Hashed = 0;
+	}
+
+	/* point SROM and SRAM at the selected banks */
+	mem_map_banks(gb);
+
+	/* memory no longer matches the pool state the machine was reset to,
+		nor any checkpoint taken of it */
+	gb->ResetFrom = 0;
+	mem_touch_all(gb);
+
+	gb->Timer.DivBase	= state_get32(timer);
+	gb->Timer.TimaTicks	= state_get32(timer + 4);
+	gb->Timer.Event		= state_get32(timer + 8);
+	gb->Timer.TimaValue	= timer[12];
+	gb->Timer.Armed		= timer[13];
+	gb->Timer.Pending	= timer[14];
+
+	for(i = 0; i < CNT_NUM_CNT; i++, misc += 4)
+		gb->Counters[ i ] = (int) state_get32(misc);
+
+	gb->Cycles			= (s32) state_get32(misc);
+	gb->Joypad.Buttons	= misc[4];
+	gb->Screen.WndLine	= (int) state_get32(misc + 5);
+
+	return GB_EMU_OK;
+}
+
+/*
+ * state_checkpoint - Brings a checkpoint up to date with the machine.
+ *
+ * The first checkpoint taken of a machine saves the whole state. After
+ *	that only the 256 byte blocks of internal RAM and the pages of
+ *	cartridge RAM that were written since the last checkpoint are copied,
+ *	along with the registers. Cartridge RAM is found out about through
+ *	copy-on-write: the checkpoint holds on to the pages it has copied, so
+ *	the machine gets a page of its own the first time it writes to one.
+ *
+ * @param Checkpoint
+ *	A pointer to a Checkpoint_t structure, zeroed out before first use.
+ *
+ * @return
+ *	GB_EMU_OK on success, GB_EMU_ERROR if memory could not be allocated.
+ */
+int state_checkpoint( Gameboy_t *gb, Checkpoint_t *Checkpoint ) {
+	unsigned char *p, *sram;
+	unsigned int i, len, num = gb->Map.NumRAMBanks * MEM_BANK_PAGES;
+
+	mem_collect_dirty(gb);
+
+	if(Checkpoint->Machine != gb || Checkpoint->NumPages != num ||
+		Checkpoint->State.Size != state_size(gb)) {
+		state_checkpoint_free(Checkpoint);
+
+		if(num && !(Checkpoint->Pages = malloc(num * sizeof(MemPage_t*))))
+			return GB_EMU_ERROR;
+
+		if(GB_EMU_ERROR == state_snapshot(gb, &Checkpoint->State)) {
+			state_checkpoint_free(Checkpoint);
+			return GB_EMU_ERROR;
+		}
+
+		for(i = 0; i < num; i++) {
+			Checkpoint->Pages[ i ] = gb->Map.RAMPages[ i ];
+			host_add(&Checkpoint->Pages[ i ]->Refs, 1);
+		}
+
+		Checkpoint->Machine		= gb;
+		Checkpoint->NumPages	= num;
+	}
+	else {
+		p = state_chunk(Checkpoint->State.Data, Checkpoint->State.Size,
+			STATE_CHUNK_CPU, &len);
+		state_save_cpu(gb, p);
+
+		/* I/O registers are written by the video hardware and the timer
+			as well, so they are copied every time */
+		p = state_chunk(Checkpoint->State.Data, Checkpoint->State.Size,
+			STATE_CHUNK_MEM, &len);
+		*p++ = gb->Memory.IE;
+		memcpy(p, gb->Memory.RAM1, 0x7F);		p += 0x7F;
+		memcpy(p, gb->Memory.IORegs, 0x4C);		p += 0x4C;
+
+		mem_copy_blocks(p + 0xA0 + 0x2000, p + 0xA0, p, &gb->Memory,
+			gb->CheckDirty);
+		p += 0xA0 + 0x2000 + 0x2000;
+
+		p = state_put32(p, gb->Map.ROMBankSelect);
+		p = state_put32(p, gb->Map.RAMBankSelect);
+		state_put32(p, gb->Map.MBCMode);
+
+		sram = state_chunk(Checkpoint->State.Data, Checkpoint->State.Size,
+			STATE_CHUNK_SRAM, &len);
+
+		for(i = 0; i < num; i++) {
+			if(Checkpoint->Pages[ i ] == gb->Map.RAMPages[ i ])
+				continue;
+
+			memcpy(sram + i * MEM_PAGE_SIZE, gb->Map.RAMPages[ i ]->Data,
+				MEM_PAGE_SIZE);
+
+			host_add(&gb->Map.RAMPages[ i ]->Refs, 1);
+			mem_page_release(Checkpoint->Pages[ i ]);
+			Checkpoint->Pages[ i ] = gb->Map.RAMPages[ i ];
+		}
+
+		p = state_chunk(Checkpoint->State.Data, Checkpoint->State.Size,
+			STATE_CHUNK_TIMER, &len);
+		state_save_timer(gb, p);
+
+		p = state_chunk(Checkpoint->State.Data, Checkpoint->State.Size,
+			STATE_CHUNK_MISC, &len);
+		state_save_misc(gb, p);
+
+		p = state_chunk(Checkpoint->State.Data, Checkpoint->State.Size,
+			STATE_CHUNK_MBC, &len);
+		state_save_mbc(gb, p);
+	}
+
+	for(i = 0; i < MEM_DIRTY_WORDS; i++)
+		gb->CheckDirty[ i ] = 0;
+
+	return GB_EMU_OK;
+}
+
+/*
+ * state_rollback - Restores the machine to a checkpoint.
+ *
+ * @param Checkpoint
+ *	A checkpoint brought up to date with state_checkpoint.
+ *
+ * @return
+ *	GB_EMU_OK on success, GB_EMU_ERROR if the checkpoint doesn't belong
+ *		to the current cartridge or memory could not be allocated.
+ */
+int state_rollback( Gameboy_t *gb, Checkpoint_t *Checkpoint ) {
+	unsigned int i;
+
+	if(GB_EMU_ERROR == state_restore(gb, &Checkpoint->State))
+		return GB_EMU_ERROR;
+
+	if(Checkpoint->Machine != gb ||
+		Checkpoint->NumPages != gb->Map.NumRAMBanks * MEM_BANK_PAGES)
+		return GB_EMU_OK;
+
+	/* the machine matches the checkpoint again. It goes on with the pages
+		the checkpoint holds, which are the same as the copies it just got */
+	for(i = 0; i < Checkpoint->NumPages; i++) {
+		host_add(&Checkpoint->Pages[ i ]->Refs, 1);
+		mem_page_release(gb->Map.RAMPages[ i ]);
+		gb->Map.RAMPages[ i ] = Checkpoint->Pages[ i ];
+	}
+
+	mem_map_banks(gb);
+	mem_collect_dirty(gb);
+
+	for(i = 0; i < MEM_DIRTY_WORDS; i++)
+		gb->CheckDirty[ i ] = 0;
+
+	return GB_EMU_OK;
+}
+
+/*
+ * state_checkpoint_free - Releases a checkpoint.
+ *
+ */
+void state_checkpoint_free( Checkpoint_t *Checkpoint ) {
+	unsigned int i;
+
+	for(i = 0; i < Checkpoint->NumPages; i++)
+		mem_page_release(Checkpoint->Pages[ i ]);
+
+	free(Checkpoint->Pages);
+	state_free(&Checkpoint->State);
+
+	Checkpoint->Pages		= NULL;
+	Checkpoint->NumPages	= 0;
+	Checkpoint->Machine		= NULL;
+}
+
+/*
+ * state_chunk - Finds a chunk in a state image.
+ *
+ * @param data
+ *	A pointer to a state image.
+ * @param size
+ *	Size of the image, in bytes.
+ * @param tag
+ *	Tag of the chunk to look for, one of STATE_CHUNK_*.
+ * @param chunk_size
+ *	A pointer to a variable that receives the size of the chunk's
+ *		contents, in bytes.
+ *
+ * @return
+ *	A pointer to the contents of the chunk, or NULL if the image doesn't
+ *		contain the chunk or is truncated.
+ */
+unsigned char *state_chunk( unsigned char *data, unsigned int size,
+	char *tag, unsigned int *chunk_size ) {
+	unsigned int pos = STATE_HEADER_SIZE, len;
+
+	while(size - pos >= STATE_CHUNK_HEADER) {
+		len = state_get32(data + pos + 4);
+
+		if(len > size - pos - STATE_CHUNK_HEADER)
+			return NULL;
+
+		if(!memcmp(data + pos, tag, 4)) {
+			*chunk_size = len;
+			return data + pos + STATE_CHUNK_HEADER;
+		}
+
+		pos += STATE_CHUNK_HEADER + len;
+	}
+
+	return NULL;
+}
+
+/*
+ * state_put16 - Stores a 16-bit value in little-endian byte order.
+ *
+ * @return
+ *	A pointer to the byte following the value.
+ */
+unsigned char *state_put16( unsigned char *p, u16 value ) {
+	p[0] = (unsigned char) value;
+	p[1] = (unsigned char) (value >> 8);
+
+	return p + 2;
+}
+
+/*
+ * state_put32 - Stores a 32-bit value in little-endian byte order.
+ *
+ * @return
+ *	A pointer to the byte following the value.
+ */
+unsigned char *state_put32( unsigned char *p, u32 value ) {
+	p[0] = (unsigned char) value;
+	p[1] = (unsigned char) (value >> 8);
+	p[2] = (unsigned char) (value >> 16);
+	p[3] = (unsigned char) (value >> 24);
+
+	return p + 4;
+}
+
+/*
+ * state_get16 - Loads a 16-bit value stored in little-endian byte order.
+ *
+ */
+u16 state_get16( unsigned char *p ) {
+	return (u16) (p[0] | (p[1] << 8));
+}
+
+/*
+ * state_get32 - Loads a 32-bit value stored in little-endian byte order.
+ *
+ */
+u32 state_get32( unsigned char *p ) {
+	return (u32) p[0] | ((u32) p[1] << 8) | ((u32) p[2] << 16) |
+		((u32) p[3] << 24);
+}
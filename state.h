@@ -0,0 +1,118 @@
+/*
+=================================================================
+Copyright (C) 2008 Torben Koenke
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+MA  02110-1301, USA.
+=================================================================
+*/
+
+
+#ifndef _STATE_H_
+#define _STATE_H_
+
+/* Save state layout, all values little-endian:
+
+	offset	size	contents
+	0		4		STATE_MAGIC
+	4		2		STATE_VERSION
+	6		2		reserved, 0
+	8		...		chunks
+
+	Every chunk starts with a 4 character tag and the size of its contents
+	as a 32-bit value. Chunks may come in any order and unknown chunks are
+	skipped, so new chunks can be added without breaking old states. A
+	chunk may also be larger than its readers expect, new fields are added
+	at the end.
+
+	MemMap_t holds pointers into the cartridge's banks which are only
+	valid while the cartridge is loaded. States store the bank indices
+	instead and the pointers are recomputed when a state is restored,
+	see mem_map_banks. The CART chunk makes sure a state is only restored
+	with the cartridge it was saved with. */
+#define STATE_MAGIC			"GBST"
+#define STATE_VERSION		2
+
+/* first version that always writes the whole MBC chunk */
+#define STATE_VERSION_MBC	2
+#define STATE_HEADER_SIZE	8
+
+/* size of a chunk's tag and size fields */
+#define STATE_CHUNK_HEADER	8
+
+/* chunk tags */
+#define STATE_CHUNK_CART	"CART"	/* cartridge the state belongs to */
+#define STATE_CHUNK_CPU		"CPU "	/* CPU registers */
+#define STATE_CHUNK_MEM		"MEM "	/* internal RAM, I/O and bank selects */
+#define STATE_CHUNK_SRAM	"SRAM"	/* cartridge RAM banks */
+#define STATE_CHUNK_TIMER	"TIMR"	/* timer */
+#define STATE_CHUNK_MISC	"MISC"	/* counters, joypad and video */
+#define STATE_CHUNK_MBC		"MBC "	/* memory bank controller */
+
+/* sizes of the chunks' contents as written by this version */
+#define STATE_CART_SIZE		(16 + 2 + 4 + 4 + 1)
+#define STATE_CPU_SIZE		(6 * 2 + 1 + 4)
+#define STATE_MEM_SIZE		(1 + 0x7F + 0x4C + 0xA0 + 0x2000 + 0x2000 + \
+								3 * 4)
+#define STATE_TIMER_SIZE	(3 * 4 + 3)
+#define STATE_MISC_SIZE		(CNT_NUM_CNT * 4 + 4 + 1 + 4)
+#define STATE_MBC_SIZE		(1 + 2 * RTC_NUM_REGS + 1 + 3 * 4)
+
+/* size of the MBC chunk before the clock was added */
+#define STATE_MBC_SIZE_OLD	1
+
+/* A save state in memory. The same image is used for run-ahead snapshots
+	and for states written to disk */
+typedef struct {
+	unsigned char *Data;		/* state image */
+	unsigned int Size;			/* bytes used in Data */
+	unsigned int Capacity;		/* bytes allocated for Data */
+
+} Snapshot_t;
+
+/* A state image that is kept up to date incrementally, see
+	state_checkpoint. Only blocks of memory written since the last
+	checkpoint are copied into it */
+struct Checkpoint_s {
+	Snapshot_t State;			/* full state image */
+	Gameboy_t *Machine;			/* machine the image was taken of */
+	MemPage_t **Pages;			/* cartridge RAM pages copied into State */
+	unsigned int NumPages;
+
+};
+
+/* function declarations */
+
+int state_snapshot( Gameboy_t *gb, Snapshot_t *Snapshot );
+int state_restore( Gameboy_t *gb, Snapshot_t *Snapshot );
+void state_free( Snapshot_t *Snapshot );
+unsigned int state_size( Gameboy_t *gb );
+int state_save( Gameboy_t *gb, unsigned char *data );
+int state_load( Gameboy_t *gb, unsigned char *data, unsigned int size );
+unsigned char *state_save_cpu( Gameboy_t *gb, unsigned char *p );
+unsigned char *state_save_timer( Gameboy_t *gb, unsigned char *p );
+unsigned char *state_save_misc( Gameboy_t *gb, unsigned char *p );
+unsigned char *state_save_mbc( Gameboy_t *gb, unsigned char *p );
+int state_checkpoint( Gameboy_t *gb, Checkpoint_t *Checkpoint );
+int state_rollback( Gameboy_t *gb, Checkpoint_t *Checkpoint );
+void state_checkpoint_free( Checkpoint_t *Checkpoint );
+unsigned char *state_chunk( unsigned char *data, unsigned int size,
+	char *tag, unsigned int *chunk_size );
+unsigned char *state_put16( unsigned char *p, u16 value );
+unsigned char *state_put32( unsigned char *p, u32 value );
+u16 state_get16( unsigned char *p );
+u32 state_get32( unsigned char *p );
+
+#endif /* _STATE_H_ */
@@ -0,0 +1,203 @@
+/*
+=================================================================
+Copyright (C) 2008 Torben Koenke
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+MA  02110-1301, USA.
+=================================================================
+*/
+
+
+#include "gameboy.h"
+
+/* TIMA is incremented every (1 << TimerShift[TAC & TAC_CLOCK]) clock
+	cycles, i.e. at 4096, 262144, 65536 and 16384 Hz respectively */
+unsigned char TimerShift[4] = { 10, 4, 6, 8 };
+
+/*
+ * timer_reset - Resets the timer.
+ *
+ * DIV starts counting from 0 and TIMA is stopped.
+ *
+ */
+void timer_reset( Gameboy_t *gb ) {
+	gb->Timer.DivBase	= gb->CPU.cycles;
+	gb->Timer.TimaTicks	= 0;
+	gb->Timer.TimaValue	= 0;
+	gb->Timer.Armed		= 0;
+	gb->Timer.Pending	= 0;
+}
+
+/*
+ * timer_ticks - Returns the number of TIMA input clock ticks since DIV
+ *	was last reset.
+ *
+ * TIMA is clocked off the same counter as DIV, so its ticks are counted
+ *	from DivBase as well. The result wraps around with the clock cycle
+ *	counter, so only differences should be used.
+ *
+ */
+u32 timer_ticks( Gameboy_t *gb ) {
+	return (gb->CPU.cycles - gb->Timer.DivBase) >> TimerShift
+		[ gb->Memory.IORegs[IO_REG_TAC] & TAC_CLOCK ];
+}
+
+/*
+ * timer_schedule - Computes the clock cycle of the next TIMA overflow.
+ *
+ * TIMA overflows once it has been incremented (0x100 - TimaValue) times
+ *	since TimaTicks. This must be called whenever any of the timer
+ *	registers is written.
+ *
+ */
+void timer_schedule( Gameboy_t *gb ) {
+	gb->Timer.Armed = (gb->Memory.IORegs[IO_REG_TAC] & TAC_ENABLE) ?
+		1 : 0;
+
+	gb->Timer.Event = gb->Timer.DivBase + ((gb->Timer.TimaTicks +
+		0x100 - gb->Timer.TimaValue) << TimerShift[ gb->Memory.IORegs
+		[IO_REG_TAC] & TAC_CLOCK ]);
+}
+
+/*
+ * timer_update - Processes TIMA overflows up to the current clock cycle.
+ *
+ * On overflow TIMA is reloaded from TMA at the exact tick it overflowed
+ *	on and the next overflow is scheduled. The interrupt is only flagged
+ *	as pending since this may be called from within a CPU slice.
+ *
+ */
+void timer_update( Gameboy_t *gb ) {
+	while(gb->Timer.Armed && (s32)(gb->CPU.cycles -
+		gb->Timer.Event) >= 0) {
+		gb->Timer.TimaTicks = (gb->Timer.Event - gb->Timer.DivBase)
+			>> TimerShift[ gb->Memory.IORegs[IO_REG_TAC] & TAC_CLOCK ];
+		gb->Timer.TimaValue = gb->Memory.IORegs[IO_REG_TMA];
+		gb->Timer.Pending	= 1;
+
+		timer_schedule(gb);
+	}
+}
+
+/*
+ * timer_interrupt - Causes a timer interrupt.
+ *
+ * This is called once per CPU slice if the overflow event is due or an
+ *	overflow was picked up by timer_update in the meantime.
+ *
+ */
+void timer_interrupt( Gameboy_t *gb ) {
+	timer_update(gb);
+
+	gb->Memory.IORegs[IO_REG_IF] |= INT_TIMER;
+	gb->Timer.Pending = 0;
+}
+
+/*
+ * timer_register_io - Installs the handlers of the timer registers.
+ *
+ */
+void timer_register_io( Gameboy_t *gb ) {
+	mem_io_register(gb, IO_REG_DIV, timer_read_div, timer_write_div);
+	mem_io_register(gb, IO_REG_TIMA, timer_read_tima, timer_write_tima);
+	mem_io_register(gb, IO_REG_TMA, NULL, timer_write_tma);
+	mem_io_register(gb, IO_REG_TAC, NULL, timer_write_tac);
+}
+
+/*
+ * timer_read_div - Computes the value of the DIV register.
+ *
+ * DIV is incremented at 16384 Hz, i.e. every 256 clock cycles.
+ *
+ */
+unsigned char timer_read_div( Gameboy_t *gb, unsigned int reg ) {
+	return (unsigned char)((gb->CPU.cycles - gb->Timer.DivBase) >> 8);
+}
+
+/*
+ * timer_read_tima - Computes the value of the TIMA register.
+ *
+ */
+unsigned char timer_read_tima( Gameboy_t *gb, unsigned int reg ) {
+	if(!(gb->Memory.IORegs[IO_REG_TAC] & TAC_ENABLE))
+		return gb->Timer.TimaValue;
+
+	timer_update(gb);
+
+	return (unsigned char)(gb->Timer.TimaValue + timer_ticks(gb) -
+		gb->Timer.TimaTicks);
+}
+
+/*
+ * timer_write_div - Handles writes to the DIV register.
+ *
+ * Writing any value to DIV resets it to 0. Since TIMA is clocked off the
+ *	same counter, this also restarts the current TIMA tick.
+ *
+ */
+void timer_write_div( Gameboy_t *gb, unsigned int reg, unsigned char value ) {
+	gb->Timer.TimaValue	= timer_read_tima(gb, IO_REG_TIMA);
+	gb->Timer.DivBase	= gb->CPU.cycles;
+	gb->Timer.TimaTicks	= 0;
+
+	timer_schedule(gb);
+
+	/* reads are computed, the value is only kept for save states */
+	gb->Memory.IORegs[ reg ] = value;
+}
+
+/*
+ * timer_write_tima - Handles writes to the TIMA register.
+ *
+ */
+void timer_write_tima( Gameboy_t *gb, unsigned int reg, unsigned char value ) {
+	timer_update(gb);
+
+	gb->Timer.TimaValue	= value;
+	gb->Timer.TimaTicks	= timer_ticks(gb);
+
+	timer_schedule(gb);
+
+	/* reads are computed, the value is only kept for save states */
+	gb->Memory.IORegs[ reg ] = value;
+}
+
+/*
+ * timer_write_tma - Handles writes to the TMA register.
+ *
+ * TMA only matters once TIMA overflows, so all that needs to be done is
+ *	to process overflows that happened with the old value.
+ *
+ */
+void timer_write_tma( Gameboy_t *gb, unsigned int reg, unsigned char value ) {
+	timer_update(gb);
+
+	gb->Memory.IORegs[IO_REG_TMA] = value;
+}
+
+/*
+ * timer_write_tac - Handles writes to the TAC register.
+ *
+ */
+void timer_write_tac( Gameboy_t *gb, unsigned int reg, unsigned char value ) {
+	/* freeze TIMA at its current value... */
+	gb->Timer.TimaValue = timer_read_tima(gb, IO_REG_TIMA);
+
+	/* ...and carry on counting from here with the new input clock */
+	gb->Memory.IORegs[IO_REG_TAC] = value;
+	gb->Timer.TimaTicks = timer_ticks(gb);
+
+	timer_schedule(gb);
+}
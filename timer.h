@@ -0,0 +1,66 @@
+/*
+=================================================================
+Copyright (C) 2008 Torben Koenke
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+MA  02110-1301, USA.
+=================================================================
+*/
+
+
+#ifndef _TIMER_H_
+#define _TIMER_H_
+
+/* TAC register bits */
+
+/* starts or stops the timer */
+#define TAC_ENABLE			(1 << 2)
+
+/* selects one of 4 input clocks for TIMA, see TimerShift */
+#define TAC_CLOCK			0x03
+
+/* The timer is never clocked. DIV and TIMA are derived from the CPU's clock
+	cycle counter whenever they are read and the next TIMA overflow is
+	kept as a single event that is checked once per CPU slice. The event
+	only needs to be recomputed when one of the timer registers is
+	written. */
+typedef struct {
+	u32 DivBase;				/* clock cycle at which DIV was reset */
+	u32 TimaTicks;				/* tick count at which TIMA held TimaValue */
+	u32 Event;					/* clock cycle at which TIMA overflows */
+	unsigned char TimaValue;
+	unsigned char Armed;		/* Event is valid */
+	unsigned char Pending;		/* an overflow still has to cause INT_TIMER */
+
+} Timer_t;
+
+/* function declarations */
+
+void timer_reset( Gameboy_t *gb );
+void timer_schedule( Gameboy_t *gb );
+void timer_update( Gameboy_t *gb );
+void timer_interrupt( Gameboy_t *gb );
+u32 timer_ticks( Gameboy_t *gb );
+void timer_register_io( Gameboy_t *gb );
+unsigned char timer_read_div( Gameboy_t *gb, unsigned int reg );
+unsigned char timer_read_tima( Gameboy_t *gb, unsigned int reg );
+void timer_write_div( Gameboy_t *gb, unsigned int reg, unsigned char value );
+void timer_write_tima( Gameboy_t *gb, unsigned int reg, unsigned char value );
+void timer_write_tma( Gameboy_t *gb, unsigned int reg, unsigned char value );
+void timer_write_tac( Gameboy_t *gb, unsigned int reg, unsigned char value );
+
+extern unsigned char TimerShift[4];
+
+#endif /* _TIMER_H_ */
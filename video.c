@@ -21,8 +21,9 @@ MA  02110-1301, USA.
 
 #include "gameboy.h"
 
-/* the 4 shades of gray a Gameboy can display */
-static int GBColors[4] = {
+/* the 4 shades of gray a Gameboy can display. Frames only store the shade
+	index, the host maps it to an actual color when presenting the frame */
+int GBColors[4] = {
 	0xFFFFFF,
 	0xD694AD,
 	0xAD4A5A,
@@ -36,52 +37,64 @@ static int GBColors[4] = {
  * This function gets called when a HBLANK interrupt occurs.
  *	It draws the current scanline, sets up the STATUS
  *	register bits and causes VBLANK and LCDC interrupts.
+ *
+ * @return
+ *	1 if the scanline completed a frame (i.e. VBLANK was entered),
+ *		otherwise 0.
  * 
  */
-void video_do_hblank( void ) {
+int video_do_hblank( Gameboy_t *gb ) {
+	int frame = 0;
+
 	/* reset the clock cycle counter */
-	Gameboy.Counters[CNT_HBLANK] = 0;
+	gb->Counters[CNT_HBLANK] = 0;
 
 	/* increment current scanline */
-	Gameboy.Memory.IORegs[IO_REG_LY]++;
+	gb->Memory.IORegs[IO_REG_LY]++;
 
-	if(Gameboy.Memory.IORegs[IO_REG_LY] > 153)
-		Gameboy.Memory.IORegs[IO_REG_LY] = 0;
+	if(gb->Memory.IORegs[IO_REG_LY] > 153)
+		gb->Memory.IORegs[IO_REG_LY] = 0;
 	
-	if(Gameboy.Memory.IORegs[IO_REG_LY] >= 144) {
+	if(gb->Memory.IORegs[IO_REG_LY] >= 144) {
 		/* it's the VBLANK period, so set the VBLANK mode bit */
-		Gameboy.Memory.IORegs[IO_REG_STAT] |= STAT_VBLANK;
+		gb->Memory.IORegs[IO_REG_STAT] |= STAT_VBLANK;
 
 		/* cause a VBLANK interrupt */
-		if(Gameboy.Memory.IORegs[IO_REG_LY] == 144) {
-			Gameboy.Memory.IORegs[IO_REG_IF] |= INT_VBLANK;
-
-			/* blit to screen */
-			host_blt();
+		if(gb->Memory.IORegs[IO_REG_LY] == 144) {
+			gb->Memory.IORegs[IO_REG_IF] |= INT_VBLANK;
+
+			/* hand the frame over to the presentation thread, unless we
+				are fast-forwarding or the frame is never shown */
+			if(!gb->Turbo && !gb->RenderSkip)
+				video_publish_frame(gb);
+			frame = 1;
 		}
 	}
 	else {
 		/* reset the VBLANK mode bit */
-		Gameboy.Memory.IORegs[IO_REG_STAT] &= ~STAT_VBLANK;
+		gb->Memory.IORegs[IO_REG_STAT] &= ~STAT_VBLANK;
 
 		/* draw the current scanline */
-		video_draw_scanline(Gameboy.Memory.IORegs[IO_REG_LY]);
+		if(!gb->RenderSkip)
+			video_draw_scanline(gb, gb->Memory.IORegs[IO_REG_LY]);
 	}
 
 	/* set coincidence bit of STATUS register if LYC and LY
 		registers are equal */
-	if(Gameboy.Memory.IORegs[IO_REG_LYC] == Gameboy.Memory.IORegs
+	if(gb->Memory.IORegs[IO_REG_LYC] == gb->Memory.IORegs
 		[IO_REG_LY]) {
-		Gameboy.Memory.IORegs[IO_REG_STAT] |= STAT_COIN;
+		gb->Memory.IORegs[IO_REG_STAT] |= STAT_COIN;
 
 		/* if coincidence select bit is on, cause an LCDC interrupt */
-		if(Gameboy.Memory.IORegs[IO_REG_STAT] & STAT_COIN_SELECT )
-			Gameboy.Memory.IORegs[IO_REG_IF] |= INT_LCDC;
+		if(gb->Memory.IORegs[IO_REG_STAT] & STAT_COIN_SELECT )
+			gb->Memory.IORegs[IO_REG_IF] |= INT_LCDC;
 	}
 	else {
 		/* reset coincidence bit of STATUS register */
-		Gameboy.Memory.IORegs[IO_REG_STAT] &= ~STAT_COIN;
+		gb->Memory.IORegs[IO_REG_STAT] &= ~STAT_COIN;
 	}
+
+	return frame;
 }
 
 /*
@@ -93,24 +106,24 @@ void video_do_hblank( void ) {
  *	a linear graphics framebuffer.
  *
  */
-void video_draw_scanline( unsigned char scanline ) {
+void video_draw_scanline( Gameboy_t *gb, unsigned char scanline ) {
 	/* don't draw anything if display is disabled */
-	if(!(Gameboy.Memory.IORegs[IO_REG_LCDC] & LCD_ENABLE))
+	if(!(gb->Memory.IORegs[IO_REG_LCDC] & LCD_ENABLE))
 		return;
 
 	/* draw window and background if they are enabled */
-	if(Gameboy.Memory.IORegs[IO_REG_LCDC] & LCD_ENABLE_BGWND) {
+	if(gb->Memory.IORegs[IO_REG_LCDC] & LCD_ENABLE_BGWND) {
 		/* draw the background portion */
-		video_draw_background(scanline);
+		video_draw_background(gb, scanline);
 
 		/* window can be disabled seperately */
-	//	if(Gameboy.Memory.IORegs[IO_REG_LCDC] & LCD_ENABLE_WND)
-	//		video_draw_window(scanline);
+	//	if(gb->Memory.IORegs[IO_REG_LCDC] & LCD_ENABLE_WND)
+	//		video_draw_window(gb, scanline);
 	}
 
 	/* draw sprites */
-	if(Gameboy.Memory.IORegs[IO_REG_LCDC] & LCD_ENABLE_OBJ)
-		video_draw_sprites(scanline);
+	if(gb->Memory.IORegs[IO_REG_LCDC] & LCD_ENABLE_OBJ)
+		video_draw_sprites(gb, scanline);
 }
 
 /*
@@ -120,26 +133,25 @@ void video_draw_scanline( unsigned char scanline ) {
  *	overlays the background and none of its tiles are ever transparent.
  *
  */
-void video_draw_window( unsigned char scanline ) {
+void video_draw_window( Gameboy_t *gb, unsigned char scanline ) {
 	unsigned char *Tiledata, *Tilemap, *Tile, TileIndex, is_signed, line;
 	int i, y_offset, x_offset;
-	static int wndline;
 
 	/* is window even visible? */
-	if(Gameboy.Memory.IORegs[IO_REG_WY] >= 144 || Gameboy.Memory.IORegs
+	if(gb->Memory.IORegs[IO_REG_WY] >= 144 || gb->Memory.IORegs
 		[IO_REG_WX] >= 166)
 		return;
 	
 	/* window is below current scanline */
-	if(Gameboy.Memory.IORegs[IO_REG_WY] > scanline)
+	if(gb->Memory.IORegs[IO_REG_WY] > scanline)
 		return;
 
 	/* figure out which tiledata to use for the window */
-	if(Gameboy.Memory.IORegs[IO_REG_LCDC] & LCD_TILEDATA) {
+	if(gb->Memory.IORegs[IO_REG_LCDC] & LCD_TILEDATA) {
 		/* use the tiledata array in VRAM from 0x8000 to 0x8FFF. The
 			indeces in the tilemap array will be treated as unsigned values
 			from 0 to 255. */
-		Tiledata	= &Gameboy.Memory.VRAM[0x0000];
+		Tiledata	= &gb->Memory.VRAM[0x0000];
 		is_signed	= 0;
 	} else {
 		/* use the tiledata at 0x8800 to 0x97FF. The indeces in the
@@ -149,28 +161,28 @@ void video_draw_window( unsigned char scanline ) {
 				0x9000 + (-128 * 16) = 0x8800
 				0x9000 + (+127 * 16) = 0x97F0
 		*/
-		Tiledata	= &Gameboy.Memory.VRAM[0x1000];
+		Tiledata	= &gb->Memory.VRAM[0x1000];
 		is_signed	= 1;
 	}
 
 	/* figure out which tilemap to use for the window */
-	if(Gameboy.Memory.IORegs[IO_REG_LCDC] & LCD_TILEMAP_WND) {
+	if(gb->Memory.IORegs[IO_REG_LCDC] & LCD_TILEMAP_WND) {
 		/* use tilemap at 0x9C00 */
-		Tilemap = &Gameboy.Memory.VRAM[0x1C00];
+		Tilemap = &gb->Memory.VRAM[0x1C00];
 	} else {
 		/* use tilemap at 0x9800 */
-		Tilemap = &Gameboy.Memory.VRAM[0x1800];
+		Tilemap = &gb->Memory.VRAM[0x1800];
 	}
 
 	/* reset current window line after VBLANK */
-	if(Gameboy.Memory.IORegs[IO_REG_LY] == 0)
-		wndline = 0;
+	if(gb->Memory.IORegs[IO_REG_LY] == 0)
+		gb->Screen.WndLine = 0;
 
 	/* a tile is 8x8 pixels */
 	for(i = 0; i < 160; i += 8) {
 		/* retrieve the index into the tiledata array from the tilemap
 			array */
-		TileIndex = Tilemap[ (wndline >> 3) * 32 + (i >> 3) ];
+		TileIndex = Tilemap[ (gb->Screen.WndLine >> 3) * 32 + (i >> 3) ];
 
 		if(is_signed) {
 			/* TileIndex is treated as a signed offset */
@@ -183,7 +195,7 @@ void video_draw_window( unsigned char scanline ) {
 		/* Tile now points to the actual tiledata in VRAM. Now get to the
 			Y offset within the tile graphic corresponding to the
 			current windowline. */
-		Tile = Tile + (wndline % 8) * 2;
+		Tile = Tile + (gb->Screen.WndLine % 8) * 2;
 
 		/* draw this line from the tile */
 		for(line = 0; line < 8; line++) {
@@ -195,18 +207,18 @@ void video_draw_window( unsigned char scanline ) {
 			unsigned char c	 = (b2 << 1) | b1;
 
 			/* IO_REG_BGP contains the palette data for window also */
-			y_offset = (wndline + Gameboy.Memory.IORegs[IO_REG_WY]) * 160;
+			y_offset = (gb->Screen.WndLine + gb->Memory.IORegs[IO_REG_WY]) * 160;
 			x_offset = i + line;
 
 			/* IO_REG_WX is the offset from absolute screen coordinates by 7 */
-			if(Gameboy.Memory.IORegs[IO_REG_WX])
-				x_offset = x_offset + Gameboy.Memory.IORegs[IO_REG_WX] - 7;
+			if(gb->Memory.IORegs[IO_REG_WX])
+				x_offset = x_offset + gb->Memory.IORegs[IO_REG_WX] - 7;
 
-			host_plot( y_offset + x_offset, GBColors[ Gameboy.Memory.IORegs
-				[IO_REG_BGP] >> (c * 2) & 0x03 ]);
+			VIDEO_BACK_BUFFER[ y_offset + x_offset ] = gb->Memory.IORegs
+				[IO_REG_BGP] >> (c * 2) & 0x03;
 		}
 	}
-	wndline++;
+	gb->Screen.WndLine++;
 }
 
 /*
@@ -219,17 +231,17 @@ void video_draw_window( unsigned char scanline ) {
  *	Inspired by gbe by Chuck Mason and Steven Fuller.
  *
  */
-void video_draw_background( unsigned char scanline ) {
+void video_draw_background( Gameboy_t *gb, unsigned char scanline ) {
 	unsigned char *Tiledata, *Tilemap, *Tile, is_signed, TileIndex,
 					line, StartX, StartY, left;
 	int i;
 
 	/* figure out which tiledata to use for the background */
-	if(Gameboy.Memory.IORegs[IO_REG_LCDC] & LCD_TILEDATA) {
+	if(gb->Memory.IORegs[IO_REG_LCDC] & LCD_TILEDATA) {
 		/* use the tiledata array in VRAM from 0x8000 to 0x8FFF. The
 			indeces in the tilemap array will be treated as unsigned values
 			from 0 to 255. */
-		Tiledata	= &Gameboy.Memory.VRAM[0x0000];
+		Tiledata	= &gb->Memory.VRAM[0x0000];
 		is_signed	= 0;
 	} else {
 		/* use the tiledata at 0x8800 to 0x97FF. The indeces in the
@@ -239,17 +251,17 @@ void video_draw_background( unsigned char scanline ) {
 				0x9000 + (-128 * 16) = 0x8800
 				0x9000 + (+127 * 16) = 0x97F0
 		*/
-		Tiledata	= &Gameboy.Memory.VRAM[0x1000];
+		Tiledata	= &gb->Memory.VRAM[0x1000];
 		is_signed	= 1;
 	}
 
 	/* figure out which tilemap to use for the background */
-	if(Gameboy.Memory.IORegs[IO_REG_LCDC] & LCD_TILEMAP_BG) {
+	if(gb->Memory.IORegs[IO_REG_LCDC] & LCD_TILEMAP_BG) {
 		/* use tilemap at 0x9C00 */
-		Tilemap = &Gameboy.Memory.VRAM[0x1C00];
+		Tilemap = &gb->Memory.VRAM[0x1C00];
 	} else {
 		/* use tilemap at 0x9800 */
-		Tilemap = &Gameboy.Memory.VRAM[0x1800];
+		Tilemap = &gb->Memory.VRAM[0x1800];
 	}
 	
 	/* at any time there will be at least (160/8 = 20) tiles displayed
@@ -262,8 +274,8 @@ void video_draw_background( unsigned char scanline ) {
 	for(i = 0; i < 160; i += 8) {
 		/* these are bytes so they will overflow if they get bigger than 255
 			and so account for the wrap around effect of the background */
-		StartX = Gameboy.Memory.IORegs[IO_REG_SCX] + i;
-		StartY = Gameboy.Memory.IORegs[IO_REG_SCY] + scanline;
+		StartX = gb->Memory.IORegs[IO_REG_SCX] + i;
+		StartY = gb->Memory.IORegs[IO_REG_SCY] + scanline;
 
 		/* retrieve the index into the tiledata array from the tilemap
 			array */
@@ -292,8 +304,8 @@ void video_draw_background( unsigned char scanline ) {
 			unsigned char c	 = (b2 << 1) | b1;
 
 			/* IO_REG_BGP contains the palette data */
-			host_plot(scanline * 160 + i + line, GBColors[ (Gameboy.Memory.IORegs
-				[IO_REG_BGP] >> (c * 2)) & 0x03 ]);
+			VIDEO_BACK_BUFFER[ scanline * 160 + i + line ] = (gb->Memory.IORegs
+				[IO_REG_BGP] >> (c * 2)) & 0x03;
 
 			/* if IO_REG_SCX is not a multiple of 8, an odd number of tiles will
 				need to be displayed, so figure out how many pixels of the first tile
@@ -309,7 +321,7 @@ void video_draw_background( unsigned char scanline ) {
 			}
 			/* last tile is only drawn partially if IO_REG_SCX is not a multiple
 				of 8 */
-			if(Gameboy.Memory.IORegs[IO_REG_SCX] % 8) {
+			if(gb->Memory.IORegs[IO_REG_SCX] % 8) {
 				if( i > 152 && line >= left )
 					break;
 			}
@@ -321,15 +333,15 @@ void video_draw_background( unsigned char scanline ) {
  * video_draw_sprites - Draws sprites that are within a scanline.
  *
  */
-void video_draw_sprites( unsigned char scanline ) {
+void video_draw_sprites( Gameboy_t *gb, unsigned char scanline ) {
 	unsigned char *OAM, *Tile, Height, Attr, Index, i, x, y, Offset, line,
 					wbit, b1, b2, c, Palette;
 
 	/* point to the end of object attribute memory */
-	OAM = &Gameboy.Memory.OAM[0xA0];
+	OAM = &gb->Memory.OAM[0xA0];
 
 	/* sprites are either 8x8 or 8x16 pixels */
-	if(Gameboy.Memory.IORegs[IO_REG_LCDC] & LCD_OBJ_SIZE)
+	if(gb->Memory.IORegs[IO_REG_LCDC] & LCD_OBJ_SIZE)
 		Height = 16;
 	else
 		Height = 8;
@@ -374,7 +386,7 @@ void video_draw_sprites( unsigned char scanline ) {
 
 		/* sprite tile data is located at the very beginning of VRAM at
 			0x8000 */
-		Tile = &Gameboy.Memory.VRAM[ Index * 16 ];
+		Tile = &gb->Memory.VRAM[ Index * 16 ];
 
 		/* sprite is flipped vertically so read from tiledata backwards */
 		if(Attr & SPRITE_FLIP_Y)
@@ -384,9 +396,9 @@ void video_draw_sprites( unsigned char scanline ) {
 														sprite */
 		/* figure out which color palette to use */
 		if(Attr & SPRITE_OBJ1PAL)
-			Palette = Gameboy.Memory.IORegs[IO_REG_OBP1];
+			Palette = gb->Memory.IORegs[IO_REG_OBP1];
 		else
-			Palette = Gameboy.Memory.IORegs[IO_REG_OBP0];
+			Palette = gb->Memory.IORegs[IO_REG_OBP0];
 
 		/* draw the line of the sprite */
 		for(line = Offset; line < 8; line++) {
@@ -403,8 +415,86 @@ void video_draw_sprites( unsigned char scanline ) {
 
 			/* 0 means transparency */
 			if(c != 0)
-				host_plot(scanline * 160 + x + line, GBColors[ (Palette >> (c * 2))
-							& 0x03 ]);
+				VIDEO_BACK_BUFFER[ scanline * 160 + x + line ] = (Palette >> (c * 2))
+							& 0x03;
 		}
 	}
 }
+
+/*
+ * video_publish_frame - Hands a completed frame to the presentation thread.
+ *
+ * Frames are passed on through a triple buffer. The emulation thread
+ *	draws into the back buffer and, once the frame is complete, swaps it
+ *	with the middle buffer. The presentation thread swaps the middle
+ *	buffer with the front buffer whenever it finds a fresh frame in it.
+ *	Neither side ever waits for the other.
+ *
+ */
+void video_publish_frame( Gameboy_t *gb ) {
+	gb->Screen.Back = host_xchg(&gb->Screen.Middle, gb->Screen.Back
+		| FRAME_FRESH) & FRAME_INDEX;
+}
+
+/*
+ * video_latest_frame - Retrieves the most recently completed frame.
+ *
+ * This is called from the presentation thread.
+ *
+ * @return
+ *	A pointer to the most recent frame if a new frame has been completed
+ *		since the last call, otherwise NULL.
+ */
+unsigned char *video_latest_frame( Gameboy_t *gb ) {
+	if(!(gb->Screen.Middle & FRAME_FRESH))
+		return NULL;
+
+	gb->Screen.Front = host_xchg(&gb->Screen.Middle, gb->Screen.Front)
+		& FRAME_INDEX;
+
+	return gb->Screen.Frames[ gb->Screen.Front ];
+}
+
+/*
+ * video_register_io - Installs the handlers of the LCD registers.
+ *
+ * The other LCD registers are plain storage, they are read by the
+ *	scanline drawing code as it needs them.
+ *
+ */
+void video_register_io( Gameboy_t *gb ) {
+	mem_io_register(gb, IO_REG_STAT, video_read_stat, video_write_stat);
+	mem_io_register(gb, IO_REG_LY, NULL, video_write_ly);
+}
+
+/*
+ * video_read_stat - Reads the STAT register.
+ *
+ * Bit 7 is not used and reads as 1.
+ *
+ */
+unsigned char video_read_stat( Gameboy_t *gb, unsigned int reg ) {
+	return gb->Memory.IORegs[IO_REG_STAT] | 0x80;
+}
+
+/*
+ * video_write_stat - Writes the STAT register.
+ *
+ * The mode and coincidence bits are set by hardware, only the interrupt
+ *	selects can be written.
+ *
+ */
+void video_write_stat( Gameboy_t *gb, unsigned int reg, unsigned char value ) {
+	gb->Memory.IORegs[IO_REG_STAT] = (value & 0x78) |
+		(gb->Memory.IORegs[IO_REG_STAT] & 0x07);
+}
+
+/*
+ * video_write_ly - Writes the LY register.
+ *
+ * LY can't be set, writing it resets the current scanline to 0.
+ *
+ */
+void video_write_ly( Gameboy_t *gb, unsigned int reg, unsigned char value ) {
+	gb->Memory.IORegs[IO_REG_LY] = 0;
+}
@@ -24,6 +24,32 @@ MA  02110-1301, USA.
 
 #endif /* _VIDEO_H_ */
 
+/* dimensions of the Gameboy's LCD */
+#define SCREEN_WIDTH		160
+#define SCREEN_HEIGHT		144
+
+/* Triple buffer for passing frames from the emulation thread to the
+	presentation thread. A frame holds one shade (0 - 3) per pixel */
+typedef struct {
+	int Back;					/* frame being drawn by emulation thread */
+	int Front;					/* frame being presented */
+	volatile int Middle;		/* last completed frame, see below */
+
+	int WndLine;				/* line of the window to draw next */
+
+	unsigned char Frames[3][SCREEN_WIDTH * SCREEN_HEIGHT];
+
+} Screen_t;
+
+/* index bits of the Screen_t.Middle field */
+#define FRAME_INDEX			0x03
+
+/* set in Screen_t.Middle if the frame has not been presented yet */
+#define FRAME_FRESH			0x04
+
+/* frame the emulation thread is currently drawing into */
+#define VIDEO_BACK_BUFFER	(gb->Screen.Frames[ gb->Screen.Back ])
+
 /* number of clock cycles before horizontal blank happens */
 #define HBLANK_CYCLES		456
 
@@ -93,8 +119,16 @@ typedef struct {
 
 /* function declarations */
 
-void video_do_hblank( void );
-void video_draw_scanline( unsigned char scanline );
-void video_draw_window( unsigned char scanline );
-void video_draw_background( unsigned char scanline );
-void video_draw_sprites( unsigned char scanline );
+int video_do_hblank( Gameboy_t *gb );
+void video_draw_scanline( Gameboy_t *gb, unsigned char scanline );
+void video_draw_window( Gameboy_t *gb, unsigned char scanline );
+void video_draw_background( Gameboy_t *gb, unsigned char scanline );
+void video_draw_sprites( Gameboy_t *gb, unsigned char scanline );
+void video_publish_frame( Gameboy_t *gb );
+unsigned char *video_latest_frame( Gameboy_t *gb );
+void video_register_io( Gameboy_t *gb );
+unsigned char video_read_stat( Gameboy_t *gb, unsigned int reg );
+void video_write_stat( Gameboy_t *gb, unsigned int reg, unsigned char value );
+void video_write_ly( Gameboy_t *gb, unsigned int reg, unsigned char value );
+
+extern int GBColors[4];
@@ -25,6 +25,12 @@ static LPBYTE	g_lpBits;
 static HBITMAP	g_hBitmap;
 static HWND		g_hWnd;
 
+/* arguments passed to ThreadProc */
+typedef struct {
+	void	(*func)(void *);
+	void	*arg;
+} ThreadArgs_t;
+
 /*
  * win32_init - Initializes the Win32 host environment.
  *
@@ -87,6 +93,13 @@ EMU_IMPORT int win32_init( void ) {
 	ShowWindow(g_hWnd, SW_SHOW);
 	UpdateWindow(g_hWnd);
 
+	/* Sleep has a granularity of 10 - 15 ms by default which is way too
+		coarse for frame pacing */
+	timeBeginPeriod(1);
+
+	/* keep the last few minutes around for rewinding */
+	gb_emu_set_rewind(WIN32_REWIND_SIZE);
+
 	/* initialization okay */
 	return GB_EMU_OK;
 }
@@ -98,7 +111,9 @@ EMU_IMPORT int win32_init( void ) {
 EMU_IMPORT void win32_sys( void ) {
 	MSG msg;
 	
-	if(PeekMessage(&msg, NULL, 0, 0, PM_REMOVE)) {
+	/* we are not called very often, so dispatch everything that queued
+		up in the meantime */
+	while(PeekMessage(&msg, NULL, 0, 0, PM_REMOVE)) {
 
 		/* pass on to window procedure */
 		TranslateMessage(&msg);
@@ -111,24 +126,176 @@ EMU_IMPORT void win32_sys( void ) {
 }
 
 /*
- * win32_blt - Blts the DIB to the window.
+ * win32_blt - Converts a frame into the DIB and blts it to the window.
  *
  */
-EMU_IMPORT void win32_blt( void ) {
+EMU_IMPORT void win32_blt( unsigned char *frame ) {
+	int p, c;
+
+	for(p = 0; p < SCREEN_WIDTH * SCREEN_HEIGHT; p++) {
+		c = GBColors[ frame[p] ];
+
+		g_lpBits[p * 3 + 0] = (c >> 16) & 0xFF;
+		g_lpBits[p * 3 + 1] = (c >>  8) & 0xFF;
+		g_lpBits[p * 3 + 2] = (c) & 0xFF;
+	}
+
 	/* this triggers a WM_PAINT */
 	InvalidateRect(g_hWnd, NULL, FALSE);
 }
 
 /*
- * win32_plot - Sets a pixel in the DIB.
+ * win32_time - Returns a timestamp in microseconds.
+ *
+ */
+EMU_IMPORT unsigned int win32_time( void ) {
+	static LARGE_INTEGER freq;
+	LARGE_INTEGER count;
+
+	if(!freq.QuadPart)
+		QueryPerformanceFrequency(&freq);
+
+	QueryPerformanceCounter(&count);
+
+	/* split up to keep the multiplication from overflowing */
+	return (unsigned int)((count.QuadPart / freq.QuadPart) * 1000000 +
+		((count.QuadPart % freq.QuadPart) * 1000000) / freq.QuadPart);
+}
+
+/*
+ * win32_clock - Returns the wall clock time in seconds since 1970.
+ *
+ */
+EMU_IMPORT unsigned int win32_clock( void ) {
+	FILETIME ft;
+	ULARGE_INTEGER t;
+
+	GetSystemTimeAsFileTime(&ft);
+
+	t.LowPart	= ft.dwLowDateTime;
+	t.HighPart	= ft.dwHighDateTime;
+
+	/* FILETIME counts 100 nsec intervals since 1601 */
+	return (unsigned int)((t.QuadPart - 116444736000000000i64) / 10000000);
+}
+
+/*
+ * win32_sleep - Suspends the calling thread.
+ *
+ */
+EMU_IMPORT void win32_sleep( unsigned int msec ) {
+	Sleep(msec);
+}
+
+/*
+ * win32_thread - Starts a new thread.
  *
  */
-EMU_IMPORT void win32_plot( unsigned int p, int c ) {
-/*	g_lpBits[p] = c; */
+EMU_IMPORT int win32_thread( void (*func)(void *), void *arg ) {
+	HANDLE hThread;
+	DWORD dwId;
+	ThreadArgs_t *lpArgs;
+
+	if(!(lpArgs = malloc(sizeof(ThreadArgs_t))))
+		return GB_EMU_ERROR;
+
+	lpArgs->func	= func;
+	lpArgs->arg		= arg;
+
+	if(!(hThread = CreateThread(NULL, 0, ThreadProc, lpArgs, 0, &dwId))) {
+		free(lpArgs);
+		return GB_EMU_ERROR;
+	}
 
-	g_lpBits[p * 3 + 0] = (c >> 16) & 0xFF;
-	g_lpBits[p * 3 + 1] = (c >>  8) & 0xFF;
-	g_lpBits[p * 3 + 2] = (c) & 0xFF;
+	/* we never wait for the thread, so don't keep the handle around */
+	CloseHandle(hThread);
+	return GB_EMU_OK;
+}
+
+/*
+ * win32_xchg - Atomically exchanges an integer.
+ *
+ */
+EMU_IMPORT int win32_xchg( volatile int *target, int value ) {
+	return InterlockedExchange((LPLONG)target, value);
+}
+
+/*
+ * win32_add - Atomically adds to an integer.
+ *
+ */
+EMU_IMPORT int win32_add( volatile int *target, int value ) {
+	return InterlockedExchangeAdd((LPLONG)target, value);
+}
+
+/*
+ * win32_map_file - Maps a file into memory, read-only.
+ *
+ */
+EMU_IMPORT void *win32_map_file( const char *path, unsigned int *size ) {
+	HANDLE hFile, hMap;
+	LPVOID lpView;
+
+	if((hFile = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL,
+		OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL)) == INVALID_HANDLE_VALUE)
+		return NULL;
+
+	*size = GetFileSize(hFile, NULL);
+	hMap = CreateFileMapping(hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+
+	/* the view keeps the file open, the handles can go right away */
+	CloseHandle(hFile);
+
+	if(!hMap)
+		return NULL;
+
+	lpView = MapViewOfFile(hMap, FILE_MAP_READ, 0, 0, 0);
+
+	CloseHandle(hMap);
+	return lpView;
+}
+
+/*
+ * win32_unmap_file - Unmaps a file mapped by win32_map_file.
+ *
+ */
+EMU_IMPORT void win32_unmap_file( void *data, unsigned int size ) {
+	UnmapViewOfFile(data);
+}
+
+/*
+ * win32_map_save - Maps a save file into memory, for reading and writing.
+ *
+ */
+EMU_IMPORT void *win32_map_save( const char *path, unsigned int size ) {
+	HANDLE hFile, hMap;
+	LPVOID lpView;
+
+	if((hFile = CreateFileA(path, GENERIC_READ | GENERIC_WRITE,
+		FILE_SHARE_READ, NULL, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL,
+		NULL)) == INVALID_HANDLE_VALUE)
+		return NULL;
+
+	/* the mapping grows the file to 'size' if it is smaller */
+	hMap = CreateFileMapping(hFile, NULL, PAGE_READWRITE, 0, size, NULL);
+
+	CloseHandle(hFile);
+
+	if(!hMap)
+		return NULL;
+
+	lpView = MapViewOfFile(hMap, FILE_MAP_WRITE, 0, 0, size);
+
+	CloseHandle(hMap);
+	return lpView;
+}
+
+/*
+ * win32_flush_file - Starts writing back a mapped save file.
+ *
+ */
+EMU_IMPORT void win32_flush_file( void *data, unsigned int size ) {
+	FlushViewOfFile(data, size);
 }
 
 /*
@@ -161,6 +328,40 @@ int APIENTRY WinMain(HINSTANCE hInstance,
 	main(0, NULL);
 }
 
+/*
+ * ThreadProc - Calls the function passed to win32_thread.
+ *
+ */
+DWORD WINAPI ThreadProc( LPVOID lpParam ) {
+	ThreadArgs_t Args = *((ThreadArgs_t*) lpParam);
+
+	free(lpParam);
+	Args.func(Args.arg);
+
+	return 0;
+}
+
+/*
+ * MapKeyToButton - Maps a virtual key code to a joypad button.
+ *
+ * @return
+ *	One of the JOYPAD_* bits or 0 if the key isn't mapped to a button.
+ *
+ */
+BYTE MapKeyToButton( WPARAM wKey ) {
+	switch(wKey) {
+		case VK_RIGHT:	return JOYPAD_RIGHT;
+		case VK_LEFT:	return JOYPAD_LEFT;
+		case VK_UP:		return JOYPAD_UP;
+		case VK_DOWN:	return JOYPAD_DOWN;
+		case 'X':		return JOYPAD_A;
+		case 'Z':		return JOYPAD_B;
+		case VK_BACK:	return JOYPAD_SELECT;
+		case VK_RETURN:	return JOYPAD_START;
+	}
+	return 0;
+}
+
 /*
  * WndProc - Window procedure of main application window.
  *
@@ -169,24 +370,43 @@ LRESULT CALLBACK WndProc(HWND hWnd, UINT uMsg, WPARAM wParam,
 						 LPARAM lParam) {
 	LPBYTE		lpROM;
 	DWORD		dwSize;
+	UINT		uSize;
+	CHAR		szPath[260];
 	HMENU		hMenu;
 	RECT		rt;
 	HDC			hDC, hDCMem;
 	PAINTSTRUCT ps;
+	BYTE		bButton;
+	static BYTE	bButtons;
 
 	switch(uMsg) {
 		case WM_COMMAND:
 			switch(LOWORD(wParam)) {
 				case IDM_FILE_LOAD_ROM:
 					/* start emulator */
-					if(lpROM = GetROMFile(&dwSize)) {
-						if(GB_EMU_ERROR == gb_emu_start(lpROM, dwSize)) {
+					if(GetROMPath(szPath, sizeof(szPath))) {
+						if(GB_EMU_ERROR == gb_emu_start_file(szPath)) {
 							/* do something! */
 						}
+					}
+					break;
+
+				case IDM_FILE_LOAD_STATE:
+					if(lpROM = GetStateFile(&dwSize)) {
+						if(GB_EMU_ERROR == gb_emu_load_state(lpROM, dwSize))
+							MessageBox(hWnd, _T("The state could not be loaded."),
+								WINDOWNAME, MB_OK | MB_ICONERROR);
 						ReleaseROMFile(lpROM);
 					}
 					break;
 
+				case IDM_FILE_SAVE_STATE:
+					if(GB_EMU_OK == gb_emu_save_state(&lpROM, &uSize)) {
+						PutStateFile(lpROM, uSize);
+						free(lpROM);
+					}
+					break;
+
 				case IDM_FILE_EXIT:
 					DestroyWindow(hWnd);
 					break;
@@ -208,6 +428,29 @@ LRESULT CALLBACK WndProc(HWND hWnd, UINT uMsg, WPARAM wParam,
 					}
 					break;
 
+				case IDM_SETTINGS_TURBO:
+					hMenu = GetMenu(hWnd);
+					if(GetMenuState(hMenu, IDM_SETTINGS_TURBO, 0) & MF_CHECKED) {
+						CheckMenuItem(hMenu, IDM_SETTINGS_TURBO, MF_UNCHECKED);
+						gb_emu_set_turbo(0);
+					} else {
+						CheckMenuItem(hMenu, IDM_SETTINGS_TURBO, MF_CHECKED);
+						gb_emu_set_turbo(1);
+					}
+					break;
+
+				case IDM_SETTINGS_RUNAHEAD:
+					hMenu = GetMenu(hWnd);
+					if(GetMenuState(hMenu, IDM_SETTINGS_RUNAHEAD, 0) & MF_CHECKED) {
+						CheckMenuItem(hMenu, IDM_SETTINGS_RUNAHEAD, MF_UNCHECKED);
+						gb_emu_set_run_ahead(0);
+					} else {
+						/* one frame hides the lag of most games */
+						CheckMenuItem(hMenu, IDM_SETTINGS_RUNAHEAD, MF_CHECKED);
+						gb_emu_set_run_ahead(1);
+					}
+					break;
+
 				case IDM_SETTINGS_CONSOLE:
 					hMenu = GetMenu(hWnd);
 					if(GetMenuState(hMenu, IDM_SETTINGS_CONSOLE, 0) & MF_CHECKED) {
@@ -245,8 +488,30 @@ LRESULT CALLBACK WndProc(HWND hWnd, UINT uMsg, WPARAM wParam,
 			EndPaint(hWnd, &ps);
 			break;
 
+		/* joypad input goes to the emulation thread through a queue */
+		case WM_KEYDOWN:
+		case WM_KEYUP:
+			/* the game runs backwards for as long as R is held. The key
+				must not be one of those MapKeyToButton maps */
+			if(wParam == 'R') {
+				gb_emu_rewind(uMsg == WM_KEYDOWN);
+				break;
+			}
+
+			if(!(bButton = MapKeyToButton(wParam)))
+				return DefWindowProc(hWnd, uMsg, wParam, lParam);
+
+			bButton = (uMsg == WM_KEYDOWN) ? (bButtons | bButton) :
+				(bButtons & ~bButton);
+
+			/* ignore auto-repeat */
+			if(bButton != bButtons && GB_EMU_OK == gb_emu_input(bButton))
+				bButtons = bButton;
+			break;
+
 		/* shut emulator down */
 		case WM_DESTROY:
+			timeEndPeriod(1);
 			gb_emu_shutdown();
 			break;
 
@@ -313,18 +578,120 @@ BOOL CALLBACK DlgControlProc( HWND hDlg, UINT uMsg, WPARAM wParam,
 }
 
 /*
- * GetROMFile - Lets the user pick a ROM file and then loads it.
+ * GetROMPath - Lets the user pick a ROM file.
+ *
+ * The emulator maps the file itself, see gb_emu_start_file, so only the
+ *	path is returned. The path is always ANSI because it is passed on to
+ *	win32_map_file.
+ *
+ * @param lpPath
+ *	A pointer to a buffer that will receive the path of the ROM file.
+ * @param dwSize
+ *	Size of the buffer, in bytes.
+ *
+ * @return
+ *	TRUE if a file was picked, FALSE if the user pressed 'Cancel'.
+ *
+ */
+BOOL GetROMPath( LPSTR lpPath, DWORD dwSize ) {
+	OPENFILENAMEA ofn;
+
+	ZeroMemory(&ofn, sizeof(ofn));
+
+	ofn.lStructSize		= sizeof(ofn);
+	ofn.hwndOwner		= g_hWnd;
+	ofn.lpstrFile		= lpPath;
+	ofn.lpstrFile[0]	= '\0';
+	ofn.nMaxFile		= dwSize;
+	ofn.lpstrFilter		= "Gameboy ROM Files\0*.gb\0All Files\0*.*\0";
+	ofn.nFilterIndex	= 1;
+	ofn.lpstrFileTitle	= NULL;
+	ofn.nMaxFileTitle	= 0;
+	ofn.lpstrInitialDir	= NULL;
+	ofn.Flags			= OFN_PATHMUSTEXIST | OFN_FILEMUSTEXIST;
+
+	return GetOpenFileNameA(&ofn);
+}
+
+/*
+ * GetStateFile - Lets the user pick a save state file and then loads it.
+ *
+ * @param lpFileSize
+ *	A pointer that will receive the filesize of the selected file,
+ *	in bytes.
+ *
+ * @return
+ *	A pointer to the selected file in memory on success. If the user
+ *	pressed 'Cancel' in the 'Open File' dialog, NULL is returned. The
+ *	file is released with ReleaseROMFile.
+ *
+ */
+LPBYTE GetStateFile( LPDWORD lpFileSize ) {
+	return OpenFileDialog(_T("Gameboy Save States\0*.gbs\0All Files\0*.*\0"),
+		lpFileSize);
+}
+
+/*
+ * PutStateFile - Lets the user pick a file and saves a state into it.
+ *
+ * @param lpData
+ *	A pointer to the state image returned by gb_emu_save_state.
+ * @param dwSize
+ *	Size of the state image, in bytes.
+ *
+ * @return
+ *	TRUE if the state was written, FALSE if the user pressed 'Cancel' or
+ *	the file could not be written.
+ *
+ */
+BOOL PutStateFile( LPBYTE lpData, DWORD dwSize ) {
+	OPENFILENAME ofn;
+	TCHAR szFile[260];
+	HANDLE hFile;
+	DWORD dwWritten;
+	BOOL bRet;
+
+	ZeroMemory(&ofn, sizeof(ofn));
+
+	ofn.lStructSize		= sizeof(ofn);
+	ofn.hwndOwner		= g_hWnd;
+	ofn.lpstrFile		= szFile;
+	ofn.lpstrFile[0]	= '\0';
+	ofn.nMaxFile		= sizeof(szFile);
+	ofn.lpstrFilter		= _T("Gameboy Save States\0*.gbs\0All Files\0*.*\0");
+	ofn.nFilterIndex	= 1;
+	ofn.lpstrDefExt		= _T("gbs");
+	ofn.Flags			= OFN_PATHMUSTEXIST | OFN_OVERWRITEPROMPT;
+
+	if(!GetSaveFileName(&ofn))
+		return FALSE;
+
+	if((hFile = CreateFile(ofn.lpstrFile, GENERIC_WRITE, 0, NULL,
+		CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL)) == INVALID_HANDLE_VALUE)
+		return FALSE;
+
+	bRet = WriteFile(hFile, lpData, dwSize, &dwWritten, NULL) &&
+		dwWritten == dwSize;
+
+	CloseHandle(hFile);
+	return bRet;
+}
+
+/*
+ * OpenFileDialog - Lets the user pick a file and then loads it.
  *
+ * @param lpFilter
+ *	Filter strings for the 'Open File' dialog.
  * @param lpFileSize
- *	A pointer that will receive the filesize of the selected ROM file,
+ *	A pointer that will receive the filesize of the selected file,
  *	in bytes.
  *
  * @return
- *	A pointer to the selected ROM file in memory on success. If the user
+ *	A pointer to the selected file in memory on success. If the user
  *	pressed 'Cancel' in the 'Open File' dialog, NULL is returned.
  *
  */
-LPBYTE GetROMFile( LPDWORD lpFileSize ) {
+LPBYTE OpenFileDialog( LPCTSTR lpFilter, LPDWORD lpFileSize ) {
 	OPENFILENAME ofn;
 	TCHAR szFile[260];
 	HANDLE hFile;
@@ -338,7 +705,7 @@ LPBYTE GetROMFile( LPDWORD lpFileSize ) {
 	ofn.lpstrFile		= szFile;
 	ofn.lpstrFile[0]	= '\0';
 	ofn.nMaxFile		= sizeof(szFile);
-	ofn.lpstrFilter		= _T("Gameboy ROM Files\0*.gb\0All Files\0*.*\0");
+	ofn.lpstrFilter		= lpFilter;
 	ofn.nFilterIndex	= 1;
 	ofn.lpstrFileTitle	= NULL;
 	ofn.nMaxFileTitle	= 0;
@@ -368,7 +735,7 @@ LPBYTE GetROMFile( LPDWORD lpFileSize ) {
 }
 
 /*
- * ReleaseROMFile - Releases a ROM file returned by GetROMFile.
+ * ReleaseROMFile - Releases a file returned by OpenFileDialog.
  *
  * @param lpROM
  *	A pointer to a ROM file in memory.
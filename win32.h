@@ -24,6 +24,7 @@ MA  02110-1301, USA.
 
 #include "gameboy.h"
 #include <windows.h>
+#include <mmsystem.h>
 #include <tchar.h>
 #include <io.h>
 #include "resource.h"
@@ -32,8 +33,25 @@ MA  02110-1301, USA.
 /* exported by host environment */
 EMU_IMPORT int win32_init( void );
 EMU_IMPORT void win32_sys( void );
-EMU_IMPORT void win32_blt( void );
-EMU_IMPORT void win32_plot( unsigned int p, int c );
+EMU_IMPORT void win32_blt( unsigned char *frame );
+EMU_IMPORT unsigned int win32_time( void );
+EMU_IMPORT unsigned int win32_clock( void );
+EMU_IMPORT void win32_sleep( unsigned int msec );
+EMU_IMPORT int win32_thread( void (*func)(void *), void *arg );
+EMU_IMPORT int win32_xchg( volatile int *target, int value );
+EMU_IMPORT int win32_add( volatile int *target, int value );
+EMU_IMPORT void *win32_map_file( const char *path, unsigned int *size );
+EMU_IMPORT void win32_unmap_file( void *data, unsigned int size );
+EMU_IMPORT void *win32_map_save( const char *path, unsigned int size );
+EMU_IMPORT void win32_flush_file( void *data, unsigned int size );
+
+/* minimum time between two win32_sys calls while executing a ROM, in
+	microseconds. Messages pile up in the queue in the meantime and are
+	all dispatched at once. */
+#define WIN32_SYS_INTERVAL	4000
+
+/* size of the rewind buffer, about 10 minutes of most games */
+#define WIN32_REWIND_SIZE	(64 * 1024 * 1024)
 
 LRESULT CALLBACK WndProc(HWND hWnd, UINT uMsg, WPARAM wParam,
 						 LPARAM lParam);
@@ -42,8 +60,14 @@ BOOL CALLBACK DlgAboutProc( HWND hDlg, UINT uMsg, WPARAM wParam,
 BOOL CALLBACK DlgControlProc( HWND hDlg, UINT uMsg, WPARAM wParam,
 						   LPARAM lParam );
 
-LPBYTE GetROMFile( LPDWORD lpFileSize );
+DWORD WINAPI ThreadProc( LPVOID lpParam );
+BYTE MapKeyToButton( WPARAM wKey );
+
+BOOL GetROMPath( LPSTR lpPath, DWORD dwSize );
 VOID ReleaseROMFile( LPBYTE lpROM );
+LPBYTE GetStateFile( LPDWORD lpFileSize );
+BOOL PutStateFile( LPBYTE lpData, DWORD dwSize );
+LPBYTE OpenFileDialog( LPCTSTR lpFilter, LPDWORD lpFileSize );
 
 #define CLASSNAME	_T("GAMEBOYEMU")
 #define WINDOWNAME	_T("GameBoy Emulator")
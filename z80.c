@@ -35,18 +35,21 @@ MA  02110-1301, USA.
  *	The difference of the number of requested clock cycles and
  *		the actual number of clock cycles the CPU ran. This
  *		may be 0 or a negative value.
+ *
+ * The clock cycles of every instruction are added to z80->cycles so the
+ *	exact time can be determined from within memory callbacks.
  */
 s32 z80_run( z80_machine_t *z80, s32 cycles ) {
 	u8 opc, op1;
 	u32 t, t2;
-	s32 left = cycles;
+	u32 end = z80->cycles + cycles;
 
-	while(left > 0) {
+	while((s32)(end - z80->cycles) > 0) {
 		/* fetch next opcode from instruction stream */
-		opc = z80->mem_read(z80->pc++);
+		opc = z80->mem_read(z80->ctx, z80->pc++);
 
-		/* subtract cycles for this instruction */
-		left = left - z80_ictbl[opc];
+		/* add cycles for this instruction */
+		z80->cycles += z80_ictbl[opc];
 
 		switch(opc) {
 			case OP_LD_B_N:
@@ -102,7 +105,7 @@ s32 z80_run( z80_machine_t *z80, s32 cycles ) {
 				break;
 
 			case OP_LD_A_ADDR_HL:
-				z80->u_af.A = z80->mem_read(z80->u_hl.HL);
+				z80->u_af.A = z80->mem_read(z80->ctx, z80->u_hl.HL);
 				break;
 
 			case OP_LD_B_B:
@@ -130,7 +133,7 @@ s32 z80_run( z80_machine_t *z80, s32 cycles ) {
 				break;
 
 			case OP_LD_B_ADDR_HL:
-				z80->u_bc.B = z80->mem_read(z80->u_hl.HL);
+				z80->u_bc.B = z80->mem_read(z80->ctx, z80->u_hl.HL);
 				break;
 
 			case OP_LD_C_B:
@@ -158,7 +161,7 @@ s32 z80_run( z80_machine_t *z80, s32 cycles ) {
 				break;
 
 			case OP_LD_C_ADDR_HL:
-				z80->u_bc.C = z80->mem_read(z80->u_hl.HL);
+				z80->u_bc.C = z80->mem_read(z80->ctx, z80->u_hl.HL);
 				break;
 
 			case OP_LD_D_B:
@@ -186,7 +189,7 @@ s32 z80_run( z80_machine_t *z80, s32 cycles ) {
 				break;
 
 			case OP_LD_D_ADDR_HL:
-				z80->u_de.D = z80->mem_read(z80->u_hl.HL);
+				z80->u_de.D = z80->mem_read(z80->ctx, z80->u_hl.HL);
 				break;
 
 			case OP_LD_E_B:
@@ -214,7 +217,7 @@ s32 z80_run( z80_machine_t *z80, s32 cycles ) {
 				break;
 
 			case OP_LD_E_ADDR_HL:
-				z80->u_de.E = z80->mem_read(z80->u_hl.HL);
+				z80->u_de.E = z80->mem_read(z80->ctx, z80->u_hl.HL);
 				break;
 
 			case OP_LD_H_B:
@@ -242,7 +245,7 @@ s32 z80_run( z80_machine_t *z80, s32 cycles ) {
 				break;
 
 			case OP_LD_H_ADDR_HL:
-				z80->u_hl.H = z80->mem_read(z80->u_hl.HL);
+				z80->u_hl.H = z80->mem_read(z80->ctx, z80->u_hl.HL);
 				break;
 
 			case OP_LD_L_B:
@@ -270,47 +273,47 @@ s32 z80_run( z80_machine_t *z80, s32 cycles ) {
 				break;
 
 			case OP_LD_L_ADDR_HL:
-				z80->u_hl.L = z80->mem_read(z80->u_hl.HL);
+				z80->u_hl.L = z80->mem_read(z80->ctx, z80->u_hl.HL);
 				break;
 
 			case OP_LD_ADDR_HL_B:
-				z80->mem_write(z80->u_hl.HL, z80->u_bc.B);
+				z80->mem_write(z80->ctx, z80->u_hl.HL, z80->u_bc.B);
 				break;
 
 			case OP_LD_ADDR_HL_C:
-				z80->mem_write(z80->u_hl.HL, z80->u_bc.C);
+				z80->mem_write(z80->ctx, z80->u_hl.HL, z80->u_bc.C);
 				break;
 
 			case OP_LD_ADDR_HL_D:
-				z80->mem_write(z80->u_hl.HL, z80->u_de.D);
+				z80->mem_write(z80->ctx, z80->u_hl.HL, z80->u_de.D);
 				break;
 
 			case OP_LD_ADDR_HL_E:
-				z80->mem_write(z80->u_hl.HL, z80->u_de.E);
+				z80->mem_write(z80->ctx, z80->u_hl.HL, z80->u_de.E);
 				break;
 
 			case OP_LD_ADDR_HL_H:
-				z80->mem_write(z80->u_hl.HL, z80->u_hl.H);
+				z80->mem_write(z80->ctx, z80->u_hl.HL, z80->u_hl.H);
 				break;
 
 			case OP_LD_ADDR_HL_L:
-				z80->mem_write(z80->u_hl.HL, z80->u_hl.L);
+				z80->mem_write(z80->ctx, z80->u_hl.HL, z80->u_hl.L);
 				break;
 
 			case OP_LD_ADDR_HL_N:
-				z80->mem_write(z80->u_hl.HL, GETBYTE(z80));
+				z80->mem_write(z80->ctx, z80->u_hl.HL, GETBYTE(z80));
 				break;
 
 			case OP_LD_A_ADDR_BC:
-				z80->u_af.A = z80->mem_read(z80->u_bc.BC);
+				z80->u_af.A = z80->mem_read(z80->ctx, z80->u_bc.BC);
 				break;
 
 			case OP_LD_A_ADDR_DE:
-				z80->u_af.A = z80->mem_read(z80->u_de.DE);
+				z80->u_af.A = z80->mem_read(z80->ctx, z80->u_de.DE);
 				break;
 
 			case OP_LD_A_ADDR_NN:
-				z80->u_af.A = z80->mem_read(GETSHORT(z80));
+				z80->u_af.A = z80->mem_read(z80->ctx, GETSHORT(z80));
 				break;
 
 			case OP_LD_A_N:
@@ -342,51 +345,51 @@ s32 z80_run( z80_machine_t *z80, s32 cycles ) {
 				break;
 
 			case OP_LD_ADDR_BC_A:
-				z80->mem_write(z80->u_bc.BC, z80->u_af.A);
+				z80->mem_write(z80->ctx, z80->u_bc.BC, z80->u_af.A);
 				break;
 
 			case OP_LD_ADDR_DE_A:
-				z80->mem_write(z80->u_de.DE, z80->u_af.A);
+				z80->mem_write(z80->ctx, z80->u_de.DE, z80->u_af.A);
 				break;
 
 			case OP_LD_ADDR_HL_A:
-				z80->mem_write(z80->u_hl.HL, z80->u_af.A);
+				z80->mem_write(z80->ctx, z80->u_hl.HL, z80->u_af.A);
 				break;
 
 			case OP_LD_ADDR_NN_A:
-				z80->mem_write(GETSHORT(z80), z80->u_af.A);
+				z80->mem_write(z80->ctx, GETSHORT(z80), z80->u_af.A);
 				break;
 
 			case OP_LD_A_ADDR_C_FF00:
-				z80->u_af.A = z80->mem_read(0xFF00 + z80->u_bc.C);
+				z80->u_af.A = z80->mem_read(z80->ctx, 0xFF00 + z80->u_bc.C);
 				break;
 
 			case OP_LD_ADDR_C_FF00_A:
-				z80->mem_write(0xFF00 + z80->u_bc.C, z80->u_af.A);
+				z80->mem_write(z80->ctx, 0xFF00 + z80->u_bc.C, z80->u_af.A);
 				break;
 
 			case OP_LDD_A_ADDR_HL:
-				z80->u_af.A = z80->mem_read(z80->u_hl.HL--);
+				z80->u_af.A = z80->mem_read(z80->ctx, z80->u_hl.HL--);
 				break;
 
 			case OP_LDD_ADDR_HL_A:
-				z80->mem_write(z80->u_hl.HL--, z80->u_af.A);
+				z80->mem_write(z80->ctx, z80->u_hl.HL--, z80->u_af.A);
 				break;
 
 			case OP_LDI_A_ADDR_HL:
-				z80->u_af.A = z80->mem_read(z80->u_hl.HL++);
+				z80->u_af.A = z80->mem_read(z80->ctx, z80->u_hl.HL++);
 				break;
 
 			case OP_LDI_ADDR_HL_A:
-				z80->mem_write(z80->u_hl.HL++, z80->u_af.A);
+				z80->mem_write(z80->ctx, z80->u_hl.HL++, z80->u_af.A);
 				break;
 
 			case OP_LD_ADDR_N_FF00_A:
-				z80->mem_write(0xFF00 + GETBYTE(z80), z80->u_af.A);
+				z80->mem_write(z80->ctx, 0xFF00 + GETBYTE(z80), z80->u_af.A);
 				break;
 
 			case OP_LD_A_ADDR_N_FF00:
-				z80->u_af.A = z80->mem_read(0xFF00 + GETBYTE(z80));
+				z80->u_af.A = z80->mem_read(z80->ctx, 0xFF00 + GETBYTE(z80));
 				break;
 
 			case OP_LD_BC_NN:
@@ -422,52 +425,52 @@ s32 z80_run( z80_machine_t *z80, s32 cycles ) {
 			case OP_LD_ADDR_NN_SP:
 				t = GETSHORT(z80);
 #ifdef LITTLE_ENDIAN
-				z80->mem_write((u16)t, *((u8*)&z80->sp));
-				z80->mem_write((u16)(t + 1), *(((u8*)&z80->sp) + 1));
+				z80->mem_write(z80->ctx, (u16)t, *((u8*)&z80->sp));
+				z80->mem_write(z80->ctx, (u16)(t + 1), *(((u8*)&z80->sp) + 1));
 #else
-				z80->mem_write((u16)(t + 1), *(((u8*)&z80->sp) + 1));
-				z80->mem_write((u16)t, *((u8*)&z80->sp));
+				z80->mem_write(z80->ctx, (u16)(t + 1), *(((u8*)&z80->sp) + 1));
+				z80->mem_write(z80->ctx, (u16)t, *((u8*)&z80->sp));
 #endif
 				break;
 
 			case OP_PUSH_AF:
-				z80->mem_write(--z80->sp, z80->u_af.F);
-				z80->mem_write(--z80->sp, z80->u_af.A);
+				z80->mem_write(z80->ctx, --z80->sp, z80->u_af.F);
+				z80->mem_write(z80->ctx, --z80->sp, z80->u_af.A);
 				break;
 
 			case OP_PUSH_BC:
-				z80->mem_write(--z80->sp, z80->u_bc.C);
-				z80->mem_write(--z80->sp, z80->u_bc.B);
+				z80->mem_write(z80->ctx, --z80->sp, z80->u_bc.C);
+				z80->mem_write(z80->ctx, --z80->sp, z80->u_bc.B);
 				break;
 
 			case OP_PUSH_DE:
-				z80->mem_write(--z80->sp, z80->u_de.E);
-				z80->mem_write(--z80->sp, z80->u_de.D);
+				z80->mem_write(z80->ctx, --z80->sp, z80->u_de.E);
+				z80->mem_write(z80->ctx, --z80->sp, z80->u_de.D);
 				break;
 
 			case OP_PUSH_HL:
-				z80->mem_write(--z80->sp, z80->u_hl.L);
-				z80->mem_write(--z80->sp, z80->u_hl.H);
+				z80->mem_write(z80->ctx, --z80->sp, z80->u_hl.L);
+				z80->mem_write(z80->ctx, --z80->sp, z80->u_hl.H);
 				break;
 
 			case OP_POP_AF:
-				z80->u_af.A = z80->mem_read(z80->sp++);
-				z80->u_af.F = z80->mem_read(z80->sp++);
+				z80->u_af.A = z80->mem_read(z80->ctx, z80->sp++);
+				z80->u_af.F = z80->mem_read(z80->ctx, z80->sp++);
 				break;
 
 			case OP_POP_BC:
-				z80->u_bc.B = z80->mem_read(z80->sp++);
-				z80->u_bc.C = z80->mem_read(z80->sp++);
+				z80->u_bc.B = z80->mem_read(z80->ctx, z80->sp++);
+				z80->u_bc.C = z80->mem_read(z80->ctx, z80->sp++);
 				break;
 
 			case OP_POP_DE:
-				z80->u_de.D = z80->mem_read(z80->sp++);
-				z80->u_de.E = z80->mem_read(z80->sp++);
+				z80->u_de.D = z80->mem_read(z80->ctx, z80->sp++);
+				z80->u_de.E = z80->mem_read(z80->ctx, z80->sp++);
 				break;
 
 			case OP_POP_HL:
-				z80->u_hl.H = z80->mem_read(z80->sp++);
-				z80->u_hl.L = z80->mem_read(z80->sp++);
+				z80->u_hl.H = z80->mem_read(z80->ctx, z80->sp++);
+				z80->u_hl.L = z80->mem_read(z80->ctx, z80->sp++);
 				break;
 
 			case OP_ADD_A_A:
@@ -542,7 +545,7 @@ s32 z80_run( z80_machine_t *z80, s32 cycles ) {
 
 			case OP_ADD_A_ADDR_HL:
 				CLRFLAG(z80, FL_SUB);
-				op1 = z80->mem_read(z80->u_hl.HL);
+				op1 = z80->mem_read(z80->ctx, z80->u_hl.HL);
 				((z80->u_af.A & 0x0F) + (op1 & 0x0F)) > 0x0F ?
 					SETFLAG(z80, FL_HCARRY) : CLRFLAG(z80, FL_HCARRY);
 				(t = z80->u_af.A + op1) & 0xFF00 ? SETFLAG(z80, FL_CARRY) :
@@ -653,7 +656,7 @@ s32 z80_run( z80_machine_t *z80, s32 cycles ) {
 
 			case OP_ADC_A_ADDR_HL:
 				CLRFLAG(z80, FL_SUB);
-				op1 = z80->mem_read(z80->u_hl.HL);
+				op1 = z80->mem_read(z80->ctx, z80->u_hl.HL);
 				t2 = GETFLAG(z80, FL_CARRY);
 				((z80->u_af.A & 0x0F) + ((op1 + t2) & 0x0F)) > 0x0F ?
 					SETFLAG(z80, FL_HCARRY) : CLRFLAG(z80, FL_HCARRY);
@@ -735,7 +738,7 @@ s32 z80_run( z80_machine_t *z80, s32 cycles ) {
 
 			case OP_SUB_ADDR_HL:
 				SETFLAG(z80, FL_SUB);
-				op1 = z80->mem_read(z80->u_hl.HL);
+				op1 = z80->mem_read(z80->ctx, z80->u_hl.HL);
 				((op1 & 0x0F) > (z80->u_af.A & 0x0F)) ?
 					SETFLAG(z80, FL_HCARRY) : CLRFLAG(z80, FL_HCARRY);
 				(op1 > z80->u_af.A) ? SETFLAG(z80, FL_CARRY) :
@@ -894,7 +897,7 @@ s32 z80_run( z80_machine_t *z80, s32 cycles ) {
 
 			case OP_SBC_A_ADDR_HL:
 /*				SETFLAG(z80, FL_SUB);
-				op1 = z80->mem_read(z80->u_hl.HL);
+				op1 = z80->mem_read(z80->ctx, z80->u_hl.HL);
 				t2 = GETFLAG(z80, FL_CARRY);
 				(((u8)(op1 + t2) & 0x0F) > (z80->u_af.A & 0x0F)) ?
 					SETFLAG(z80, FL_HCARRY) : CLRFLAG(z80, FL_HCARRY);
@@ -904,7 +907,7 @@ s32 z80_run( z80_machine_t *z80, s32 cycles ) {
 				z80->u_af.A ? CLRFLAG(z80, FL_ZERO) : SETFLAG(z80, FL_ZERO);*/
 
 				SETFLAG(z80, FL_SUB);
-				op1 = z80->mem_read(z80->u_hl.HL) + GETFLAG(z80, FL_CARRY);
+				op1 = z80->mem_read(z80->ctx, z80->u_hl.HL) + GETFLAG(z80, FL_CARRY);
 				((op1 & 0x0F) > (z80->u_af.A & 0x0F)) ? SETFLAG(z80, FL_HCARRY) :
 					CLRFLAG(z80, FL_HCARRY);
 				(op1 > z80->u_af.A) ? SETFLAG(z80, FL_CARRY) :
@@ -986,7 +989,7 @@ s32 z80_run( z80_machine_t *z80, s32 cycles ) {
 			case OP_AND_A_ADDR_HL:
 				CLRFLAG(z80, FL_SUB|FL_CARRY);
 				SETFLAG(z80, FL_HCARRY);
-				z80->u_af.A = z80->u_af.A & z80->mem_read(z80->u_hl.HL);
+				z80->u_af.A = z80->u_af.A & z80->mem_read(z80->ctx, z80->u_hl.HL);
 				z80->u_af.A ? CLRFLAG(z80, FL_ZERO) : SETFLAG(z80, FL_ZERO);
 				break;
 
@@ -1041,7 +1044,7 @@ s32 z80_run( z80_machine_t *z80, s32 cycles ) {
 
 			case OP_OR_A_ADDR_HL:
 				CLRFLAG(z80, FL_SUB|FL_HCARRY|FL_CARRY);
-				z80->u_af.A = z80->u_af.A | z80->mem_read(z80->u_hl.HL);
+				z80->u_af.A = z80->u_af.A | z80->mem_read(z80->ctx, z80->u_hl.HL);
 				z80->u_af.A ? CLRFLAG(z80, FL_ZERO) : SETFLAG(z80, FL_ZERO);
 				break;
 
@@ -1095,7 +1098,7 @@ s32 z80_run( z80_machine_t *z80, s32 cycles ) {
 
 			case OP_XOR_A_ADDR_HL:
 				CLRFLAG(z80, FL_SUB|FL_HCARRY|FL_CARRY);
-				z80->u_af.A = z80->u_af.A ^ z80->mem_read(z80->u_hl.HL);
+				z80->u_af.A = z80->u_af.A ^ z80->mem_read(z80->ctx, z80->u_hl.HL);
 				z80->u_af.A ? CLRFLAG(z80, FL_ZERO) : SETFLAG(z80, FL_ZERO);
 				break;
 
@@ -1172,7 +1175,7 @@ s32 z80_run( z80_machine_t *z80, s32 cycles ) {
 
 			case OP_CP_ADDR_HL:
 				SETFLAG(z80, FL_SUB);
-				op1 = z80->mem_read(z80->u_hl.HL);
+				op1 = z80->mem_read(z80->ctx, z80->u_hl.HL);
 				((op1 & 0x0F) > (z80->u_af.A & 0x0F)) ?
 					SETFLAG(z80, FL_HCARRY) : CLRFLAG(z80, FL_HCARRY);
 				(op1 > z80->u_af.A) ? SETFLAG(z80, FL_CARRY) :
@@ -1243,11 +1246,11 @@ s32 z80_run( z80_machine_t *z80, s32 cycles ) {
 
 			case OP_INC_ADDR_HL:
 				CLRFLAG(z80, FL_SUB);
-				op1 = z80->mem_read(z80->u_hl.HL);
+				op1 = z80->mem_read(z80->ctx, z80->u_hl.HL);
 				((op1 & 0x0F) + 1) > 0x0F ? SETFLAG(z80, FL_HCARRY) :
 					CLRFLAG(z80, FL_HCARRY);
 				(++op1) ? CLRFLAG(z80, FL_ZERO) : SETFLAG(z80, FL_ZERO);
-				z80->mem_write(z80->u_hl.HL, op1);
+				z80->mem_write(z80->ctx, z80->u_hl.HL, op1);
 				break;
 
 			case OP_DEC_A:
@@ -1308,12 +1311,12 @@ s32 z80_run( z80_machine_t *z80, s32 cycles ) {
 
 			case OP_DEC_ADDR_HL:
 				SETFLAG(z80, FL_SUB);
-				op1 = z80->mem_read(z80->u_hl.HL);
+				op1 = z80->mem_read(z80->ctx, z80->u_hl.HL);
 				(op1 & 0x0F) ? CLRFLAG(z80, FL_HCARRY) :
 					SETFLAG(z80, FL_HCARRY);
 				op1--;
 				op1 ? CLRFLAG(z80, FL_ZERO) : SETFLAG(z80, FL_ZERO);
-				z80->mem_write(z80->u_hl.HL, op1);
+				z80->mem_write(z80->ctx, z80->u_hl.HL, op1);
 				break;
 
 			case OP_ADD_HL_BC:
@@ -1396,9 +1399,9 @@ s32 z80_run( z80_machine_t *z80, s32 cycles ) {
 
 			case OP_CB_PREFIX:
 				/* fetch actual opcode */
-				opc = z80->mem_read(z80->pc++);
-				/* subtract cycle count for instruction */
-				left = left - z80_cb_ictbl[opc];
+				opc = z80->mem_read(z80->ctx, z80->pc++);
+				/* add cycle count for instruction */
+				z80->cycles += z80_cb_ictbl[opc];
 				switch(opc) {
 					case OP_SWAP_A:
 						CLRFLAG(z80, FL_SUB|FL_HCARRY|FL_CARRY);
@@ -1444,10 +1447,10 @@ s32 z80_run( z80_machine_t *z80, s32 cycles ) {
 
 					case OP_SWAP_ADDR_HL:
 						CLRFLAG(z80, FL_SUB|FL_HCARRY|FL_CARRY);
-						op1 = z80->mem_read(z80->u_hl.HL);
+						op1 = z80->mem_read(z80->ctx, z80->u_hl.HL);
 						(op1 = (op1 << 4) | (op1 >> 4)) ?
 							CLRFLAG(z80, FL_ZERO) : SETFLAG(z80, FL_ZERO);
-						z80->mem_write(z80->u_hl.HL, op1);
+						z80->mem_write(z80->ctx, z80->u_hl.HL, op1);
 						break;
 
 					case OP_RLC_A:
@@ -1501,11 +1504,11 @@ s32 z80_run( z80_machine_t *z80, s32 cycles ) {
 
 					case OP_RLC_ADDR_HL:
 						CLRFLAG(z80, FL_SUB|FL_HCARRY);
-						op1 = z80->mem_read(z80->u_hl.HL);
+						op1 = z80->mem_read(z80->ctx, z80->u_hl.HL);
 						(op1 >> 7) ? SETFLAG(z80, FL_CARRY) : CLRFLAG(z80, FL_CARRY);
 						(op1 = (op1 << 1) | GETFLAG(z80, FL_CARRY)) ?
 							CLRFLAG(z80, FL_ZERO) : SETFLAG(z80, FL_ZERO);
-						z80->mem_write(z80->u_hl.HL, op1);
+						z80->mem_write(z80->ctx, z80->u_hl.HL, op1);
 						break;
 
 					case OP_RL_A:
@@ -1566,12 +1569,12 @@ s32 z80_run( z80_machine_t *z80, s32 cycles ) {
 
 					case OP_RL_ADDR_HL:
 						CLRFLAG(z80, FL_SUB|FL_HCARRY);
-						opc = z80->mem_read(z80->u_hl.HL);
+						opc = z80->mem_read(z80->ctx, z80->u_hl.HL);
 						op1 = opc >> 7;
 						(opc = (opc << 1) | GETFLAG(z80, FL_CARRY)) ?
 						CLRFLAG(z80, FL_ZERO) : SETFLAG(z80, FL_ZERO);
 						op1 ? SETFLAG(z80, FL_CARRY) : CLRFLAG(z80, FL_CARRY);
-						z80->mem_write(z80->u_hl.HL, opc);
+						z80->mem_write(z80->ctx, z80->u_hl.HL, opc);
 						break;
 
 					case OP_RRC_A:
@@ -1625,11 +1628,11 @@ s32 z80_run( z80_machine_t *z80, s32 cycles ) {
 
 					case OP_RRC_ADDR_HL:
 						CLRFLAG(z80, FL_SUB|FL_HCARRY);
-						op1 = z80->mem_read(z80->u_hl.HL);
+						op1 = z80->mem_read(z80->ctx, z80->u_hl.HL);
 						(op1 & 0x01) ? SETFLAG(z80, FL_CARRY) : CLRFLAG(z80, FL_CARRY);
 						(op1 = (op1 >> 1) | (GETFLAG(z80, FL_CARRY) << 7)) ?
 							CLRFLAG(z80, FL_ZERO) : SETFLAG(z80, FL_ZERO);
-						z80->mem_write(z80->u_hl.HL, op1);
+						z80->mem_write(z80->ctx, z80->u_hl.HL, op1);
 						break;
 
 					case OP_RR_A:
@@ -1690,12 +1693,12 @@ s32 z80_run( z80_machine_t *z80, s32 cycles ) {
 
 					case OP_RR_ADDR_HL:
 						CLRFLAG(z80, FL_SUB|FL_HCARRY);
-						opc = z80->mem_read(z80->u_hl.HL);
+						opc = z80->mem_read(z80->ctx, z80->u_hl.HL);
 						op1 = (opc & 0x01);
 						(opc = (opc >> 1) | (GETFLAG(z80, FL_CARRY) << 7)) ?
 							CLRFLAG(z80, FL_ZERO) : SETFLAG(z80, FL_ZERO);
 						op1 ? SETFLAG(z80, FL_CARRY) : CLRFLAG(z80, FL_CARRY);
-						z80->mem_write(z80->u_hl.HL, opc);
+						z80->mem_write(z80->ctx, z80->u_hl.HL, opc);
 						break;
 
 					case OP_SLA_A:
@@ -1749,10 +1752,10 @@ s32 z80_run( z80_machine_t *z80, s32 cycles ) {
 
 					case OP_SLA_ADDR_HL:
 						CLRFLAG(z80, FL_SUB|FL_HCARRY);
-						op1 = z80->mem_read(z80->u_hl.HL);
+						op1 = z80->mem_read(z80->ctx, z80->u_hl.HL);
 						(op1 >> 7) ? SETFLAG(z80, FL_CARRY) : CLRFLAG(z80, FL_CARRY);
 						(op1 = op1 << 1) ? CLRFLAG(z80, FL_ZERO) : SETFLAG(z80, FL_ZERO);
-						z80->mem_write(z80->u_hl.HL, op1);
+						z80->mem_write(z80->ctx, z80->u_hl.HL, op1);
 						break;
 
 					case OP_SRA_A:
@@ -1813,12 +1816,12 @@ s32 z80_run( z80_machine_t *z80, s32 cycles ) {
 
 					case OP_SRA_ADDR_HL:
 						CLRFLAG(z80, FL_SUB|FL_HCARRY);
-						opc = z80->mem_read(z80->u_hl.HL);
+						opc = z80->mem_read(z80->ctx, z80->u_hl.HL);
 						(opc & 0x01) ? SETFLAG(z80, FL_CARRY) : CLRFLAG(z80, FL_CARRY);
 						op1 = opc & 0x80;
 						(opc = (opc >> 1) | op1) ? CLRFLAG(z80, FL_ZERO) :
 							SETFLAG(z80, FL_ZERO);
-						z80->mem_write(z80->u_hl.HL, opc);
+						z80->mem_write(z80->ctx, z80->u_hl.HL, opc);
 						break;
 
 					case OP_SRL_A:
@@ -1872,10 +1875,10 @@ s32 z80_run( z80_machine_t *z80, s32 cycles ) {
 
 					case OP_SRL_ADDR_HL:
 						CLRFLAG(z80, FL_SUB|FL_HCARRY);
-						op1 = z80->mem_read(z80->u_hl.HL);
+						op1 = z80->mem_read(z80->ctx, z80->u_hl.HL);
 						(op1 & 0x01) ? SETFLAG(z80, FL_CARRY) : CLRFLAG(z80, FL_CARRY);
 						(op1 = op1 >> 1) ? CLRFLAG(z80, FL_ZERO) : SETFLAG(z80, FL_ZERO);
-						z80->mem_write(z80->u_hl.HL, op1);
+						z80->mem_write(z80->ctx, z80->u_hl.HL, op1);
 						break;
 
 					case OP_BIT_A_0:
@@ -1987,7 +1990,7 @@ s32 z80_run( z80_machine_t *z80, s32 cycles ) {
 						CLRFLAG(z80, FL_SUB);
 						SETFLAG(z80, FL_HCARRY);
 						op1 = (opc >> 3) & 0x07;
-						(z80->mem_read(z80->u_hl.HL) & (1 << op1)) ? CLRFLAG(z80, FL_ZERO) :
+						(z80->mem_read(z80->ctx, z80->u_hl.HL) & (1 << op1)) ? CLRFLAG(z80, FL_ZERO) :
 							SETFLAG(z80, FL_ZERO);
 						break;
 
@@ -2084,9 +2087,9 @@ s32 z80_run( z80_machine_t *z80, s32 cycles ) {
 					case OP_SET_ADDR_HL_6:
 					case OP_SET_ADDR_HL_7:
 						op1 = (opc >> 3) & 0x07;
-						opc = z80->mem_read(z80->u_hl.HL);
+						opc = z80->mem_read(z80->ctx, z80->u_hl.HL);
 						opc = opc | (1 << op1);
-						z80->mem_write(z80->u_hl.HL, opc);
+						z80->mem_write(z80->ctx, z80->u_hl.HL, opc);
 						break;
 
 					case OP_RES_A_0:
@@ -2182,9 +2185,9 @@ s32 z80_run( z80_machine_t *z80, s32 cycles ) {
 					case OP_RES_ADDR_HL_6:
 					case OP_RES_ADDR_HL_7:
 						op1 = (opc >> 3) & 0x07;
-						opc = z80->mem_read(z80->u_hl.HL);
+						opc = z80->mem_read(z80->ctx, z80->u_hl.HL);
 						opc &= ~(1 << op1);
-						z80->mem_write(z80->u_hl.HL, opc);
+						z80->mem_write(z80->ctx, z80->u_hl.HL, opc);
 						break;
 		
 				}
@@ -2340,11 +2343,11 @@ s32 z80_run( z80_machine_t *z80, s32 cycles ) {
 			case OP_CALL_NN:
 				t = GETSHORT(z80);
 #ifdef LITTLE_ENDIAN
-				z80->mem_write(--z80->sp, *((u8*)&z80->pc));
-				z80->mem_write(--z80->sp, *(((u8*)&z80->pc) + 1));
+				z80->mem_write(z80->ctx, --z80->sp, *((u8*)&z80->pc));
+				z80->mem_write(z80->ctx, --z80->sp, *(((u8*)&z80->pc) + 1));
 #else
-				z80->mem_write(--z80->sp, *(((u8*)&z80->pc) + 1));
-				z80->mem_write(--z80->sp, *((u8*)&z80->pc));
+				z80->mem_write(z80->ctx, --z80->sp, *(((u8*)&z80->pc) + 1));
+				z80->mem_write(z80->ctx, --z80->sp, *((u8*)&z80->pc));
 #endif
 				z80->pc = (u16)t;
 				break;
@@ -2353,11 +2356,11 @@ s32 z80_run( z80_machine_t *z80, s32 cycles ) {
 				t = GETSHORT(z80);
 				if(!GETFLAG(z80, FL_ZERO)) {
 #ifdef LITTLE_ENDIAN
-					z80->mem_write(--z80->sp, *((u8*)&z80->pc));
-					z80->mem_write(--z80->sp, *(((u8*)&z80->pc) + 1));
+					z80->mem_write(z80->ctx, --z80->sp, *((u8*)&z80->pc));
+					z80->mem_write(z80->ctx, --z80->sp, *(((u8*)&z80->pc) + 1));
 #else
-					z80->mem_write(--z80->sp, *(((u8*)&z80->pc) + 1));
-					z80->mem_write(--z80->sp, *((u8*)&z80->pc));
+					z80->mem_write(z80->ctx, --z80->sp, *(((u8*)&z80->pc) + 1));
+					z80->mem_write(z80->ctx, --z80->sp, *((u8*)&z80->pc));
 #endif
 					z80->pc = (u16)t;
 				}
@@ -2367,11 +2370,11 @@ s32 z80_run( z80_machine_t *z80, s32 cycles ) {
 				t = GETSHORT(z80);
 				if(GETFLAG(z80, FL_ZERO)) {
 #ifdef LITTLE_ENDIAN
-					z80->mem_write(--z80->sp, *((u8*)&z80->pc));
-					z80->mem_write(--z80->sp, *(((u8*)&z80->pc) + 1));
+					z80->mem_write(z80->ctx, --z80->sp, *((u8*)&z80->pc));
+					z80->mem_write(z80->ctx, --z80->sp, *(((u8*)&z80->pc) + 1));
 #else
-					z80->mem_write(--z80->sp, *(((u8*)&z80->pc) + 1));
-					z80->mem_write(--z80->sp, *((u8*)&z80->pc));
+					z80->mem_write(z80->ctx, --z80->sp, *(((u8*)&z80->pc) + 1));
+					z80->mem_write(z80->ctx, --z80->sp, *((u8*)&z80->pc));
 #endif
 					z80->pc = (u16)t;
 				}
@@ -2381,11 +2384,11 @@ s32 z80_run( z80_machine_t *z80, s32 cycles ) {
 				t = GETSHORT(z80);
 				if(!GETFLAG(z80, FL_CARRY)) {
 #ifdef LITTLE_ENDIAN
-					z80->mem_write(--z80->sp, *((u8*)&z80->pc));
-					z80->mem_write(--z80->sp, *(((u8*)&z80->pc) + 1));
+					z80->mem_write(z80->ctx, --z80->sp, *((u8*)&z80->pc));
+					z80->mem_write(z80->ctx, --z80->sp, *(((u8*)&z80->pc) + 1));
 #else
-					z80->mem_write(--z80->sp, *(((u8*)&z80->pc) + 1));
-					z80->mem_write(--z80->sp, *((u8*)&z80->pc));
+					z80->mem_write(z80->ctx, --z80->sp, *(((u8*)&z80->pc) + 1));
+					z80->mem_write(z80->ctx, --z80->sp, *((u8*)&z80->pc));
 #endif
 					z80->pc = (u16)t;
 				}
@@ -2395,11 +2398,11 @@ s32 z80_run( z80_machine_t *z80, s32 cycles ) {
 				t = GETSHORT(z80);
 				if(GETFLAG(z80, FL_CARRY)) {
 #ifdef LITTLE_ENDIAN
-					z80->mem_write(--z80->sp, *((u8*)&z80->pc));
-					z80->mem_write(--z80->sp, *(((u8*)&z80->pc) + 1));
+					z80->mem_write(z80->ctx, --z80->sp, *((u8*)&z80->pc));
+					z80->mem_write(z80->ctx, --z80->sp, *(((u8*)&z80->pc) + 1));
 #else
-					z80->mem_write(--z80->sp, *(((u8*)&z80->pc) + 1));
-					z80->mem_write(--z80->sp, *((u8*)&z80->pc));
+					z80->mem_write(z80->ctx, --z80->sp, *(((u8*)&z80->pc) + 1));
+					z80->mem_write(z80->ctx, --z80->sp, *((u8*)&z80->pc));
 #endif
 					z80->pc = (u16)t;
 				}
@@ -2415,33 +2418,33 @@ s32 z80_run( z80_machine_t *z80, s32 cycles ) {
 			case OP_RST_38:
 				op1 = ((opc >> 3) & 0x07) * 8;
 #ifdef LITTLE_ENDIAN
-				z80->mem_write(--z80->sp, *((u8*)&z80->pc));
-				z80->mem_write(--z80->sp, *(((u8*)&z80->pc) + 1));
+				z80->mem_write(z80->ctx, --z80->sp, *((u8*)&z80->pc));
+				z80->mem_write(z80->ctx, --z80->sp, *(((u8*)&z80->pc) + 1));
 #else
-				z80->mem_write(--z80->sp, *(((u8*)&z80->pc) + 1));
-				z80->mem_write(--z80->sp, *((u8*)&z80->pc));
+				z80->mem_write(z80->ctx, --z80->sp, *(((u8*)&z80->pc) + 1));
+				z80->mem_write(z80->ctx, --z80->sp, *((u8*)&z80->pc));
 #endif
 				z80->pc = op1;
 				break;
 
 			case OP_RET:
 #ifdef LITTLE_ENDIAN
-				*(((u8*)&z80->pc) + 1) = z80->mem_read(z80->sp++);
-				*((u8*)&z80->pc) = z80->mem_read(z80->sp++);
+				*(((u8*)&z80->pc) + 1) = z80->mem_read(z80->ctx, z80->sp++);
+				*((u8*)&z80->pc) = z80->mem_read(z80->ctx, z80->sp++);
 #else
-				*((u8*)&z80->pc) = z80->mem_read(z80->sp++);
-				*(((u8*)&z80->pc) + 1) = z80->mem_read(z80->sp++);
+				*((u8*)&z80->pc) = z80->mem_read(z80->ctx, z80->sp++);
+				*(((u8*)&z80->pc) + 1) = z80->mem_read(z80->ctx, z80->sp++);
 #endif
 				break;
 
 			case OP_RET_NZ:
 				if(!GETFLAG(z80, FL_ZERO)) {
 #ifdef LITTLE_ENDIAN
-					*(((u8*)&z80->pc) + 1) = z80->mem_read(z80->sp++);
-					*((u8*)&z80->pc) = z80->mem_read(z80->sp++);
+					*(((u8*)&z80->pc) + 1) = z80->mem_read(z80->ctx, z80->sp++);
+					*((u8*)&z80->pc) = z80->mem_read(z80->ctx, z80->sp++);
 #else
-					*((u8*)&z80->pc) = z80->mem_read(z80->sp++);
-					*(((u8*)&z80->pc) + 1) = z80->mem_read(z80->sp++);
+					*((u8*)&z80->pc) = z80->mem_read(z80->ctx, z80->sp++);
+					*(((u8*)&z80->pc) + 1) = z80->mem_read(z80->ctx, z80->sp++);
 #endif
 				}
 				break;
@@ -2449,11 +2452,11 @@ s32 z80_run( z80_machine_t *z80, s32 cycles ) {
 			case OP_RET_Z:
 				if(GETFLAG(z80, FL_ZERO)) {
 #ifdef LITTLE_ENDIAN
-					*(((u8*)&z80->pc) + 1) = z80->mem_read(z80->sp++);
-					*((u8*)&z80->pc) = z80->mem_read(z80->sp++);
+					*(((u8*)&z80->pc) + 1) = z80->mem_read(z80->ctx, z80->sp++);
+					*((u8*)&z80->pc) = z80->mem_read(z80->ctx, z80->sp++);
 #else
-					*((u8*)&z80->pc) = z80->mem_read(z80->sp++);
-					*(((u8*)&z80->pc) + 1) = z80->mem_read(z80->sp++);
+					*((u8*)&z80->pc) = z80->mem_read(z80->ctx, z80->sp++);
+					*(((u8*)&z80->pc) + 1) = z80->mem_read(z80->ctx, z80->sp++);
 #endif
 				}
 				break;
@@ -2461,11 +2464,11 @@ s32 z80_run( z80_machine_t *z80, s32 cycles ) {
 			case OP_RET_NC:
 				if(!GETFLAG(z80, FL_CARRY)) {
 #ifdef LITTLE_ENDIAN
-					*(((u8*)&z80->pc) + 1) = z80->mem_read(z80->sp++);
-					*((u8*)&z80->pc) = z80->mem_read(z80->sp++);
+					*(((u8*)&z80->pc) + 1) = z80->mem_read(z80->ctx, z80->sp++);
+					*((u8*)&z80->pc) = z80->mem_read(z80->ctx, z80->sp++);
 #else
-					*((u8*)&z80->pc) = z80->mem_read(z80->sp++);
-					*(((u8*)&z80->pc) + 1) = z80->mem_read(z80->sp++);
+					*((u8*)&z80->pc) = z80->mem_read(z80->ctx, z80->sp++);
+					*(((u8*)&z80->pc) + 1) = z80->mem_read(z80->ctx, z80->sp++);
 #endif
 				}
 				break;
@@ -2473,22 +2476,22 @@ s32 z80_run( z80_machine_t *z80, s32 cycles ) {
 			case OP_RET_C:
 				if(GETFLAG(z80, FL_CARRY)) {
 #ifdef LITTLE_ENDIAN
-					*(((u8*)&z80->pc) + 1) = z80->mem_read(z80->sp++);
-					*((u8*)&z80->pc) = z80->mem_read(z80->sp++);
+					*(((u8*)&z80->pc) + 1) = z80->mem_read(z80->ctx, z80->sp++);
+					*((u8*)&z80->pc) = z80->mem_read(z80->ctx, z80->sp++);
 #else
-					*((u8*)&z80->pc) = z80->mem_read(z80->sp++);
-					*(((u8*)&z80->pc) + 1) = z80->mem_read(z80->sp++);
+					*((u8*)&z80->pc) = z80->mem_read(z80->ctx, z80->sp++);
+					*(((u8*)&z80->pc) + 1) = z80->mem_read(z80->ctx, z80->sp++);
 #endif
 				}
 				break;
 
 			case OP_RETI:
 #ifdef LITTLE_ENDIAN
-				*(((u8*)&z80->pc) + 1) = z80->mem_read(z80->sp++);
-				*((u8*)&z80->pc) = z80->mem_read(z80->sp++);
+				*(((u8*)&z80->pc) + 1) = z80->mem_read(z80->ctx, z80->sp++);
+				*((u8*)&z80->pc) = z80->mem_read(z80->ctx, z80->sp++);
 #else
-				*((u8*)&z80->pc) = z80->mem_read(z80->sp++);
-				*(((u8*)&z80->pc) + 1) = z80->mem_read(z80->sp++);
+				*((u8*)&z80->pc) = z80->mem_read(z80->ctx, z80->sp++);
+				*(((u8*)&z80->pc) + 1) = z80->mem_read(z80->ctx, z80->sp++);
 #endif
 				/* enable interrupts */
 				z80->IFF = 1;
@@ -2501,7 +2504,7 @@ s32 z80_run( z80_machine_t *z80, s32 cycles ) {
 
 	}
 
-	return left;
+	return (s32)(end - z80->cycles);
 }
 
 /**
@@ -2524,11 +2527,11 @@ s32 z80_interrupt( z80_machine_t *z80, u16 isr_addr ) {
 		return 0;
 
 #ifdef LITTLE_ENDIAN
-	z80->mem_write(--z80->sp, *((u8*)&z80->pc));
-	z80->mem_write(--z80->sp, *(((u8*)&z80->pc) + 1));
+	z80->mem_write(z80->ctx, --z80->sp, *((u8*)&z80->pc));
+	z80->mem_write(z80->ctx, --z80->sp, *(((u8*)&z80->pc) + 1));
 #else
-	z80->mem_write(--z80->sp, *(((u8*)&z80->pc) + 1));
-	z80->mem_write(--z80->sp, *((u8*)&z80->pc));
+	z80->mem_write(z80->ctx, --z80->sp, *(((u8*)&z80->pc) + 1));
+	z80->mem_write(z80->ctx, --z80->sp, *((u8*)&z80->pc));
 #endif
 
 	/* disable interrupts */
@@ -48,6 +48,11 @@ MA  02110-1301, USA.
  typedef char s8;
  typedef short s16;
  typedef int s32;
+ #ifdef WIN32
+  typedef unsigned __int64 u64;
+ #else
+  typedef unsigned long long u64;
+ #endif
 #else
  #error "Unknown architecture, please define datatype size"
 #endif
@@ -58,12 +63,14 @@ MA  02110-1301, USA.
 #endif
 
 #define ERRHALT	0xFFFF0000
-#define GETBYTE(x) (x->mem_read(x->pc++))
+#define GETBYTE(x) (x->mem_read(x->ctx, x->pc++))
 
 #ifdef LITTLE_ENDIAN
- #define GETSHORT(x) ((x->mem_read(++x->pc) << 8) | x->mem_read(x->pc++ - 1))
+ #define GETSHORT(x) ((x->mem_read(x->ctx, ++x->pc) << 8) | \
+	x->mem_read(x->ctx, x->pc++ - 1))
 #else
- #define GETSHORT(x) ((x->mem_read(x->pc++) << 8) | x->mem_read(x->pc++))
+ #define GETSHORT(x) ((x->mem_read(x->ctx, x->pc++) << 8) | \
+	x->mem_read(x->ctx, x->pc++))
 #endif
 
 #define FL_ZERO		(1 << 7)
@@ -117,9 +124,11 @@ typedef struct {
 		};
 		u16 HL;
 	} u_hl;
-	u8 (*mem_read)(u16 addr);
-	void (*mem_write)(u16 addr, u8 data);
+	u8 (*mem_read)(void *ctx, u16 addr);
+	void (*mem_write)(void *ctx, u16 addr, u8 data);
+	void *ctx; /* passed to mem_read and mem_write */
 	u8 IFF; /* interrupt enable flip-flop */
+	u32 cycles; /* clock cycles executed so far, wraps around */
 } z80_machine_t;
 
 typedef enum {